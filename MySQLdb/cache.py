@@ -0,0 +1,339 @@
+"""
+MySQLdb Result Cache
+--------------------
+
+This module implements an optional client-side cache for the results
+of read-only queries. Pass a ResultCache to MySQLdb.connect() as
+result_cache; it may be shared by several connections.
+
+Results are keyed by the final query text plus the connection's
+host, port, account, current database and character set. Only the raw
+column values are kept, so cached rows are decoded again each time
+they are served, exactly as if they had come from the server.
+
+Each entry is tagged with the tables the statement names after FROM
+and JOIN and those its columns come from, for invalidate(). Results
+that cannot be tied to any table, such as those of stored functions,
+are not kept.
+
+"""
+
+import re
+import time
+from array import array
+from itertools import islice
+from threading import Lock
+
+_STRINGS = re.compile(r"'(?:[^'\\]|\\.|'')*'|\"(?:[^\"\\]|\\.|\"\")*\"")
+_UNCACHEABLE = re.compile(
+    r"\bFOR\s+(?:UPDATE|SHARE)\b|\bLOCK\s+IN\s+SHARE\s+MODE\b|\bINTO\b|@"
+    r"|\b(?:NOW|SYSDATE|CURDATE|CURTIME|CURRENT_DATE|CURRENT_TIME"
+    r"|CURRENT_TIMESTAMP|LOCALTIME|LOCALTIMESTAMP|UNIX_TIMESTAMP|UTC_DATE"
+    r"|UTC_TIME|UTC_TIMESTAMP|RAND|UUID|UUID_SHORT|GET_LOCK|RELEASE_LOCK"
+    r"|RELEASE_ALL_LOCKS|IS_FREE_LOCK|IS_USED_LOCK|LAST_INSERT_ID|ROW_COUNT"
+    r"|FOUND_ROWS|CONNECTION_ID|CURRENT_USER|SESSION_USER|SYSTEM_USER|USER"
+    r"|DATABASE|SCHEMA|SLEEP|BENCHMARK|MASTER_POS_WAIT|NEXTVAL|LASTVAL)\b",
+    re.I)
+_NAME = r"(?:`(?:[^`]|``)+`|[\w$]+)"
+_TABLES = re.compile(r"\b(?:FROM|JOIN)\s*\(*(.*?)(?=\b(?:WHERE|GROUP|HAVING"
+                     r"|ORDER|LIMIT|UNION|ON|USING|FROM|JOIN|INNER|OUTER|LEFT"
+                     r"|RIGHT|CROSS|NATURAL|STRAIGHT_JOIN|WINDOW|SELECT)\b"
+                     r"|[();]|$)", re.I | re.S)
+_TABLE = re.compile(r"\s*(%s)(?:\s*\.\s*(%s))?" % (_NAME, _NAME))
+_USE = re.compile(r"(?:^|;)\s*USE\b", re.I)
+
+
+def _unquote(name):
+    if name.startswith('`'):
+        name = name[1:-1].replace('``', '`')
+    return name.lower()
+
+
+def tables(query, db=None):
+    """Return the set of tables query names after FROM and JOIN,
+    lowercased, each as 'table' and, if the database is named or db is
+    given, 'db.table'."""
+    names = set()
+    for match in _TABLES.finditer(_STRINGS.sub("''", query)):
+        for part in match.group(1).split(','):
+            m = _TABLE.match(part)
+            if m is None:
+                continue
+            if m.group(2):
+                schema, table = _unquote(m.group(1)), _unquote(m.group(2))
+            else:
+                schema, table = db and db.lower(), _unquote(m.group(1))
+            if table == 'dual':
+                continue
+            names.add(table)
+            if schema:
+                names.add("%s.%s" % (schema, table))
+    return names
+
+
+class CachedField(object):
+
+    """Stand-in for _mysql.field, as seen by decoders."""
+
+    __slots__ = ('result', 'name', 'org_name', 'table', 'org_table', 'db',
+                 'catalog', 'length', 'max_length', 'decimals', 'charsetnr',
+                 'flags', 'type')
+
+    def __init__(self, result, metadata):
+        self.result = result
+        (self.name, self.org_name, self.table, self.org_table, self.db,
+         self.catalog, self.length, self.max_length, self.decimals,
+         self.charsetnr, self.flags, self.type) = metadata
+
+
+class CachedEntry(object):
+
+    """The raw rows of one result set, packed into a single string.
+
+    lengths holds one entry per cell; -1 marks NULL. key is that of
+    ResultCache.key(). tags is None if the result could not be tied to
+    any table."""
+
+    __slots__ = ('key', 'description', 'field_flags', 'fields', 'data',
+                 'lengths', 'nrows', 'tags', 'expires', 'size')
+
+    def __init__(self, key, result, ttl):
+        self.key = key
+        self.description = result.describe()
+        self.field_flags = result.field_flags()
+        self.fields = tuple([ (f.name, f.org_name, f.table, f.org_table, f.db,
+                               f.catalog, f.length, f.max_length, f.decimals,
+                               f.charsetnr, f.flags, f.type)
+                              for f in result.fields ])
+        cells = []
+        lengths = array('l')
+        nrows = 0
+        for row in result:
+            for col in row:
+                if col is None:
+                    lengths.append(-1)
+                else:
+                    lengths.append(len(col))
+                    cells.append(col)
+            nrows += 1
+        self.data = ''.join(cells)
+        self.lengths = lengths
+        self.nrows = nrows
+        tags = tables(key[-1], key[1][1])
+        untied = False
+        for f in result.fields:
+            if f.org_table:
+                tags.add(f.org_table.lower())
+                if f.db:
+                    tags.add("%s.%s" % (f.db.lower(), f.org_table.lower()))
+            else:
+                untied = True
+        # a computed column with no table in sight may read any
+        self.tags = not (untied and not tags) and frozenset(tags) or None
+        self.expires = time.time() + ttl
+        self.size = len(self.data) + lengths.itemsize * len(lengths) + \
+                    len(key[-1]) + 256 * len(self.fields)
+
+    def open(self, connection):
+        """Return a result object reading this entry, bound to the
+        given _mysql connection."""
+        return CachedResult(self, connection)
+
+
+class CachedResult(object):
+
+    """Serves a CachedEntry through the subset of the _mysql.result
+    interface that cursors.Result uses."""
+
+    use = 0
+
+    def __init__(self, entry, connection):
+        self.entry = entry
+        self.connection = connection
+        self.fields = tuple([ CachedField(self, m) for m in entry.fields ])
+        self._row = 0
+        self._cell = 0
+        self._offset = 0
+
+    def describe(self):
+        return self.entry.description
+
+    def field_flags(self):
+        return self.entry.field_flags
+
+    def num_fields(self):
+        return len(self.fields)
+
+    def num_rows(self):
+        return self.entry.nrows
+
+    def fetch_row(self):
+        entry = self.entry
+        if self._row >= entry.nrows:
+            return None
+        data, lengths = entry.data, entry.lengths
+        cell, offset = self._cell, self._offset
+        row = []
+        for i in xrange(len(self.fields)):
+            n = lengths[cell]
+            cell += 1
+            if n < 0:
+                row.append(None)
+            else:
+                row.append(data[offset:offset+n])
+                offset += n
+        self._row += 1
+        self._cell, self._offset = cell, offset
+        return tuple(row)
+
+    def fetch_all(self, maxrows=0):
+        if maxrows > 0:
+            return list(islice(self, maxrows))
+        return list(self)
+
+    def memory_usage(self):
+        return self.entry.size
+
+    def __iter__(self):
+        return iter(self.fetch_row, None)
+
+    def clear(self):
+        self._row = self.entry.nrows
+
+
+class ResultCache(object):
+
+    """A size-bounded LRU cache of query results.
+
+    ttl
+      default number of seconds an entry stays valid
+
+    max_bytes
+      approximate upper bound on the memory held by cached rows;
+      least recently used entries are evicted to stay below it
+
+    max_entry_bytes
+      results larger than this are never cached (default max_bytes/4)
+
+    """
+
+    def __init__(self, ttl=60, max_bytes=64 * 1024 * 1024,
+                 max_entry_bytes=None):
+        self.ttl = ttl
+        self.max_bytes = max_bytes
+        if max_entry_bytes is None:
+            max_entry_bytes = max_bytes // 4
+        self.max_entry_bytes = max_entry_bytes
+        self.size = 0
+        self.hits = 0
+        self.misses = 0
+        self._entries = {}
+        self._tags = {}
+        # circular doubly-linked list of [prev, next, key]; most recent last
+        self._root = root = []
+        root[:] = [root, root, None]
+        self._links = {}
+        self._lock = Lock()
+
+    def __len__(self):
+        return len(self._entries)
+
+    def cacheable(self, query):
+        """Return True if query looks like a single read-only SELECT
+        whose result depends only on the tables it reads: not a locking
+        read, not SELECT ... INTO, and calling none of the functions
+        that depend on the time, the session or chance."""
+        if query.lstrip()[:6].upper() != 'SELECT':
+            return False
+        text = _STRINGS.sub("''", query)
+        return ';' not in text and not _UNCACHEABLE.search(text)
+
+    def changes_database(self, query):
+        """Return True if query may change the current database, so
+        that the session's scope has to be read again."""
+        return bool(_USE.search(_STRINGS.sub("''", query)))
+
+    def key(self, connection, query):
+        """Return the key of query run on connection: the server, the
+        account, the current database and the character set."""
+        return (connection._cache_scope, connection._cache_session(),
+                connection.character_set_name(), query)
+
+    def get(self, key):
+        """Return the live entry for key, or None."""
+        self._lock.acquire()
+        try:
+            entry = self._entries.get(key)
+            if entry is not None and entry.expires <= time.time():
+                self._remove(key)
+                entry = None
+            if entry is None:
+                self.misses += 1
+                return None
+            link = self._links[key]
+            link[0][1], link[1][0] = link[1], link[0]
+            root = self._root
+            last = root[0]
+            link[0], link[1] = last, root
+            last[1] = root[0] = link
+            self.hits += 1
+            return entry
+        finally:
+            self._lock.release()
+
+    def store(self, key, result, ttl=None):
+        """Read all of result (a _mysql.result) into a new entry for
+        key and return it. The entry is only retained if it fits."""
+        if ttl is None:
+            ttl = self.ttl
+        entry = CachedEntry(key, result, ttl)
+        if ttl <= 0 or entry.size > self.max_entry_bytes or \
+                entry.tags is None:
+            return entry
+        self._lock.acquire()
+        try:
+            if key in self._entries:
+                self._remove(key)
+            self._entries[key] = entry
+            root = self._root
+            last = root[0]
+            last[1] = root[0] = self._links[key] = [last, root, key]
+            for tag in entry.tags:
+                self._tags.setdefault(tag, set()).add(key)
+            self.size += entry.size
+            while self.size > self.max_bytes:
+                self._remove(root[1][2])
+        finally:
+            self._lock.release()
+        return entry
+
+    def invalidate(self, *tags):
+        """Discard all entries built from any of the given tables. A tag
+        is a table name, optionally qualified as 'db.table'."""
+        self._lock.acquire()
+        try:
+            for tag in tags:
+                for key in list(self._tags.get(tag.lower(), ())):
+                    self._remove(key)
+        finally:
+            self._lock.release()
+
+    def clear(self):
+        """Discard all entries."""
+        self._lock.acquire()
+        try:
+            for key in self._entries.keys():
+                self._remove(key)
+        finally:
+            self._lock.release()
+
+    def _remove(self, key):
+        entry = self._entries.pop(key)
+        link = self._links.pop(key)
+        link[0][1], link[1][0] = link[1], link[0]
+        for tag in entry.tags:
+            keys = self._tags[tag]
+            keys.discard(key)
+            if not keys:
+                del self._tags[tag]
+        self.size -= entry.size
@@ -0,0 +1,309 @@
+"""
+MySQLdb Query Capture
+---------------------
+
+This module records query traffic so that it can be replayed offline.
+Pass a QueryCapture to MySQLdb.connect() as capture; it may be shared
+by several connections.
+
+Every result set a cursor reads is recorded with the query text, the
+field metadata and status, and the column values as they came from
+the server, before any decoding. Statements that fail are recorded
+with their error. A Replay reads the file back: each result set can be
+served through the _mysql.result interface by MySQLdb.cache's
+CachedResult, and so decoded exactly as if it had come from the
+server. tests/replay.py uses it to benchmark the decoding of captured
+traffic, or to serve it from tests/mockserver.py.
+
+The file is gzip-compressed. Each record is a marshalled tuple,
+preceded by its length as 4 bytes, little-endian:
+
+    ('MySQLdb-capture', version, time, client_info, byteorder)
+    ('result', time, query, index, status, description, field_flags,
+     fields, nrows, lengths, data)
+    ('error', time, query, index, errno, message)
+
+The first record is the header. index numbers the result sets of one
+query from 0. status is that of connection.status(), and fields are
+the field metadata as MySQLdb.cache keeps it. lengths is the
+array('i') of cell lengths, row after row, as a string in the
+header's byteorder, with -1 for NULL; data is the non-NULL cells
+joined.
+
+"""
+
+import gzip
+import marshal
+import random
+import struct
+import sys
+import time
+from array import array
+from threading import Lock
+
+import _mysql
+from MySQLdb.cache import CachedResult
+
+MAGIC = 'MySQLdb-capture'
+VERSION = 1
+
+
+def _fields(result):
+    return tuple([ (f.name, f.org_name, f.table, f.org_table, f.db,
+                    f.catalog, f.length, f.max_length, f.decimals,
+                    f.charsetnr, f.flags, f.type)
+                   for f in result.fields ])
+
+
+class CapturedQuery(object):
+
+    """The result sets of one statement, as a cursor reads them."""
+
+    __slots__ = ('capture', 'query', 'results')
+
+    def __init__(self, capture, query):
+        self.capture = capture
+        self.query = query
+        self.results = 0
+
+    def result(self, result, status):
+        """Begin recording the next result set; result is a
+        _mysql.result, or None if the statement returned no rows."""
+        recorder = CapturedRows(self, self.results, result, status)
+        self.results += 1
+        return recorder
+
+    def error(self, e):
+        """Record the exception e, raised by the statement."""
+        if len(e.args) == 2:
+            errno, message = e.args
+        else:
+            errno, message = -1, str(e)
+        self.capture.write(('error', time.time(), self.query, self.results,
+                            errno, message))
+
+
+class CapturedRows(object):
+
+    """Collects the raw rows of one result set until it is finished."""
+
+    __slots__ = ('query', 'index', 'status', 'description', 'field_flags',
+                 'fields', 'cells', 'lengths', 'nrows', 'max_rows')
+
+    def __init__(self, query, index, result, status):
+        self.query = query
+        self.index = index
+        self.status = status
+        self.description = self.field_flags = self.fields = ()
+        if result:
+            self.description = result.describe()
+            self.field_flags = result.field_flags()
+            self.fields = _fields(result)
+        self.cells = []
+        self.lengths = array('i')
+        self.nrows = 0
+        self.max_rows = query.capture.max_rows
+
+    def add(self, rows):
+        """Record rows, tuples of strings or None, as fetched."""
+        cells, lengths = self.cells, self.lengths
+        for row in rows:
+            if self.max_rows is not None and self.nrows >= self.max_rows:
+                return
+            for col in row:
+                if col is None:
+                    lengths.append(-1)
+                else:
+                    lengths.append(len(col))
+                    cells.append(col)
+            self.nrows += 1
+
+    def finish(self):
+        """Write the result set."""
+        query = self.query
+        query.capture.write(('result', time.time(), query.query, self.index,
+                             self.status, self.description, self.field_flags,
+                             self.fields, self.nrows, self.lengths.tostring(),
+                             ''.join(self.cells)))
+        self.cells = self.lengths = None
+
+
+class QueryCapture(object):
+
+    """Writes the queries of the connections using it, and their raw
+    results, to a file.
+
+    path
+      the capture file; it is overwritten. It is complete once close()
+      has been called
+
+    max_rows
+      rows of a result set past this many are not recorded; the status
+      still gives the number the server returned
+
+    sample
+      fraction (0 to 1) of the statements that are recorded
+
+    """
+
+    def __init__(self, path, max_rows=None, sample=1.0):
+        self.path = path
+        self.max_rows = max_rows
+        self.sample = sample
+        self.results = 0
+        self.errors = 0
+        self._file = gzip.open(path, 'wb')
+        self._lock = Lock()
+        self.write((MAGIC, VERSION, time.time(), _mysql.get_client_info(),
+                    sys.byteorder))
+
+    def start(self, query):
+        """Return a CapturedQuery for query, about to be sent, or None
+        if it is not sampled."""
+        if self.sample < 1.0 and random.random() >= self.sample:
+            return None
+        return CapturedQuery(self, query)
+
+    def write(self, record):
+        """Append one record to the file."""
+        data = marshal.dumps(record)
+        self._lock.acquire()
+        try:
+            if self._file is None:
+                return
+            self._file.write(struct.pack('<I', len(data)) + data)
+            if record[0] == 'result':
+                self.results += 1
+            elif record[0] == 'error':
+                self.errors += 1
+        finally:
+            self._lock.release()
+
+    def close(self):
+        """Finish the file. Later records are dropped."""
+        self._lock.acquire()
+        try:
+            if self._file is not None:
+                self._file.close()
+                self._file = None
+        finally:
+            self._lock.release()
+
+
+class _Connection(object):
+
+    """What decoders look at on the connection of a replayed result."""
+
+    def __init__(self, charset):
+        self.charset = charset
+
+    def character_set_name(self):
+        return self.charset
+
+
+class ReplayedResult(object):
+
+    """A recorded result set, in the form of a MySQLdb.cache.CachedEntry
+    so that CachedResult can serve it. fields is () if the statement
+    returned no result set."""
+
+    __slots__ = ('time', 'query', 'index', 'status', 'description',
+                 'field_flags', 'fields', 'nrows', 'lengths', 'data', 'size')
+
+    def __init__(self, record, swap):
+        (self.time, self.query, self.index, self.status, self.description,
+         self.field_flags, self.fields, self.nrows, lengths,
+         self.data) = record[1:]
+        self.lengths = array('i', lengths)
+        if swap:
+            self.lengths.byteswap()
+        self.size = len(self.data) + len(lengths)
+
+    @property
+    def charset(self):
+        return self.status[4]
+
+    def open(self, connection=None):
+        """Return a result object reading the rows, as a _mysql.result
+        of connection would. Without a connection, decoders see one
+        whose character set is the one recorded."""
+        if connection is None:
+            connection = _Connection(self.charset)
+        return CachedResult(self, connection)
+
+    def rows(self):
+        """Return the rows as tuples of strings or None."""
+        return self.open().fetch_all()
+
+
+class ReplayedError(object):
+
+    """A statement that failed with (errno, message)."""
+
+    __slots__ = ('time', 'query', 'index', 'errno', 'message')
+
+    def __init__(self, record):
+        (self.time, self.query, self.index, self.errno,
+         self.message) = record[1:]
+
+
+def _read(f):
+    head = f.read(4)
+    if len(head) < 4:
+        return None
+    n, = struct.unpack('<I', head)
+    data = f.read(n)
+    if len(data) < n:
+        return None
+    return marshal.loads(data)
+
+
+class Replay(object):
+
+    """Reads a file written by QueryCapture. Iterating over it yields a
+    ReplayedResult or ReplayedError for each record, in the order they
+    were written; a file cut short ends at its last whole record."""
+
+    def __init__(self, path):
+        self.path = path
+        f = gzip.open(path, 'rb')
+        try:
+            header = _read(f)
+        finally:
+            f.close()
+        if not isinstance(header, tuple) or header[0] != MAGIC:
+            raise ValueError("%s is not a MySQLdb capture file" % path)
+        if header[1] > VERSION:
+            raise ValueError("%s is a version %d capture file; this is "
+                             "version %d" % (path, header[1], VERSION))
+        self.version, self.started, self.client_info, self.byteorder = \
+            header[1:]
+
+    def __iter__(self):
+        swap = self.byteorder != sys.byteorder
+        f = gzip.open(self.path, 'rb')
+        try:
+            _read(f)
+            while True:
+                try:
+                    record = _read(f)
+                except (IOError, EOFError, ValueError):
+                    break
+                if record is None:
+                    break
+                if record[0] == 'result':
+                    yield ReplayedResult(record, swap)
+                elif record[0] == 'error':
+                    yield ReplayedError(record)
+        finally:
+            f.close()
+
+    def queries(self):
+        """Return (query, records) pairs, the records of each execution
+        of a statement grouped together, in order."""
+        out = []
+        for record in self:
+            if record.index == 0 or not out or out[-1][0] != record.query:
+                out.append((record.query, []))
+            out[-1][1].append(record)
+        return out
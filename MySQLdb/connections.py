@@ -33,6 +33,14 @@ class Connection(object):
     """MySQL Database Connection Object"""
 
     errorhandler = defaulterrorhandler
+    warnings_policy = 'eager'
+    result_cache = None
+    slow_query_log = None
+    capture = None
+    max_result_memory = None
+    memory_high_water = 0
+    _pending_warnings = None
+    _session_scope = None
 
     from MySQLdb.exceptions import Warning, Error, InterfaceError, DataError, \
          DatabaseError, OperationalError, IntegrityError, InternalError, \
@@ -75,6 +83,15 @@ class Connection(object):
         compress
           if set, compression is enabled
 
+        compression_algorithms
+          string, comma-separated compression algorithms the client
+          permits, e.g. "zstd,zlib,uncompressed" (MySQL-8.0.18 and newer
+          client library; NotSupportedError otherwise)
+
+        zstd_compression_level
+          integer, compression level used with zstd (MySQL-8.0.18 and
+          newer client library; NotSupportedError otherwise)
+
         named_pipe
           if set, a named pipe is used to connect (Windows only)
 
@@ -117,6 +134,42 @@ class Connection(object):
         local_infile
           integer, non-zero enables LOAD LOCAL INFILE; zero disables
 
+        warnings_policy
+          how warnings from the server are handled after each statement:
+          'eager' (default) fetches them with SHOW WARNINGS right away and
+          reports them via the warnings module; 'lazy' only records the
+          warning count, and fetches the details into cursor.messages when
+          that or cursor.warnings() is read; 'off' ignores them.
+
+        result_cache
+          a MySQLdb.cache.ResultCache; if supplied, the results of
+          single SELECT statements are served from it when possible.
+          Entries are kept apart by account and current database,
+          which is read from the server when the cache is first used
+          and after USE or select_db(). They expire by TTL and can be
+          dropped by table name with result_cache.invalidate(); the
+          cache does not notice writes on its own.
+
+        max_result_memory
+          integer; if set, a result set estimated to need more than
+          this many bytes raises OperationalError. A stored result is
+          checked once the client library has read all of it, before
+          any row is decoded, so the limit bounds what is decoded, not
+          what the library buffers; use_result() cursors are checked
+          every few rows as they arrive, which bounds both. The largest
+          result seen so far is kept in the memory_high_water
+          attribute, which may be reset to 0.
+
+        slow_query_log
+          a MySQLdb.slowlog.SlowQueryLog; if supplied, statements whose
+          execution, fetching and decoding together take longer than
+          its threshold are written to it, with their call site.
+
+        capture
+          a MySQLdb.capture.QueryCapture; if supplied, statements and
+          the raw rows of their results are recorded to it, to be
+          replayed offline (see tests/replay.py).
+
         There are a number of undocumented, non-standard methods. See the
         documentation for the MySQL C API for some hints on what they do.
 
@@ -147,11 +200,27 @@ class Connection(object):
 
         sql_mode = kwargs2.pop('sql_mode', None)
 
+        warnings_policy = kwargs2.pop('warnings_policy', 'eager')
+        if warnings_policy not in ('eager', 'lazy', 'off'):
+            raise ValueError("warnings_policy must be 'eager', 'lazy' or 'off'")
+        self.warnings_policy = warnings_policy
+
+        self.result_cache = kwargs2.pop('result_cache', None)
+        self.slow_query_log = kwargs2.pop('slow_query_log', None)
+        self.capture = kwargs2.pop('capture', None)
+        self.max_result_memory = kwargs2.pop('max_result_memory', None)
+        self._cache_scope = (kwargs.get('host'), kwargs.get('port'),
+                             kwargs.get('unix_socket'))
+
         self._db = _mysql.connection(*args, **kwargs2)
 
         self._server_version = tuple(
             [ int(n) for n in self._db.get_server_info().split('.')[:2] ])
 
+        self._charset = charset
+        self._sql_mode = sql_mode
+        self._init_command = kwargs.get('init_command')
+
         if charset:
             self._db.set_character_set(charset)
 
@@ -166,6 +235,7 @@ class Connection(object):
         self._active_cursor = None
 
     def autocommit(self, do_autocommit):
+        self._capture_warnings()
         self._autocommit = do_autocommit
         return self._db.autocommit(do_autocommit)
 
@@ -175,14 +245,60 @@ class Connection(object):
         return self._db.ping(reconnect)
 
     def commit(self):
+        self._capture_warnings()
         return self._db.commit()
 
     def rollback(self):
+        self._capture_warnings()
         return self._db.rollback()
 
     def close(self):
         return self._db.close()
 
+    def reset(self):
+        """Return the session to the state it was in when this Connection
+        was created, without reconnecting. Any open transaction is rolled
+        back and temporary tables and user variables are discarded; then
+        init_command, charset, sql_mode and autocommit are applied again.
+        Useful for recycling pooled connections.
+
+        Non-standard."""
+        self._pending_warnings = None
+        if self._active_cursor and self._active_cursor.connection:
+            self._active_cursor._flush()
+        self._session_scope = None
+        self._db.reset()
+        if self._init_command:
+            self._db.query(self._init_command)
+            while True:
+                self._db.get_result()
+                if not self._db.next_result():
+                    break
+        if self._charset:
+            self._set_character_set(self._charset)
+        if self._sql_mode:
+            self.set_sql_mode(self._sql_mode)
+        if self._transactional:
+            self.autocommit(False)
+
+    def select_db(self, db):
+        """Make db the current database.
+
+        Non-standard."""
+        self._capture_warnings()
+        self._session_scope = None
+        self._db.select_db(db)
+
+    def _cache_session(self):
+        """Return (account, current database), the part of the result
+        cache key that the session can change, reading it from the
+        server when first needed and after it may have changed."""
+        if self._session_scope is None:
+            self._capture_warnings()
+            self._db.query("SELECT CURRENT_USER(), DATABASE()")
+            self._session_scope = self._db.get_result().fetch_row()
+        return self._session_scope
+
     def escape_string(self, s):
         return self._db.escape_string(s)
 
@@ -195,7 +311,7 @@ class Connection(object):
         cursorclass parameter is used to create the Cursor. By default,
         self.cursorclass=cursors.Cursor is used.
         """
-        if self._active_cursor:
+        if self._active_cursor and self._active_cursor.connection:
             self._active_cursor._flush()
 
         if not encoders:
@@ -244,13 +360,17 @@ class Connection(object):
         Non-standard. It is better to set the character set when creating the
         connection using the charset parameter."""
         if self.character_set_name() != charset:
-            try:
-                self._db.set_character_set(charset)
-            except AttributeError:
-                if self._server_version < (4, 1):
-                    raise self.NotSupportedError("server is too old to set charset")
-                self._db.query('SET NAMES %s' % charset)
-                self._db.get_result()
+            self._capture_warnings()
+            self._set_character_set(charset)
+
+    def _set_character_set(self, charset):
+        try:
+            self._db.set_character_set(charset)
+        except AttributeError:
+            if self._server_version < (4, 1):
+                raise self.NotSupportedError("server is too old to set charset")
+            self._db.query('SET NAMES %s' % charset)
+            self._db.get_result()
 
     def set_sql_mode(self, sql_mode):
         """Set the connection sql_mode. See MySQL documentation for legal
@@ -260,9 +380,44 @@ class Connection(object):
         using the sql_mode parameter."""
         if self._server_version < (4, 1):
             raise self.NotSupportedError("server is too old to set sql_mode")
+        self._capture_warnings()
         self._db.query("SET SESSION sql_mode='%s'" % sql_mode)
         self._db.get_result()
 
+    def compression_stats(self):
+        """Return a dict comparing the uncompressed bytes exchanged on
+        this connection with what went over the wire:
+
+        bytes_sent, bytes_received
+          uncompressed query text sent and row data received, as
+          counted by the client
+
+        wire_bytes_sent, wire_bytes_received
+          bytes the server counted for this session on the network,
+          after compression
+
+        compression, algorithm, level
+          the session's compression status, where the server reports it
+
+        Requires MySQL-5.0 or newer. The status query itself is included
+        in the wire counts.
+
+        Non-standard."""
+        self._capture_warnings()
+        self._db.query("SHOW SESSION STATUS WHERE Variable_name IN "
+                       "('Bytes_sent', 'Bytes_received', 'Compression', "
+                       "'Compression_algorithm', 'Compression_level')")
+        status = dict(self._db.get_result())
+        return {
+            'bytes_sent': self._db.bytes_sent,
+            'bytes_received': self._db.bytes_received,
+            'wire_bytes_sent': long(status.get('Bytes_received', 0)),
+            'wire_bytes_received': long(status.get('Bytes_sent', 0)),
+            'compression': status.get('Compression'),
+            'algorithm': status.get('Compression_algorithm'),
+            'level': status.get('Compression_level'),
+            }
+
     def _warning_count(self):
         """Return the number of warnings generated from the last query."""
         if hasattr(self._db, "warning_count"):
@@ -285,4 +440,23 @@ class Connection(object):
         self._db.query("SHOW WARNINGS")
         return tuple(self._db.get_result())
 
-
+    def _capture_warnings(self):
+        """Fetch any warnings a cursor has deferred (see
+        Cursor._warning_check) before another statement clears them from
+        the server. They are dropped if rows or results of that cursor are
+        still unread, as SHOW WARNINGS cannot be sent until they are,
+        and by then the warnings are gone."""
+        pending, self._pending_warnings = self._pending_warnings, None
+        if pending:
+            cursor = pending()
+            if cursor is not None and cursor._lazy_warnings:
+                if cursor._warnings_readable():
+                    cursor._report_warnings(cursor._issue_warnings)
+                else:
+                    cursor._lazy_warnings = False
+
+    def _more_results(self):
+        """Return True if the last query has unread results."""
+        if hasattr(self._db, "more_results"):
+            return self._db.more_results()
+        return False
@@ -9,10 +9,20 @@ create Cursors direction; use connection.cursor() instead.
 
 import re
 import sys
+import tempfile
+import time
 import weakref
+import _mysql
 from MySQLdb.converters import get_codec
 from warnings import warn
 
+# use_result() rows are accounted for in batches of this many
+MEMORY_CHECK_ROWS = 1024
+
+# rows formatted, and objects and bytes allocated for them, by every
+# result created while _mysql.alloc_profile() is on
+_format_allocs = [0, 0, 0]
+
 INSERT_VALUES = re.compile(r"(?P<start>.+values\s*)"
                            r"(?P<values>\(((?<!\\)'[^\)]*?\)[^\)]*(?<!\\)?'|[^\(\)]|(?:\([^\)]*\)))+\))"
                            r"(?P<end>.*)", re.I)
@@ -29,6 +39,23 @@ class Cursor(object):
     arraysize
         default number of rows fetchmany() will fetch
 
+    cache_ttl
+        seconds results of this cursor's queries stay in the
+        connection's result_cache; None uses the cache's default,
+        and 0 bypasses the cache
+
+    max_buffer
+        with use_result set, the number of rows already fetched that
+        are kept for scrolling back; older rows are discarded so
+        memory stays bounded. None keeps every row.
+
+    spill_dir
+        if set (and use_result is not), results are read into a
+        memory-mapped temporary file in this directory instead of
+        client memory, and decoded as they are fetched, with at most
+        max_buffer rows kept; scrolling anywhere stays possible.
+        '' uses the system's temporary directory.
+
     """
 
     from MySQLdb.exceptions import MySQLError, Warning, Error, InterfaceError, \
@@ -37,6 +64,11 @@ class Cursor(object):
 
     _defer_warnings = False
     _fetch_type = None
+    _timing = None
+    _capture = None
+    cache_ttl = None
+    max_buffer = 1000
+    spill_dir = None
 
     def __init__(self, connection, encoders, decoders, row_formatter):
         self.connection = weakref.proxy(connection)
@@ -45,13 +77,12 @@ class Cursor(object):
         self.arraysize = 1
         self._executed = None
         self.lastrowid = None
-        self.messages = []
+        self._messages = []
+        self._lazy_warnings = False
+        self._issue_warnings = False
         self.errorhandler = connection.errorhandler
         self._result = None
         self._pending_results = []
-        self._warnings = 0
-        self._info = None
-        self.rownumber = None
         self.maxrows = 0
         self.encoders = encoders
         self.decoders = decoders
@@ -59,18 +90,42 @@ class Cursor(object):
         self.row_formatter = row_formatter
         self.use_result = False
 
+    @property
+    def messages(self):
+        """List of (exception class, value) tuples for the last
+        operation. With the 'lazy' warnings policy, reading this
+        fetches any warnings the last statement left on the server."""
+        if self._lazy_warnings and self._warnings_readable():
+            self._report_warnings(self._issue_warnings)
+        return self._messages
+
+    @property
+    def rownumber(self):
+        """Index of the next row fetchone() will return, or None."""
+        if self._result:
+            return self._result.rownumber
+        return None
+
     @property
     def description(self):
         if self._result:
             return self._result.description
         return None
 
+    def alloc_stats(self):
+        """Allocation counts of the current result set, as returned by
+        Result.alloc_stats(), or None."""
+        if self._result:
+            return self._result.alloc_stats()
+        return None
+
     def _flush(self):
         """_flush() reads to the end of the current result set, buffering what
         it can, and then releases the result set."""
         if self._result:
             self._result.flush()
-            self._result = None
+        self.connection._capture_warnings()
+        self._result = None
         db = self._get_db()
         while db.next_result():
             result = Result(self)
@@ -95,7 +150,8 @@ class Cursor(object):
             result = db.get_result(True)
             if result:
                 result.clear()
-        del self.messages[:]
+        self._lazy_warnings = False
+        del self._messages[:]
 
     def close(self):
         """Close the cursor. No further queries will be possible."""
@@ -116,20 +172,66 @@ class Cursor(object):
             self.errorhandler(self, self.ProgrammingError, "execute() first")
 
     def _warning_check(self):
-        """Check for warnings, and report via the warnings module."""
-        from warnings import warn
-        if self._warnings:
-            warnings = self._get_db()._show_warnings()
-            if warnings:
-                # This is done in two loops in case
-                # Warnings are set to raise exceptions.
-                for warning in warnings:
-                    self.messages.append((self.Warning, warning))
+        """Check for warnings according to the connection's
+        warnings_policy. 'eager' fetches them now and reports them via
+        the warnings module; 'lazy' only records that there are some,
+        leaving them to be fetched when messages or warnings() is read;
+        'off' ignores them. SHOW WARNINGS cannot be sent while rows or
+        results of the query are unread, so 'eager' then defers them as
+        'lazy' does, and reports them once they are fetched."""
+        result = self._result
+        if not result or not result.warning_count:
+            return
+        policy = self.connection.warnings_policy
+        if policy == 'eager' and self._warnings_readable():
+            self._report_warnings(True)
+        elif policy in ('eager', 'lazy'):
+            self._lazy_warnings = True
+            self._issue_warnings = policy == 'eager'
+            self.connection._pending_warnings = weakref.ref(self)
+
+    def _warnings_readable(self):
+        """Return True if SHOW WARNINGS can be sent for the current
+        result: its rows have all been read (an unbuffered result may
+        still be streaming) and no further result of the query is
+        waiting on the server."""
+        result = self._result
+        if result and result.result and result.result.use:
+            return False
+        return not self.connection._more_results()
+
+    def _report_warnings(self, issue=False):
+        """Fetch the current result's warnings into messages. If issue
+        is True, also report them via the warnings module."""
+        self._lazy_warnings = False
+        result = self._result
+        if not result:
+            return
+        warnings = result.warnings()
+        if warnings:
+            # This is done in two loops in case
+            # Warnings are set to raise exceptions.
+            for warning in warnings:
+                self._messages.append((self.Warning, warning))
+            if issue:
                 for warning in warnings:
-                    warn(warning[-1], self.Warning, 3)
-            elif self._info:
-                self.messages.append((self.Warning, self._info))
-                warn(self._info, self.Warning, 3)
+                    warn(warning[-1], self.Warning, 4)
+        elif result.info:
+            self._messages.append((self.Warning, result.info))
+            if issue:
+                warn(result.info, self.Warning, 4)
+
+    def warnings(self):
+        """Return the warnings generated by the last statement as a
+        tuple of (Level, Code, Message) tuples, fetching them from the
+        server if that has not been done yet.
+
+        Non-standard."""
+        if self._lazy_warnings and self._warnings_readable():
+            self._report_warnings(self._issue_warnings)
+        if not self._result:
+            return ()
+        return self._result.warnings()
 
     def nextset(self):
         """Advance to the next result set.
@@ -138,6 +240,7 @@ class Cursor(object):
         """
         db = self._get_db()
         self._result.clear()
+        self.connection._capture_warnings()
         self._result = None
         if self._pending_results:
             self._result = self._pending_results[0]
@@ -177,9 +280,8 @@ class Cursor(object):
         """
         db = self._get_db()
         self._clear()
-        charset = db.character_set_name()
         if isinstance(query, unicode):
-            query = query.encode(charset)
+            query = query.encode(db.character_set_name())
         try:
             if args is not None:
                 query = query % tuple(( get_codec(a, self.encoders)(db, a) for a in args ))
@@ -225,9 +327,8 @@ class Cursor(object):
         self._clear()
         if not args:
             return
-        charset = self.connection.character_set_name()
         if isinstance(query, unicode):
-            query = query.encode(charset)
+            query = query.encode(db.character_set_name())
         matched = INSERT_VALUES.match(query)
         if not matched:
             rowcount = 0
@@ -322,8 +423,42 @@ class Cursor(object):
         connection = self._get_db()
         self._flush()
         self._executed = query
-        connection.query(query)
-        self._result = Result(self)
+        log = self.connection.slow_query_log
+        self._timing = log is not None and log.start(connection, query) or None
+        capture = self.connection.capture
+        self._capture = capture is not None and capture.start(query) or None
+        cache = self.connection.result_cache
+        if cache is not None and cache.changes_database(query):
+            self.connection._session_scope = None
+        if cache is not None and self.cache_ttl != 0 and not self.use_result \
+                and self.spill_dir is None and cache.cacheable(query):
+            self._cached_query(cache, query)
+            return
+        try:
+            connection.query(query)
+            self._result = Result(self)
+        except self.Error, e:
+            if self._capture is not None:
+                self._capture.error(e)
+            raise
+
+    def _cached_query(self, cache, query):
+        """Serve query from the result cache, running it and caching
+        the raw rows on a miss."""
+        db = self._get_db()
+        key = cache.key(self.connection, query)
+        entry = cache.get(key)
+        if entry is None:
+            db.query(query)
+            result = db.get_result()
+            status = db.status()
+            if not result or status[2]:
+                self._result = Result(self, result, status)
+                return
+            entry = cache.store(key, result, self.cache_ttl)
+            result.clear()
+        self._result = Result(self, entry.open(db),
+                              (0L, long(entry.nrows), 0, None, key[2]))
 
     def fetchone(self):
         """Fetches a single row from the cursor. None indicates that
@@ -365,28 +500,117 @@ class Cursor(object):
         else:
             self.errorhandler(self, self.ProgrammingError,
                               "unknown scroll mode %s" % `mode`)
-        if row < 0 or row >= len(self._rows):
+        if not self._result:
             self.errorhandler(self, IndexError, "out of range")
-        self.rownumber = row
+        self._result.seek(row)
+
+
+def rows_size(rows, sample=16):
+    """Approximate bytes held by a list of decoded rows and their
+    values, extrapolated from an evenly spaced sample of rows. Values
+    shared between rows, such as None, are counted once per use."""
+    n = len(rows)
+    size = sys.getsizeof(rows)
+    if not n:
+        return size
+    sampled = rows[::max(1, n // sample)]
+    total = 0
+    for row in sampled:
+        values = isinstance(row, dict) and row.values() or row
+        total += sys.getsizeof(row) + sum(map(sys.getsizeof, values))
+    return size + total * n // len(sampled)
+
+
+def allocations(rows):
+    """Return (objects, bytes) allocated for rows, a list: each row, and
+    each of its values that nothing else refers to (so not None,
+    interned strings or cached small ints)."""
+    objects = size = 0
+    for row in rows:
+        objects += 1
+        size += sys.getsizeof(row)
+        if isinstance(row, dict):
+            values = row.itervalues()
+        elif isinstance(row, (tuple, list)):
+            values = row
+        else:
+            continue
+        for v in values:
+            # the row, v and getrefcount's argument
+            if sys.getrefcount(v) == 3:
+                objects += 1
+                size += sys.getsizeof(v)
+    return objects, size
+
+
+def _count_allocs(counts, rows):
+    """Add rows, just formatted, and the objects and bytes allocated for
+    them to counts and to the module totals."""
+    objects, size = allocations(rows)
+    for c in counts, _format_allocs:
+        c[0] += len(rows)
+        c[1] += objects
+        c[2] += size
+
+
+def _alloc_dict(rows, objects, size):
+    n = float(rows or 1)
+    return {'rows': rows, 'objects': objects, 'bytes': size,
+            'objects_per_row': objects / n, 'bytes_per_row': size / n}
+
+
+def alloc_stats(reset=False):
+    """Return the allocations counted while _mysql.alloc_profile() is
+    on, for every result since the last reset: a dict with 'fetch', the
+    row tuples built by _mysql (see _mysql.alloc_stats()), and 'format',
+    the rows made of them by the cursor's row formatter. Each is a dict
+    of rows, objects, bytes, objects_per_row and bytes_per_row. If
+    reset is true, the counts are zeroed afterwards."""
+    r = {'fetch': _mysql.alloc_stats(reset),
+         'format': _alloc_dict(*_format_allocs)}
+    if reset:
+        _format_allocs[:] = [0, 0, 0]
+    return r
 
 
 class Result(object):
 
-    def __init__(self, cursor):
+    def __init__(self, cursor, result=None, status=None):
         self.cursor = cursor
         db = cursor._get_db()
-        result = db.get_result(cursor.use_result)
+        spill_dir = None
+        if cursor.spill_dir is not None and not cursor.use_result:
+            spill_dir = cursor.spill_dir or tempfile.gettempdir()
+        self._spilled = spill_dir is not None
+        if status is None:
+            result = db.get_result(cursor.use_result, spill_dir)
+            status = db.status()
         self.result = result
+        # [rows, objects, bytes] formatted, and the _mysql result whose
+        # own counts outlive self.result, if profiling allocations
+        self._allocs = None
+        if result and _mysql.alloc_profile():
+            self._allocs = [0, 0, 0]
+            self._fetched = result
+        # the SlowQuery timing the statement this result belongs to
+        self._timing, cursor._timing = cursor._timing, None
+        # the CapturedRows recording the raw rows, if capturing
+        self._capture = None
+        if cursor._capture is not None:
+            self._capture = cursor._capture.result(result, status)
         decoders = cursor.decoders
         self.row_formatter = cursor.row_formatter
-        self.max_buffer = 1000
+        self.max_buffer = cursor.max_buffer
         self.rows = []
         self.row_start = 0
-        self.rows_read = 0
         self.row_index = 0
-        self.lastrowid = db.insert_id()
-        self.warning_count = db.warning_count()
-        self.info = db.info()
+        self.rows_memory = 0
+        # rows before this one were captured and counted already
+        self._rows_seen = 0
+        self._next_check = MEMORY_CHECK_ROWS
+        self.lastrowid, affected_rows, self.warning_count, self.info, \
+                        self.charset = status
+        self._warnings = None
         self.rowcount = -1
         self.description = None
         self.field_flags = ()
@@ -396,28 +620,181 @@ class Result(object):
             self.description = result.describe()
             self.field_flags = result.field_flags()
             self.row_decoders = tuple(( get_codec(field, decoders) for field in result.fields ))
-            if not cursor.use_result:
-                self.rowcount = db.affected_rows()
+            if self._spilled:
+                self.rowcount = result.num_rows()
+            elif not cursor.use_result:
+                self.rowcount = affected_rows
+                self._check_memory()
                 self.flush()
+        else:
+            self._finish()
 
     def flush(self):
         if self.result:
-            self.rows.extend([ self.row_formatter(self.row_decoders, row) for row in self.result ])
+            if (self.result.use or self._spilled) and \
+                    self.cursor.connection.max_result_memory:
+                rows = self.result.fetch_all(MEMORY_CHECK_ROWS)
+                while rows:
+                    self._append(rows)
+                    rows = self.result.fetch_all(MEMORY_CHECK_ROWS)
+            else:
+                self._append(self.result.fetch_all())
             self.result.clear()
             self.result = None
+            self._finish()
+
+    def _finish(self):
+        """Called once every row has been read and decoded."""
+        timing, self._timing = self._timing, None
+        if timing is not None:
+            timing.finish()
+        capture, self._capture = self._capture, None
+        if capture is not None:
+            capture.finish()
+
+    def _unseen(self, rows):
+        """Return the rows, about to be appended to the buffer, that
+        were not read before: seek() on a spilled result can read rows
+        from the file again, and they are captured and counted once."""
+        start = self.row_start + len(self.rows)
+        seen = self._rows_seen - start
+        self._rows_seen = max(self._rows_seen, start + len(rows))
+        if seen > 0:
+            return rows[seen:]
+        return rows
+
+    def _append(self, rows):
+        unseen = self._unseen(rows)
+        if self._capture is not None:
+            self._capture.add(unseen)
+        timing = self._timing
+        if timing is not None:
+            start = time.time()
+        rows = map(self.row_formatter, [self.row_decoders] * len(rows), rows)
+        if timing is not None:
+            timing.decode += time.time() - start
+            timing.rows += len(unseen)
+        if self._allocs is not None:
+            _count_allocs(self._allocs, rows)
+        if self.rows:
+            self.rows.extend(rows)
+        else:
+            self.rows = rows
+        self._check_memory()
+
+    def _check_memory(self):
+        """Update the accounted size of the decoded rows and the
+        connection's high-water mark, and enforce max_result_memory."""
+        self.rows_memory = rows_size(self.rows)
+        self._next_check = self.row_start + len(self.rows) + MEMORY_CHECK_ROWS
+        size = self.memory_usage()
+        connection = self.cursor.connection
+        if size > connection.memory_high_water:
+            connection.memory_high_water = size
+        limit = connection.max_result_memory
+        if limit and size > limit:
+            self.clear()
+            self.rows = []
+            self.rows_memory = 0
+            cursor = self.cursor
+            cursor.errorhandler(cursor, cursor.OperationalError,
+                                "result needs about %d bytes, more than "
+                                "max_result_memory (%d)" % (size, limit))
+
+    def memory_usage(self):
+        """Approximate bytes held by this result: the rows still
+        buffered by the client library plus the decoded rows."""
+        size = self.rows_memory
+        if self.result:
+            size += self.result.memory_usage()
+        return size
+
+    def alloc_stats(self):
+        """Return the allocations counted for this result set if
+        _mysql.alloc_profile() was on when it was created, or None: a
+        dict with 'fetch' and 'format', in the form of alloc_stats()."""
+        if self._allocs is None:
+            return None
+        return {'fetch': self._fetched.alloc_stats(),
+                'format': _alloc_dict(*self._allocs)}
 
     def clear(self):
         if self.result:
             self.result.clear()
             self.result = None
+            self._finish()
+
+    @property
+    def rownumber(self):
+        return self.row_start + self.row_index
+
+    def _read_row(self):
+        """Decode the next row of a use_result() result into the
+        buffer. Returns False at the end of the result set."""
+        row = self.result.fetch_row()
+        if row is None:
+            self._finish()
+            return False
+        if self.max_buffer is not None and self.row_index >= self.max_buffer:
+            # drop the oldest consumed rows, keeping half a buffer
+            # behind the current position for scrolling back
+            drop = self.row_index - self.max_buffer // 2
+            del self.rows[:drop]
+            self.row_start += drop
+            self.row_index -= drop
+        unseen = len(self._unseen((row,)))
+        if self._capture is not None and unseen:
+            self._capture.add((row,))
+        timing = self._timing
+        if timing is None:
+            self.rows.append(self.row_formatter(self.row_decoders, row))
+        else:
+            start = time.time()
+            self.rows.append(self.row_formatter(self.row_decoders, row))
+            timing.decode += time.time() - start
+            timing.rows += unseen
+        if self._allocs is not None:
+            _count_allocs(self._allocs, self.rows[-1:])
+        if self.row_start + len(self.rows) >= self._next_check:
+            self._check_memory()
+        return True
+
+    def seek(self, row):
+        """Make row, counted from the start of the result set, the
+        next one to be fetched."""
+        if row < 0:
+            self.cursor.errorhandler(self.cursor, IndexError, "out of range")
+        if self._spilled and self.result and \
+                not self.row_start <= row < self.row_start + len(self.rows):
+            # spilled rows can be read from anywhere in the file
+            if row >= self.result.num_rows():
+                self.cursor.errorhandler(self.cursor, IndexError,
+                                         "out of range")
+            self.result.data_seek(row)
+            self.rows = []
+            self.row_start = row
+            self.row_index = 0
+            return
+        if row < self.row_start:
+            cursor = self.cursor
+            cursor.errorhandler(cursor, cursor.NotSupportedError,
+                                "cannot scroll back to row %d; only rows "
+                                "from %d on are still buffered (max_buffer=%s)"
+                                % (row, self.row_start, self.max_buffer))
+        if self.result:
+            # rows skipped over count as fetched, so they can be dropped
+            while row - self.row_start >= len(self.rows):
+                self.row_index = len(self.rows)
+                if not self._read_row():
+                    break
+        if row - self.row_start >= len(self.rows):
+            self.cursor.errorhandler(self.cursor, IndexError, "out of range")
+        self.row_index = row - self.row_start
 
     def fetchone(self):
         if self.result:
-            while self.row_index >= len(self.rows):
-                row = self.result.fetch_row()
-                if row is None:
-                    return row
-                self.rows.append(self.row_formatter(self.row_decoders, row))
+            if self.row_index >= len(self.rows) and not self._read_row():
+                return None
         if self.row_index >= len(self.rows):
             return None
         row = self.rows[self.row_index]
@@ -435,13 +812,10 @@ class Result(object):
     def fetchmany(self, size):
         """Fetch up to size rows from the cursor. Result set may be smaller
         than size. If size is not defined, cursor.arraysize is used."""
-        row_end = self.row_index + size
         if self.result:
-            while self.row_index >= len(self.rows):
-                row = self.result.fetch_row()
-                if row is None:
-                    break
-                self.rows.append(self.row_formatter(self.row_decoders, row))
+            while self.row_index + size > len(self.rows) and self._read_row():
+                pass
+        row_end = self.row_index + size
         if self.row_index >= len(self.rows):
             return []
         if row_end >= len(self.rows):
@@ -457,20 +831,13 @@ class Result(object):
         self.row_index = len(self.rows)
         return rows
 
-    def warning_check(self):
-        """Check for warnings, and report via the warnings module."""
-        if self.warning_count:
-            cursor = self.cursor
-            warnings = cursor._get_db()._show_warnings()
-            if warnings:
-                # This is done in two loops in case
-                # Warnings are set to raise exceptions.
-                for warning in warnings:
-                    cursor.warnings.append((self.Warning, warning))
-                for warning in warnings:
-                    warn(warning[-1], self.Warning, 3)
-            elif self._info:
-                cursor.messages.append((self.Warning, self._info))
-                warn(self._info, self.Warning, 3)
-
-
+    def warnings(self):
+        """Return the warnings for this result as a tuple of
+        (Level, Code, Message) tuples. They are fetched from the server
+        on first use, so this must be called before the connection
+        executes another statement."""
+        if self._warnings is None:
+            self._warnings = ()
+            if self.warning_count:
+                self._warnings = self.cursor.connection._show_warnings()
+        return self._warnings
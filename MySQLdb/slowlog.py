@@ -0,0 +1,296 @@
+"""
+MySQLdb Slow Query Log
+----------------------
+
+This module implements an optional client-side log of slow queries.
+Pass a SlowQueryLog to MySQLdb.connect() as slow_query_log; it may be
+shared by several connections.
+
+Unlike the server's slow log, it sees the time the client spends
+receiving and decoding rows, and knows which line of the application
+issued the query. Each entry is one line of JSON with:
+
+time
+  when the query finished, in seconds since the epoch
+
+digest, digest_text
+  the query with literals replaced by ?, and a hash of that, so that
+  entries for the same statement can be grouped
+
+query
+  the query text, cut to max_query_length
+
+total, execute, fetch, decode
+  seconds: total is the sum of the time spent executing the query,
+  receiving its rows from the server, and turning them into Python
+  values
+
+rows, bytes
+  rows decoded and bytes of row data received
+
+call_site
+  "file:line in function" of the first caller outside MySQLdb
+
+explain
+  for a sample of the logged SELECT statements, the rows of EXPLAIN
+  run on a separate connection, as dicts; or explain_error if that
+  failed. Entries sampled for EXPLAIN are written by a background
+  thread once it has run, so they may come out of order
+
+"""
+
+import json
+import logging
+import random
+import re
+import sys
+import time
+from hashlib import md5
+from logging.handlers import RotatingFileHandler
+from Queue import Queue, Full
+from threading import Lock, Thread
+
+_COMMENTS = re.compile(r"/\*.*?\*/|(?:--|#)[^\n]*", re.S)
+_LITERALS = re.compile(r"'(?:[^'\\]|\\.|'')*'"
+                       r'|"(?:[^"\\]|\\.|"")*"'
+                       r"|\b0x[0-9a-f]+\b"
+                       r"|(?<![\w`.])[-+]?\d+(?:\.\d*)?(?:e[-+]?\d+)?\b",
+                       re.I)
+_LISTS = re.compile(r"\(\s*\?(?:\s*,\s*\?)*\s*\)")
+_VALUES = re.compile(r"(\(\.\.\.\))(?:\s*,\s*\(\.\.\.\))+")
+_SPACE = re.compile(r"\s+")
+_QUOTED = re.compile(r"'(?:[^'\\]|\\.|'')*'"
+                     r'|"(?:[^"\\]|\\.|"")*"'
+                     r"|`(?:[^`]|``)*`", re.S)
+_EXPLAINABLE = re.compile(r"\s*\(*\s*SELECT\b", re.I)
+_MULTI_STATEMENTS_OFF = 1       # MYSQL_OPTION_MULTI_STATEMENTS_OFF
+_EXPLAIN_QUEUE = 100
+
+
+def digest(query):
+    """Return query normalized for grouping: comments dropped, string
+    and number literals replaced by ?, lists of them by (...), runs of
+    such lists (as in multi-row INSERTs) by one, and whitespace
+    collapsed."""
+    text = _COMMENTS.sub(' ', query)
+    text = _LITERALS.sub('?', text)
+    text = _LISTS.sub('(...)', text)
+    text = _VALUES.sub(r'\1', text)
+    return _SPACE.sub(' ', text).strip()
+
+
+def explainable(query):
+    """Return whether EXPLAIN may be run for query: a single SELECT,
+    with no ; outside quoted strings and names but a trailing one."""
+    if not _EXPLAINABLE.match(query):
+        return False
+    return ';' not in _QUOTED.sub('', query).rstrip().rstrip(';')
+
+
+def _call_site():
+    """Return "file:line in function" for the innermost frame that is
+    not in MySQLdb itself."""
+    frame = sys._getframe(2)
+    while frame is not None:
+        name = frame.f_globals.get('__name__', '')
+        if name != 'MySQLdb' and not name.startswith('MySQLdb.'):
+            code = frame.f_code
+            return "%s:%d in %s" % (code.co_filename, frame.f_lineno,
+                                    code.co_name)
+        frame = frame.f_back
+    return None
+
+
+class SlowQuery(object):
+
+    """Timings of one statement, from when a cursor sends it until its
+    result has been read and decoded."""
+
+    __slots__ = ('log', 'db', 'query', 'call_site', 'stats', 'decode',
+                 'rows')
+
+    def __init__(self, log, db, query):
+        self.log = log
+        self.db = db
+        self.query = query
+        self.call_site = _call_site()
+        self.stats = db.stats()
+        self.decode = 0.0
+        self.rows = 0
+
+    def finish(self):
+        """Log the statement if it took at least the threshold."""
+        before, after = self.stats, self.db.stats()
+        execute = (after['query_ns'] - before['query_ns']) / 1e9
+        fetch = (after['result_ns'] + after['fetch_ns'] -
+                 before['result_ns'] - before['fetch_ns']) / 1e9
+        total = execute + fetch + self.decode
+        if total < self.log.threshold:
+            return
+        self.log.record(self.query, self.call_site, total, execute, fetch,
+                        self.decode, self.rows,
+                        after['bytes_received'] - before['bytes_received'])
+
+
+class SlowQueryLog(object):
+
+    """Writes statements whose total client-side time reaches threshold
+    to a rotating file.
+
+    path
+      the log file; when it would grow past max_bytes, it is renamed to
+      path.1 (and older files to path.2 and so on, up to backup_count)
+
+    threshold
+      seconds of execute, fetch and decode time from which a statement
+      is logged
+
+    explain_sample
+      fraction (0 to 1) of the logged SELECT statements for which
+      EXPLAIN is run. It runs in a background thread, never on the
+      application's connection; statements with more than one
+      statement in them are not explained, and entries are written
+      without EXPLAIN while too many are waiting for it
+
+    explain_connect
+      a dict of MySQLdb.connect() arguments, or a function returning a
+      connection, for the separate connection EXPLAIN runs on; it is
+      opened when first needed, with multiple statements turned off
+
+    max_query_length
+      longer query texts are cut to this many characters
+
+    """
+
+    def __init__(self, path, threshold=1.0, max_bytes=10 * 1024 * 1024,
+                 backup_count=5, explain_sample=0.0, explain_connect=None,
+                 max_query_length=4096):
+        self.path = path
+        self.threshold = threshold
+        self.explain_sample = explain_sample
+        self.explain_connect = explain_connect
+        self.max_query_length = max_query_length
+        self.entries = 0
+        self._handler = RotatingFileHandler(path, maxBytes=max_bytes,
+                                            backupCount=backup_count,
+                                            delay=True)
+        self._handler.setFormatter(logging.Formatter('%(message)s'))
+        self._explain_db = None
+        self._explain_queue = None
+        self._explain_thread = None
+        self._closed = False
+        self._lock = Lock()
+
+    def start(self, db, query):
+        """Begin timing query, about to be sent on the _mysql
+        connection db."""
+        return SlowQuery(self, db, query)
+
+    def record(self, query, call_site, total, execute, fetch, decode, rows,
+               nbytes):
+        """Write one entry."""
+        text = digest(query)
+        entry = {
+            'time': time.time(),
+            'digest': md5(text).hexdigest()[:16],
+            'digest_text': text,
+            'query': query[:self.max_query_length],
+            'total': total,
+            'execute': execute,
+            'fetch': fetch,
+            'decode': decode,
+            'rows': rows,
+            'bytes': nbytes,
+            'call_site': call_site,
+            }
+        if self.explain_sample and random.random() < self.explain_sample \
+                and explainable(query) and self._queue_explain(query, entry):
+            return
+        self._write(entry)
+
+    def _write(self, entry):
+        line = json.dumps(entry, sort_keys=True, default=repr)
+        self._handler.handle(logging.makeLogRecord({'msg': line}))
+        self.entries += 1
+
+    def _queue_explain(self, query, entry):
+        """Hand entry to the EXPLAIN thread, starting it if need be;
+        return False if the queue is full or the log closed."""
+        self._lock.acquire()
+        try:
+            if self._closed:
+                return False
+            if self._explain_thread is None:
+                self._explain_queue = Queue(_EXPLAIN_QUEUE)
+                self._explain_thread = Thread(target=self._explain_loop,
+                                              name="SlowQueryLog EXPLAIN")
+                self._explain_thread.daemon = True
+                self._explain_thread.start()
+            try:
+                self._explain_queue.put_nowait((query, entry))
+            except Full:
+                return False
+            return True
+        finally:
+            self._lock.release()
+
+    def _explain_loop(self):
+        queue = self._explain_queue
+        while True:
+            item = queue.get()
+            if item is None:
+                break
+            query, entry = item
+            self._explain(query, entry)
+            self._write(entry)
+        self._close_explain()
+
+    def _explain(self, query, entry):
+        try:
+            if self._explain_db is None:
+                self._explain_db = self._connect()
+            cursor = self._explain_db.cursor()
+            try:
+                cursor.execute("EXPLAIN " + query.rstrip().rstrip(';'))
+                names = [ d[0] for d in cursor.description or () ]
+                entry['explain'] = [ dict(zip(names, row))
+                                     for row in cursor.fetchall() ]
+            finally:
+                cursor.close()
+        except Exception, e:
+            entry['explain_error'] = str(e)
+            self._close_explain()
+
+    def _connect(self):
+        connect = self.explain_connect
+        if callable(connect):
+            db = connect()
+        elif connect is None:
+            raise ValueError("explain_sample needs explain_connect")
+        else:
+            from MySQLdb.connections import Connection
+            db = Connection(**connect)
+        db._db.set_server_option(_MULTI_STATEMENTS_OFF)
+        return db
+
+    def _close_explain(self):
+        db, self._explain_db = self._explain_db, None
+        if db is not None:
+            try:
+                db.close()
+            except Exception:
+                pass
+
+    def close(self):
+        """Wait for the EXPLAIN thread to write the entries it has, then
+        close the log file and the EXPLAIN connection."""
+        self._lock.acquire()
+        try:
+            self._closed = True
+            thread, self._explain_thread = self._explain_thread, None
+        finally:
+            self._lock.release()
+        if thread is not None:
+            self._explain_queue.put(None)
+            thread.join()
+        self._handler.close()
@@ -18,6 +18,12 @@ metadata['ext_modules'] = [
                        'src/connections.c',
                        'src/results.c',
                        'src/fields.c',
+                       'src/spill.c',
+                       'src/export.c',
+                       'src/blob.c',
+                       'src/histogram.c',
+                       'src/gil.c',
+                       'src/synthetic.c',
                        ],
               **options),
     ]
@@ -0,0 +1,678 @@
+/* -*- mode: C; indent-tabs-mode: t; c-basic-offset: 8; -*- */
+
+#include "mysqlmod.h"
+
+#ifdef HAVE_MYSQL_STMT
+
+static void
+_mysql_BlobObject_free_binding(
+	_mysql_BlobObject *self)
+{
+	free(self->bind);
+	free(self->lengths);
+	free(self->nulls);
+	self->bind = NULL;
+	self->lengths = NULL;
+	self->nulls = NULL;
+}
+
+/* Closes the statement, which reads and discards whatever is left of
+   its result, and never raises, so it is safe as tp_clear. */
+static int
+_mysql_BlobObject_release(
+	_mysql_BlobObject *self)
+{
+	if (self->stmt) {
+		MYSQL_STMT *stmt = self->stmt;
+		self->stmt = NULL;
+		MYSQL_BEGIN_ALLOW_THREADS
+		mysql_stmt_close(stmt);
+		MYSQL_END_ALLOW_THREADS
+	}
+	_mysql_BlobObject_free_binding(self);
+	Py_CLEAR(self->conn);
+	return 0;
+}
+
+/* The statement's row points into the connection's network buffer,
+   which mysql_close() frees, so a blob is unusable once its connection
+   is closed. */
+#define check_blob(b) \
+	do { \
+		if (!(b)->stmt) { \
+			PyErr_SetString(PyExc_ValueError, \
+					"I/O operation on closed blob"); \
+			return NULL; \
+		} \
+		check_connection(((_mysql_ConnectionObject *) (b)->conn)); \
+	} while (0)
+
+/* Copies up to n bytes from the current position to dst and advances;
+   returns the number copied, or -1 with an exception set. */
+static Py_ssize_t
+_mysql_BlobObject_copy(
+	_mysql_BlobObject *self,
+	char *dst,
+	Py_ssize_t n)
+{
+	MYSQL_BIND bind;
+	unsigned long length = 0;
+	int r;
+
+	if (n > (Py_ssize_t) (self->size - self->pos))
+		n = (Py_ssize_t) (self->size - self->pos);
+	if (n <= 0)
+		return 0;
+	memset(&bind, 0, sizeof(bind));
+	bind.buffer_type = MYSQL_TYPE_BLOB;
+	bind.buffer = dst;
+	bind.buffer_length = (unsigned long) n;
+	bind.length = &length;
+	MYSQL_BEGIN_ALLOW_THREADS
+	r = mysql_stmt_fetch_column(self->stmt, &bind, self->column,
+				    self->pos);
+	MYSQL_END_ALLOW_THREADS
+	if (r) {
+		_mysql_StmtException((_mysql_ConnectionObject *) self->conn,
+				     self->stmt);
+		return -1;
+	}
+	self->pos += n;
+	return n;
+}
+
+static char _mysql_BlobObject_read__doc__[] =
+"read([size]) -- Reads at most size bytes, or everything up to the\n\
+end if size is negative or omitted, and returns them as a string.\n\
+An empty string means the end of the value.\n\
+";
+
+static PyObject *
+_mysql_BlobObject_read(
+	_mysql_BlobObject *self,
+	PyObject *args)
+{
+	Py_ssize_t size = -1;
+	PyObject *r;
+
+	if (!PyArg_ParseTuple(args, "|n:read", &size)) return NULL;
+	check_blob(self);
+	if (size < 0 || size > (Py_ssize_t) (self->size - self->pos))
+		size = (Py_ssize_t) (self->size - self->pos);
+	if (!(r = PyString_FromStringAndSize(NULL, size))) return NULL;
+	if (_mysql_BlobObject_copy(self, PyString_AS_STRING(r), size) < 0) {
+		Py_DECREF(r);
+		return NULL;
+	}
+	return r;
+}
+
+static char _mysql_BlobObject_readinto__doc__[] =
+"readinto(buffer) -- Reads up to len(buffer) bytes into the writable\n\
+buffer and returns the number read, 0 at the end of the value.\n\
+";
+
+static PyObject *
+_mysql_BlobObject_readinto(
+	_mysql_BlobObject *self,
+	PyObject *args)
+{
+	Py_buffer view;
+	Py_ssize_t n;
+
+	check_blob(self);
+	if (!PyArg_ParseTuple(args, "w*:readinto", &view)) return NULL;
+	n = _mysql_BlobObject_copy(self, view.buf, view.len);
+	PyBuffer_Release(&view);
+	if (n < 0) return NULL;
+	return PyInt_FromSsize_t(n);
+}
+
+static char _mysql_BlobObject_seek__doc__[] =
+"seek(offset[, whence]) -- Moves the position as file.seek() does:\n\
+whence is 0 (from the start), 1 (from the current position) or 2\n\
+(from the end). The position may not go before the start.\n\
+";
+
+static PyObject *
+_mysql_BlobObject_seek(
+	_mysql_BlobObject *self,
+	PyObject *args)
+{
+	PY_LONG_LONG offset, base;
+	int whence = 0;
+
+	if (!PyArg_ParseTuple(args, "L|i:seek", &offset, &whence)) return NULL;
+	check_blob(self);
+	switch (whence) {
+	case 0: base = 0; break;
+	case 1: base = self->pos; break;
+	case 2: base = self->size; break;
+	default:
+		PyErr_SetString(PyExc_ValueError, "invalid whence");
+		return NULL;
+	}
+	if (base + offset < 0) {
+		PyErr_SetString(PyExc_ValueError, "negative seek position");
+		return NULL;
+	}
+	/* reads past the end simply return nothing */
+	self->pos = base + offset > (PY_LONG_LONG) self->size ?
+		self->size : (unsigned long) (base + offset);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static char _mysql_BlobObject_tell__doc__[] =
+"tell() -- Returns the current position.\n\
+";
+
+static PyObject *
+_mysql_BlobObject_tell(
+	_mysql_BlobObject *self,
+	PyObject *unused)
+{
+	check_blob(self);
+	return PyLong_FromUnsignedLong(self->pos);
+}
+
+static char _mysql_BlobObject_close__doc__[] =
+"close() -- Closes the statement the value is read from, which frees\n\
+the connection for other queries. Closing twice is harmless.\n\
+";
+
+static PyObject *
+_mysql_BlobObject_close(
+	_mysql_BlobObject *self,
+	PyObject *unused)
+{
+	_mysql_BlobObject_release(self);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyObject *
+_mysql_BlobObject_enter(
+	_mysql_BlobObject *self,
+	PyObject *unused)
+{
+	check_blob(self);
+	Py_INCREF(self);
+	return (PyObject *) self;
+}
+
+static PyObject *
+_mysql_BlobObject_exit(
+	_mysql_BlobObject *self,
+	PyObject *args)
+{
+	_mysql_BlobObject_release(self);
+	Py_INCREF(Py_False);
+	return Py_False;
+}
+
+static PyObject *
+_mysql_BlobObject_get_closed(
+	_mysql_BlobObject *self,
+	void *closure)
+{
+	return PyBool_FromLong(!self->stmt);
+}
+
+static int
+_mysql_BlobObject_traverse(
+	_mysql_BlobObject *self,
+	visitproc visit,
+	void *arg)
+{
+	Py_VISIT(self->conn);
+	return 0;
+}
+
+static void
+_mysql_BlobObject_dealloc(
+	_mysql_BlobObject *self)
+{
+	PyObject_GC_UnTrack((PyObject *)self);
+	_mysql_BlobObject_release(self);
+	MyFree(self);
+}
+
+static PyObject *
+_mysql_BlobObject_repr(
+	_mysql_BlobObject *self)
+{
+	char buf[300];
+	sprintf(buf, "<%s _mysql.blob of %lu bytes at %lx>",
+		self->stmt ? "open" : "closed", self->size, (long)self);
+	return PyString_FromString(buf);
+}
+
+char _mysql_ConnectionObject_open_blob__doc__[] =
+"open_blob(query, column=0) -- Prepares and executes query, which\n\
+must not take parameters, and returns the value in the given column\n\
+of its first row as a file-like _mysql.blob, or None if there is no\n\
+row or the value is NULL. Reads copy slices of the value with\n\
+mysql_stmt_fetch_column(), so it is never turned into one Python\n\
+string; the client library still receives the row as a whole.\n\
+The connection cannot run other queries until the blob is closed.\n\
+Non-standard.\n\
+";
+
+PyObject *
+_mysql_ConnectionObject_open_blob(
+	_mysql_ConnectionObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"query", "column", NULL};
+	char *query;
+	int len, column = 0, r;
+	unsigned int i, n;
+	unsigned PY_LONG_LONG start;
+	MYSQL_STMT *stmt;
+	_mysql_BlobObject *blob;
+	PyObject *sql = NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#|i:open_blob", kwlist,
+					 &query, &len, &column))
+		return NULL;
+	check_connection(self);
+	if (!(stmt = mysql_stmt_init(&(self->connection))))
+		return _mysql_Exception(self);
+	if (!(blob = MyAlloc(_mysql_BlobObject, _mysql_BlobObject_Type))) {
+		mysql_stmt_close(stmt);
+		return NULL;
+	}
+	blob->stmt = stmt;
+	Py_INCREF(self);
+	blob->conn = (PyObject *) self;
+	if (_mysql_trace_hook) {
+		if (!(sql = PyString_FromStringAndSize(query, len)))
+			goto error;
+		_mysql_trace_query(self, sql);
+	}
+	MYSQL_BEGIN_ALLOW_THREADS
+	start = _mysql_clock_ns();
+	r = mysql_stmt_prepare(stmt, query, len);
+	if (!r)
+		r = mysql_stmt_execute(stmt);
+	start = _mysql_clock_ns() - start;
+	MYSQL_END_ALLOW_THREADS
+	self->stats.query_ns += start;
+	self->stats.queries++;
+	_mysql_record_query_latency(self, start);
+	if (sql && _mysql_trace_hook)
+		_mysql_trace_query_done(self, sql, start,
+					r ? mysql_stmt_errno(stmt) : 0, len);
+	Py_CLEAR(sql);
+	if (r) goto stmt_error;
+	self->bytes_sent += len;
+	n = mysql_stmt_field_count(stmt);
+	if (column < 0 || (unsigned int) column >= n) {
+		PyErr_SetString(_mysql_ProgrammingError,
+				n ? "column out of range" :
+				"query returned no result set");
+		goto error;
+	}
+	blob->column = column;
+	/* zero-length buffers: mysql_stmt_fetch() only reports lengths */
+	blob->bind = calloc(n, sizeof(MYSQL_BIND));
+	blob->lengths = calloc(n, sizeof(unsigned long));
+	blob->nulls = calloc(n, sizeof(_mysql_bool));
+	if (!blob->bind || !blob->lengths || !blob->nulls) {
+		PyErr_NoMemory();
+		goto error;
+	}
+	for (i=0; i<n; i++) {
+		blob->bind[i].buffer_type = MYSQL_TYPE_BLOB;
+		blob->bind[i].length = &blob->lengths[i];
+		blob->bind[i].is_null = &blob->nulls[i];
+	}
+	if (mysql_stmt_bind_result(stmt, blob->bind)) goto stmt_error;
+	MYSQL_BEGIN_ALLOW_THREADS
+	start = _mysql_clock_ns();
+	r = mysql_stmt_fetch(stmt);
+	start = _mysql_clock_ns() - start;
+	MYSQL_END_ALLOW_THREADS
+	self->stats.fetch_ns += start;
+	if (r == 1) goto stmt_error;
+	if (r == MYSQL_NO_DATA || blob->nulls[column]) {
+		Py_DECREF(blob);
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	self->stats.rows++;
+	for (i=0; i<n; i++)
+		self->bytes_received += blob->lengths[i];
+	blob->size = blob->lengths[column];
+	return (PyObject *) blob;
+  stmt_error:
+	_mysql_StmtException(self, stmt);
+  error:
+	Py_DECREF(blob);
+	return NULL;
+}
+
+char _mysql_ConnectionObject_stmt_execute__doc__[] =
+"stmt_execute(query, params=(), chunk_size=65536) -- Prepares query,\n\
+with ? placeholders, and executes it with params, returning the\n\
+number of affected rows. Each parameter is None, an int, long, float\n\
+or str, or an object with a read() method: that one is sent as a\n\
+BLOB in chunks of chunk_size bytes with mysql_stmt_send_long_data(),\n\
+so the value is never held in memory whole nor escaped. Any result\n\
+set is discarded. Non-standard.\n\
+";
+
+PyObject *
+_mysql_ConnectionObject_stmt_execute(
+	_mysql_ConnectionObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"query", "params", "chunk_size", NULL};
+	static char empty[1];
+	char *query;
+	int len, chunk_size = 65536, r;
+	PyObject *params = NULL, *seq = NULL, *sql = NULL, *result = NULL;
+	MYSQL_STMT *stmt;
+	MYSQL_BIND *bind = NULL;
+	unsigned long *lengths = NULL;
+	PY_LONG_LONG *ints = NULL;
+	double *floats = NULL;
+	Py_ssize_t i, n;
+	my_ulonglong affected;
+	unsigned PY_LONG_LONG start, elapsed = 0;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#|Oi:stmt_execute",
+					 kwlist, &query, &len, &params,
+					 &chunk_size))
+		return NULL;
+	check_connection(self);
+	if (chunk_size < 1) {
+		PyErr_SetString(PyExc_ValueError, "chunk_size must be positive");
+		return NULL;
+	}
+	if (params)
+		seq = PySequence_Fast(params, "params must be a sequence");
+	else
+		seq = PyTuple_New(0);
+	if (!seq)
+		return NULL;
+	if (!(stmt = mysql_stmt_init(&(self->connection)))) {
+		Py_DECREF(seq);
+		return _mysql_Exception(self);
+	}
+	self->stats.queries++;
+	if (_mysql_trace_hook) {
+		if (!(sql = PyString_FromStringAndSize(query, len)))
+			goto error;
+		_mysql_trace_query(self, sql);
+	}
+	MYSQL_BEGIN_ALLOW_THREADS
+	start = _mysql_clock_ns();
+	r = mysql_stmt_prepare(stmt, query, len);
+	elapsed = _mysql_clock_ns() - start;
+	MYSQL_END_ALLOW_THREADS
+	self->stats.query_ns += elapsed;
+	if (r) goto stmt_error;
+	self->bytes_sent += len;
+	n = PySequence_Fast_GET_SIZE(seq);
+	if ((unsigned long) n != mysql_stmt_param_count(stmt)) {
+		PyErr_Format(_mysql_ProgrammingError,
+			     "statement takes %lu parameters, %d given",
+			     mysql_stmt_param_count(stmt), (int) n);
+		goto error;
+	}
+	bind = calloc(n + 1, sizeof(MYSQL_BIND));
+	lengths = calloc(n + 1, sizeof(unsigned long));
+	ints = calloc(n + 1, sizeof(PY_LONG_LONG));
+	floats = calloc(n + 1, sizeof(double));
+	if (!bind || !lengths || !ints || !floats) {
+		PyErr_NoMemory();
+		goto error;
+	}
+	for (i=0; i<n; i++) {
+		PyObject *v = PySequence_Fast_GET_ITEM(seq, i);
+		MYSQL_BIND *b = &bind[i];
+		b->length = &lengths[i];
+		if (v == Py_None) {
+			b->buffer_type = MYSQL_TYPE_NULL;
+		} else if (PyInt_Check(v) || PyLong_Check(v)) {
+			ints[i] = PyLong_AsLongLong(v);
+			if (ints[i] == -1 && PyErr_Occurred())
+				goto error;
+			b->buffer_type = MYSQL_TYPE_LONGLONG;
+			b->buffer = &ints[i];
+		} else if (PyFloat_Check(v)) {
+			floats[i] = PyFloat_AS_DOUBLE(v);
+			b->buffer_type = MYSQL_TYPE_DOUBLE;
+			b->buffer = &floats[i];
+		} else if (PyString_Check(v)) {
+			b->buffer_type = MYSQL_TYPE_STRING;
+			b->buffer = PyString_AS_STRING(v);
+			b->buffer_length = lengths[i] = PyString_GET_SIZE(v);
+		} else if (PyObject_HasAttrString(v, "read")) {
+			/* a stream that sends no data is an empty value */
+			b->buffer_type = MYSQL_TYPE_LONG_BLOB;
+			b->buffer = empty;
+		} else {
+			PyErr_Format(PyExc_TypeError,
+				     "unsupported parameter type: %.200s",
+				     v->ob_type->tp_name);
+			goto error;
+		}
+	}
+	if (mysql_stmt_bind_param(stmt, bind)) goto stmt_error;
+	for (i=0; i<n; i++) {
+		PyObject *v = PySequence_Fast_GET_ITEM(seq, i);
+		if (bind[i].buffer != empty)
+			continue;
+		for (;;) {
+			PyObject *chunk;
+			if (!(chunk = PyObject_CallMethod(v, "read", "i",
+							  chunk_size)))
+				goto error;
+			if (!PyString_Check(chunk)) {
+				Py_DECREF(chunk);
+				PyErr_SetString(PyExc_TypeError,
+						"read() must return a string");
+				goto error;
+			}
+			if (!PyString_GET_SIZE(chunk)) {
+				Py_DECREF(chunk);
+				break;
+			}
+			MYSQL_BEGIN_ALLOW_THREADS
+			start = _mysql_clock_ns();
+			r = mysql_stmt_send_long_data(stmt, (unsigned int) i,
+						      PyString_AS_STRING(chunk),
+						      PyString_GET_SIZE(chunk));
+			start = _mysql_clock_ns() - start;
+			MYSQL_END_ALLOW_THREADS
+			self->stats.query_ns += start;
+			elapsed += start;
+			self->bytes_sent += PyString_GET_SIZE(chunk);
+			Py_DECREF(chunk);
+			if (r) goto stmt_error;
+		}
+	}
+	MYSQL_BEGIN_ALLOW_THREADS
+	start = _mysql_clock_ns();
+	r = mysql_stmt_execute(stmt);
+	start = _mysql_clock_ns() - start;
+	MYSQL_END_ALLOW_THREADS
+	self->stats.query_ns += start;
+	elapsed += start;
+	/* one sample for the whole statement: prepare, the streamed
+	   parameters and execute */
+	_mysql_record_query_latency(self, elapsed);
+	if (r) goto stmt_error;
+	affected = mysql_stmt_affected_rows(stmt);
+	result = PyLong_FromUnsignedLongLong(affected);
+	goto error;
+  stmt_error:
+	_mysql_StmtException(self, stmt);
+  error:
+	if (sql) {
+		if (_mysql_trace_hook)
+			_mysql_trace_query_done(self, sql, elapsed,
+						mysql_stmt_errno(stmt), len);
+		Py_DECREF(sql);
+	}
+	MYSQL_BEGIN_ALLOW_THREADS
+	mysql_stmt_close(stmt);
+	MYSQL_END_ALLOW_THREADS
+	free(bind);
+	free(lengths);
+	free(ints);
+	free(floats);
+	Py_DECREF(seq);
+	return result;
+}
+
+static PyMethodDef _mysql_BlobObject_methods[] = {
+	{
+		"read",
+		(PyCFunction)_mysql_BlobObject_read,
+		METH_VARARGS,
+		_mysql_BlobObject_read__doc__
+	},
+	{
+		"readinto",
+		(PyCFunction)_mysql_BlobObject_readinto,
+		METH_VARARGS,
+		_mysql_BlobObject_readinto__doc__
+	},
+	{
+		"seek",
+		(PyCFunction)_mysql_BlobObject_seek,
+		METH_VARARGS,
+		_mysql_BlobObject_seek__doc__
+	},
+	{
+		"tell",
+		(PyCFunction)_mysql_BlobObject_tell,
+		METH_NOARGS,
+		_mysql_BlobObject_tell__doc__
+	},
+	{
+		"close",
+		(PyCFunction)_mysql_BlobObject_close,
+		METH_NOARGS,
+		_mysql_BlobObject_close__doc__
+	},
+	{
+		"__enter__",
+		(PyCFunction)_mysql_BlobObject_enter,
+		METH_NOARGS,
+		NULL
+	},
+	{
+		"__exit__",
+		(PyCFunction)_mysql_BlobObject_exit,
+		METH_VARARGS,
+		NULL
+	},
+	{NULL,              NULL} /* sentinel */
+};
+
+static struct PyMemberDef _mysql_BlobObject_memberlist[] = {
+	{
+		"connection",
+		T_OBJECT,
+		offsetof(_mysql_BlobObject, conn),
+		RO,
+		"Connection the value is read from"
+	},
+	{
+		"size",
+		T_ULONG,
+		offsetof(_mysql_BlobObject, size),
+		RO,
+		"Length of the value in bytes"
+	},
+	{NULL} /* Sentinel */
+};
+
+static struct PyGetSetDef _mysql_BlobObject_getset[] = {
+	{
+		"closed",
+		(getter)_mysql_BlobObject_get_closed,
+		NULL,
+		"True if close() has been called"
+	},
+	{NULL} /* Sentinel */
+};
+
+static char _mysql_BlobObject__doc__[] =
+"A BLOB value read piecewise; see connection.open_blob().";
+
+PyTypeObject _mysql_BlobObject_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,
+	"_mysql.blob",
+	sizeof(_mysql_BlobObject),
+	0,
+	(destructor)_mysql_BlobObject_dealloc, /* tp_dealloc */
+	0, /*tp_print*/
+	0, /* tp_getattr */
+	0, /* tp_setattr */
+	0, /*tp_compare*/
+	(reprfunc)_mysql_BlobObject_repr, /* tp_repr */
+
+	/* Method suites for standard classes */
+
+	0, /* (PyNumberMethods *) tp_as_number */
+	0, /* (PySequenceMethods *) tp_as_sequence */
+	0, /* (PyMappingMethods *) tp_as_mapping */
+
+	/* More standard operations (here for binary compatibility) */
+
+	0, /* (hashfunc) tp_hash */
+	0, /* (ternaryfunc) tp_call */
+	0, /* (reprfunc) tp_str */
+	0, /* (getattrofunc) tp_getattro */
+	0, /* (setattrofunc) tp_setattro */
+
+	/* Functions to access object as input/output buffer */
+	0, /* (PyBufferProcs *) tp_as_buffer */
+
+	/* Flags to define presence of optional/expanded features */
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC, /* (long) tp_flags */
+
+	_mysql_BlobObject__doc__, /* (char *) tp_doc Documentation string */
+	/* call function for all accessible objects */
+	(traverseproc)_mysql_BlobObject_traverse, /* tp_traverse */
+	/* delete references to contained objects */
+	(inquiry)_mysql_BlobObject_release, /* tp_clear */
+
+	/* rich comparisons */
+	0, /* (richcmpfunc) tp_richcompare */
+
+	/* weak reference enabler */
+	0, /* (long) tp_weaklistoffset */
+
+	/* Iterators */
+	0, /* (getiterfunc) tp_iter */
+	0, /* (iternextfunc) tp_iternext */
+
+	/* Attribute descriptor and subclassing stuff */
+	(struct PyMethodDef *)_mysql_BlobObject_methods, /* tp_methods */
+	(struct PyMemberDef *)_mysql_BlobObject_memberlist, /*tp_members */
+	(struct PyGetSetDef *)_mysql_BlobObject_getset, /* tp_getset */
+	0, /* (struct _typeobject *) tp_base; */
+	0, /* (PyObject *) tp_dict */
+	0, /* (descrgetfunc) tp_descr_get */
+	0, /* (descrsetfunc) tp_descr_set */
+	0, /* (long) tp_dictoffset */
+	0, /* tp_init */
+	NULL, /* tp_alloc */
+	NULL, /* tp_new */
+	NULL, /* tp_free Low-level free-memory routine */
+	0, /* (PyObject *) tp_bases */
+	0, /* (PyObject *) tp_mro method resolution order */
+	0, /* (PyObject *) tp_defined */
+};
+
+#endif /* HAVE_MYSQL_STMT */
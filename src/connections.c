@@ -2,6 +2,34 @@
 
 #include "mysqlmod.h"
 
+/* Returns 0 if names, a comma-separated list, holds only compression
+   algorithms the server protocol knows; otherwise sets
+   ProgrammingError and returns -1. */
+static int
+_mysql_check_compression_algorithms(
+	const char *names)
+{
+	static const char *known[] = {"zlib", "zstd", "uncompressed", NULL};
+	const char *p = names;
+	size_t n;
+	int i;
+
+	do {
+		n = strcspn(p, ",");
+		for (i=0; known[i]; i++)
+			if (strlen(known[i]) == n && !strncmp(known[i], p, n))
+				break;
+		if (!known[i]) {
+			PyErr_Format(_mysql_ProgrammingError,
+				     "unknown compression algorithm in '%s'",
+				     names);
+			return -1;
+		}
+		p += n;
+	} while (*p++);
+	return 0;
+}
+
 static int
 _mysql_ConnectionObject_Initialize(
 	_mysql_ConnectionObject *self,
@@ -25,16 +53,25 @@ _mysql_ConnectionObject_Initialize(
 				  "read_default_file", "read_default_group",
 				  "client_flag", "ssl",
 				  "local_infile",
+				  "compression_algorithms",
+				  "zstd_compression_level",
 				  NULL } ;
 	int connect_timeout = 0;
 	int compress = -1, named_pipe = -1, local_infile = -1;
+	int zstd_compression_level = -1, options_err = 0;
 	char *init_command=NULL,
 	     *read_default_file=NULL,
-	     *read_default_group=NULL;
+	     *read_default_group=NULL,
+	     *compression_algorithms=NULL;
 	
 	self->open = 0;
+	self->bytes_sent = self->bytes_received = 0;
+	Py_CLEAR(self->stats.errors);
+	memset(&(self->stats), 0, sizeof(self->stats));
+	memset(&(self->latency_query), 0, sizeof(self->latency_query));
+	memset(&(self->latency_result), 0, sizeof(self->latency_result));
 	check_server_init(-1);
-	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ssssisiiisssiOi:connect",
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ssssisiiisssiOisi:connect",
 					 kwlist,
 					 &host, &user, &passwd, &db,
 					 &port, &unix_socket,
@@ -43,10 +80,30 @@ _mysql_ConnectionObject_Initialize(
 					 &init_command, &read_default_file,
 					 &read_default_group,
 					 &client_flag, &ssl,
-					 &local_infile
+					 &local_infile,
+					 &compression_algorithms,
+					 &zstd_compression_level
 					 ))
 		return -1;
 
+	if (compression_algorithms &&
+	    _mysql_check_compression_algorithms(compression_algorithms))
+		return -1;
+	if (zstd_compression_level != -1 &&
+	    (zstd_compression_level < 1 || zstd_compression_level > 22)) {
+		PyErr_SetString(_mysql_ProgrammingError,
+				"zstd_compression_level must be from 1 to 22");
+		return -1;
+	}
+
+#if !HAVE_MYSQL_OPT_COMPRESSION_ALGORITHMS
+	if (compression_algorithms || zstd_compression_level != -1) {
+		PyErr_SetString(_mysql_NotSupportedError,
+				"client library does not support compression_algorithms or zstd_compression_level");
+		return -1;
+	}
+#endif
+
 #define _stringsuck(d,t,s) {t=PyMapping_GetItemString(s,#d);\
         if(t){d=PyString_AsString(t);Py_DECREF(t);}\
         PyErr_Clear();}
@@ -66,7 +123,7 @@ _mysql_ConnectionObject_Initialize(
 #endif
 	}
 
-	Py_BEGIN_ALLOW_THREADS ;
+	MYSQL_BEGIN_ALLOW_THREADS ;
 	conn = mysql_init(&(self->connection));
 	if (connect_timeout) {
 		unsigned int timeout = connect_timeout;
@@ -89,16 +146,37 @@ _mysql_ConnectionObject_Initialize(
 	if (local_infile != -1)
 		mysql_options(&(self->connection), MYSQL_OPT_LOCAL_INFILE, (char *) &local_infile);
 
+#if HAVE_MYSQL_OPT_COMPRESSION_ALGORITHMS
+	if (compression_algorithms != NULL)
+		options_err |= mysql_options(&(self->connection),
+					     MYSQL_OPT_COMPRESSION_ALGORITHMS,
+					     compression_algorithms);
+	if (zstd_compression_level != -1) {
+		unsigned int level = zstd_compression_level;
+		options_err |= mysql_options(&(self->connection),
+					     MYSQL_OPT_ZSTD_COMPRESSION_LEVEL,
+					     &level);
+	}
+#endif
+
 #if HAVE_OPENSSL
 	if (ssl)
 		mysql_ssl_set(&(self->connection),
 			      key, cert, ca, capath, cipher);
 #endif
 
-	conn = mysql_real_connect(&(self->connection), host, user, passwd, db,
-				  port, unix_socket, client_flag);
+	if (!options_err)
+		conn = mysql_real_connect(&(self->connection), host, user, passwd, db,
+					  port, unix_socket, client_flag);
+
+	MYSQL_END_ALLOW_THREADS ;
 
-	Py_END_ALLOW_THREADS ;
+	if (options_err) {
+		mysql_close(&(self->connection));
+		PyErr_SetString(_mysql_ProgrammingError,
+				"invalid compression_algorithms or zstd_compression_level");
+		return -1;
+	}
 
 	if (!conn) {
 		_mysql_Exception(self);
@@ -163,6 +241,13 @@ client_flag\n\
 load_infile\n\
   int, non-zero enables LOAD LOCAL INFILE, zero disables\n\
 \n\
+compression_algorithms\n\
+  string, comma-separated list of permitted compression\n\
+  algorithms, e.g. \"zstd,zlib,uncompressed\" (MySQL 8.0.18 and newer)\n\
+\n\
+zstd_compression_level\n\
+  int, compression level (1-22) used with zstd (MySQL 8.0.18 and newer)\n\
+\n\
 ";
 
 PyObject *
@@ -201,6 +286,31 @@ _escape_item(
 	PyObject *item,
 	PyObject *d);
 
+/* Returns the size bytes at in escaped for mysql's character set, and
+   enclosed in single quotes if quote is set. Needs no server, only a
+   MYSQL that has been through mysql_init(). */
+PyObject *
+_mysql_escape_bytes(
+	MYSQL *mysql,
+	const char *in,
+	int size,
+	int quote)
+{
+	PyObject *str;
+	char *out;
+	int len;
+
+	quote = quote ? 1 : 0;
+	str = PyString_FromStringAndSize((char *) NULL, size*2+1+2*quote);
+	if (!str) return PyErr_NoMemory();
+	out = PyString_AS_STRING(str);
+	len = mysql_real_escape_string(mysql, out+quote, in, size);
+	if (quote)
+		*out = *(out+len+1) = '\'';
+	if (_PyString_Resize(&str, len+2*quote) < 0) return NULL;
+	return str;
+}
+
 char _mysql_escape_string__doc__[] =
 "escape_string(s) -- quote any SQL-interpreted characters in string s.\n\
 If you want quotes around your value, use string_literal(s) instead.\n\
@@ -211,16 +321,10 @@ _mysql_escape_string(
         _mysql_ConnectionObject *self,
         PyObject *args)
 {
-        PyObject *str;
-        char *in, *out;
-        int len, size;
+        char *in;
+        int size;
         if (!PyArg_ParseTuple(args, "s#:escape_string", &in, &size)) return NULL;
-        str = PyString_FromStringAndSize((char *) NULL, size*2+1);
-        if (!str) return PyErr_NoMemory();
-        out = PyString_AS_STRING(str);
-	len = mysql_real_escape_string(&(self->connection), out, in, size);
-        if (_PyString_Resize(&str, len) < 0) return NULL;
-        return (str);
+        return _mysql_escape_bytes(&(self->connection), in, size, 0);
 }
 
 char _mysql_string_literal__doc__[] =
@@ -236,17 +340,10 @@ _mysql_string_literal(
         _mysql_ConnectionObject *self,
         PyObject *args)
 {
-        PyObject *str;
-        char *in, *out;
-        int len, size;
+        char *in;
+        int size;
         if (!PyArg_ParseTuple(args, "s#:string_literal", &in, &size)) return NULL;
-        str = PyString_FromStringAndSize((char *) NULL, size*2+3);
-        if (!str) return PyErr_NoMemory();
-        out = PyString_AS_STRING(str);
-        len = mysql_real_escape_string(&(self->connection), out+1, in, size);
-        *out = *(out+len+1) = '\'';
-        if (_PyString_Resize(&str, len+2) < 0) return NULL;
-        return (str);
+        return _mysql_escape_bytes(&(self->connection), in, size, 1);
 }
 
 static char _mysql_ConnectionObject_close__doc__[] =
@@ -258,9 +355,9 @@ _mysql_ConnectionObject_close(
 	PyObject *unused)
 {
 	if (self->open) {
-		Py_BEGIN_ALLOW_THREADS
+		MYSQL_BEGIN_ALLOW_THREADS
 		mysql_close(&(self->connection));
-		Py_END_ALLOW_THREADS
+		MYSQL_END_ALLOW_THREADS
 		self->open = 0;
 	} else {
 		PyErr_SetString(_mysql_ProgrammingError,
@@ -300,9 +397,9 @@ _mysql_ConnectionObject_dump_debug_info(
 	int err;
 
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	err = mysql_dump_debug_info(&(self->connection));
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (err) return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -318,7 +415,7 @@ _mysql_ConnectionObject_autocommit(
 {
 	int flag, err;
 	if (!PyArg_ParseTuple(args, "i", &flag)) return NULL;
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 #if MYSQL_VERSION_ID >= 40100
 	err = mysql_autocommit(&(self->connection), flag);
 #else
@@ -328,7 +425,7 @@ _mysql_ConnectionObject_autocommit(
 		err = mysql_query(&(self->connection), query);
 	}
 #endif
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (err) return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -344,13 +441,13 @@ _mysql_ConnectionObject_commit(
 {
 	int err;
 
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 #if MYSQL_VERSION_ID >= 40100
 	err = mysql_commit(&(self->connection));
 #else
 	err = mysql_query(&(self->connection), "COMMIT");
 #endif
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (err) return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -366,13 +463,13 @@ _mysql_ConnectionObject_rollback(
 {
 	int err;
 
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 #if MYSQL_VERSION_ID >= 40100
 	err = mysql_rollback(&(self->connection));
 #else
 	err = mysql_query(&(self->connection), "ROLLBACK");
 #endif
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (err) return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -398,19 +495,34 @@ _mysql_ConnectionObject_next_result(
 {
 	int err;
 
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 #if MYSQL_VERSION_ID >= 40100
 	err = mysql_next_result(&(self->connection));
 #else
 	err = -1;
 #endif
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (err > 0) return _mysql_Exception(self);
 	return PyInt_FromLong(err == 0);
 }
 
 #if MYSQL_VERSION_ID >= 40100
 
+static char _mysql_ConnectionObject_more_results__doc__[] =
+"more_results() -- Returns True if the last query has more results\n\
+for next_result() to read.\n\
+\n\
+Non-standard.\n\
+";
+static PyObject *
+_mysql_ConnectionObject_more_results(
+	_mysql_ConnectionObject *self,
+	PyObject *unused)
+{
+	check_connection(self);
+	return PyBool_FromLong(mysql_more_results(&(self->connection)));
+}
+
 static char _mysql_ConnectionObject_set_server_option__doc__[] =
 "set_server_option(option) -- Enables or disables an option\n\
 for the connection.\n\
@@ -425,9 +537,9 @@ _mysql_ConnectionObject_set_server_option(
 	int err, flags=0;
 	if (!PyArg_ParseTuple(args, "i", &flags))
 		return NULL;
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	err = mysql_set_server_option(&(self->connection), flags);
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (err) return _mysql_Exception(self);
 	return PyInt_FromLong(err);
 }		
@@ -531,15 +643,75 @@ _mysql_ConnectionObject_change_user(
 					 kwlist, &user, &pwd, &db))
 		return NULL;
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 		r = mysql_change_user(&(self->connection), user, pwd, db);
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (r) 	return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
 }
 #endif
 
+static char _mysql_ConnectionObject_reset__doc__[] =
+"Returns the session to the state it had just after connecting,\n\
+without reconnecting: any open transaction is rolled back, temporary\n\
+tables are dropped, and user variables and session settings revert\n\
+to their defaults.\n\
+\n\
+mysql_reset_connection() is used when both client and server are\n\
+MySQL-5.7.3 or newer. Otherwise the connection re-authenticates as\n\
+the same user on the current database with mysql_change_user().\n\
+\n\
+Non-standard.\n\
+";
+
+static PyObject *
+_mysql_ConnectionObject_reset(
+	_mysql_ConnectionObject *self,
+	PyObject *unused)
+{
+	PyObject *user=NULL, *passwd=NULL, *db=NULL;
+	int r;
+
+	check_connection(self);
+#if MYSQL_VERSION_ID >= 50703
+	if (mysql_get_server_version(&(self->connection)) >= 50703) {
+		MYSQL_BEGIN_ALLOW_THREADS
+		r = mysql_reset_connection(&(self->connection));
+		MYSQL_END_ALLOW_THREADS
+		if (r) return _mysql_Exception(self);
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+#endif
+	/* mysql_change_user() replaces these, so pass it copies */
+	if (!(user = PyString_FromString(self->connection.user ?
+					 self->connection.user : "")))
+		goto error;
+	if (self->connection.passwd &&
+	    !(passwd = PyString_FromString(self->connection.passwd)))
+		goto error;
+	if (self->connection.db &&
+	    !(db = PyString_FromString(self->connection.db)))
+		goto error;
+	MYSQL_BEGIN_ALLOW_THREADS
+	r = mysql_change_user(&(self->connection),
+			      PyString_AS_STRING(user),
+			      passwd ? PyString_AS_STRING(passwd) : NULL,
+			      db ? PyString_AS_STRING(db) : NULL);
+	MYSQL_END_ALLOW_THREADS
+	Py_DECREF(user);
+	Py_XDECREF(passwd);
+	Py_XDECREF(db);
+	if (r) return _mysql_Exception(self);
+	Py_INCREF(Py_None);
+	return Py_None;
+  error:
+	Py_XDECREF(user);
+	Py_XDECREF(passwd);
+	return NULL;
+}
+
 static char _mysql_ConnectionObject_character_set_name__doc__[] =
 "Returns the default character set for the current connection.\n\
 Non-standard.\n\
@@ -576,9 +748,9 @@ _mysql_ConnectionObject_set_character_set(
 	int err;
 	if (!PyArg_ParseTuple(args, "s", &s)) return NULL;
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	err = mysql_set_character_set(&(self->connection), s);
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (err) return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -723,12 +895,51 @@ _mysql_ConnectionObject_insert_id(
 	my_ulonglong r;
 
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	r = mysql_insert_id(&(self->connection));
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	return PyLong_FromUnsignedLongLong(r);
 }
 
+static char _mysql_ConnectionObject_status__doc__[] =
+"Returns a snapshot of the connection status after the most\n\
+recent query as a tuple:\n\
+\n\
+  (insert_id, affected_rows, warning_count, info, character_set_name)\n\
+\n\
+This is equivalent to calling each of those methods in turn, but\n\
+is done in a single call. When the result set was retrieved with\n\
+store_result(), affected_rows is the number of rows in it.\n\
+\n\
+Non-standard.\n\
+";
+
+static PyObject *
+_mysql_ConnectionObject_status(
+	_mysql_ConnectionObject *self,
+	PyObject *unused)
+{
+	const char *info, *charset;
+	unsigned int warnings;
+
+	check_connection(self);
+	info = mysql_info(&(self->connection));
+#if MYSQL_VERSION_ID >= 40100
+	warnings = mysql_warning_count(&(self->connection));
+#else
+	warnings = 0;
+#endif
+#if MYSQL_VERSION_ID >= 32321
+	charset = mysql_character_set_name(&(self->connection));
+#else
+	charset = "latin1";
+#endif
+	return Py_BuildValue("(KKIzs)",
+			     (unsigned PY_LONG_LONG) mysql_insert_id(&(self->connection)),
+			     (unsigned PY_LONG_LONG) mysql_affected_rows(&(self->connection)),
+			     warnings, info, charset);
+}
+
 static char _mysql_ConnectionObject_kill__doc__[] =
 "Asks the server to kill the thread specified by pid.\n\
 Non-standard.";
@@ -742,9 +953,9 @@ _mysql_ConnectionObject_kill(
 	int r;
 	if (!PyArg_ParseTuple(args, "k:kill", &pid)) return NULL;
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	r = mysql_kill(&(self->connection), pid);
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (r) return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -794,20 +1005,105 @@ _mysql_ConnectionObject_ping(
 	PyObject *args)
 {
 	int r, reconnect = -1;
+	unsigned long tid;
 	if (!PyArg_ParseTuple(args, "|I", &reconnect)) return NULL;
 	check_connection(self);
 	if ( reconnect != -1 ) self->connection.reconnect = reconnect;
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
+	tid = mysql_thread_id(&(self->connection));
 	r = mysql_ping(&(self->connection));
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (r) 	return _mysql_Exception(self);
+	if (mysql_thread_id(&(self->connection)) != tid)
+		self->stats.reconnects++;
 	Py_INCREF(Py_None);
 	return Py_None;
 }
 
+/* The trace hook's query event, for sql about to be sent. */
+void
+_mysql_trace_query(
+	_mysql_ConnectionObject *self,
+	PyObject *sql)
+{
+	_mysql_trace("query", self, "{s:O,s:k}",
+		     "sql", sql,
+		     "thread_id", mysql_thread_id(&(self->connection)));
+}
+
+/* The trace hook's query_done event, for sql that took elapsed ns and
+   failed with merr, or succeeded if it is 0. */
+void
+_mysql_trace_query_done(
+	_mysql_ConnectionObject *self,
+	PyObject *sql,
+	unsigned PY_LONG_LONG elapsed,
+	unsigned int merr,
+	Py_ssize_t len)
+{
+	_mysql_trace("query_done", self, "{s:O,s:k,s:K,s:I,s:K}",
+		     "sql", sql,
+		     "thread_id", mysql_thread_id(&(self->connection)),
+		     "ns", elapsed,
+		     "errno", merr,
+		     "bytes", (unsigned PY_LONG_LONG) len);
+}
+
+/* mysql_real_query(), timed; called without the GIL. The time taken
+   is stored in *elapsed and the thread id from before the query in
+   *tid, for the caller to pass to _mysql_ConnectionObject_count_query()
+   once it has the GIL again. */
+int
+_mysql_ConnectionObject_real_query(
+	_mysql_ConnectionObject *self,
+	const char *query,
+	unsigned long len,
+	unsigned PY_LONG_LONG *elapsed,
+	unsigned long *tid)
+{
+	unsigned PY_LONG_LONG start;
+	int r;
+
+	*tid = mysql_thread_id(&(self->connection));
+	start = _mysql_clock_ns();
+	r = mysql_real_query(&(self->connection), query, len);
+	*elapsed = _mysql_clock_ns() - start;
+	return r;
+}
+
+/* Whether the view "s*" got of obj stays valid without the GIL. Only
+   the new buffer interface pins an object's memory until the view is
+   released; an old-style buffer, such as an array.array or an mmap, may
+   be resized or closed by another thread meanwhile. */
+static int
+_mysql_pinned(
+	PyObject *obj)
+{
+	return PyObject_CheckBuffer(obj) || PyUnicode_Check(obj);
+}
+
+/* Counts a query sent by _mysql_ConnectionObject_real_query() in the
+   connection's stats and latency histograms; needs the GIL. A changed
+   thread id means the client library reconnected. */
+static void
+_mysql_ConnectionObject_count_query(
+	_mysql_ConnectionObject *self,
+	unsigned PY_LONG_LONG elapsed,
+	unsigned long tid)
+{
+	self->stats.query_ns += elapsed;
+	self->stats.queries++;
+	if (mysql_thread_id(&(self->connection)) != tid)
+		self->stats.reconnects++;
+	_mysql_record_query_latency(self, elapsed);
+}
+
 static char _mysql_ConnectionObject_query__doc__[] =
 "Execute a query. store_result() or use_result() will get the\n\
-result set, if any. Non-standard. Use cursor() to create a cursor,\n\
+result set, if any. The query may be a string or any object\n\
+supporting the buffer interface, such as a bytearray, and is sent\n\
+without being copied, unless it only has an old-style buffer, like\n\
+an array.array or an mmap. Non-standard. Use cursor() to create a cursor,\n\
 then cursor.execute().\n\
 " ;
 
@@ -816,18 +1112,134 @@ _mysql_ConnectionObject_query(
 	_mysql_ConnectionObject *self,
 	PyObject *args)
 {
-	char *query;
-	int len, r;
-	if (!PyArg_ParseTuple(args, "s#:query", &query, &len)) return NULL;
-	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
-	r = mysql_real_query(&(self->connection), query, len);
-	Py_END_ALLOW_THREADS
-	if (r) return _mysql_Exception(self);
+	Py_buffer query;
+	char *copy = NULL;
+	unsigned PY_LONG_LONG elapsed;
+	unsigned long tid;
+	int r;
+	if (!PyArg_ParseTuple(args, "s*:query", &query)) return NULL;
+	if (!self->open) {
+		PyBuffer_Release(&query);
+		return _mysql_Exception(self);
+	}
+	if (!_mysql_pinned(PyTuple_GET_ITEM(args, 0))) {
+		if (!(copy = malloc(query.len + 1))) {
+			PyBuffer_Release(&query);
+			return PyErr_NoMemory();
+		}
+		memcpy(copy, query.buf, query.len);
+	}
+	if (_mysql_trace_hook)
+		_mysql_trace_query(self, PyTuple_GET_ITEM(args, 0));
+	MYSQL_BEGIN_ALLOW_THREADS
+	r = _mysql_ConnectionObject_real_query(self,
+					       copy ? copy : query.buf,
+					       query.len, &elapsed, &tid);
+	MYSQL_END_ALLOW_THREADS
+	_mysql_ConnectionObject_count_query(self, elapsed, tid);
+	PyBuffer_Release(&query);
+	free(copy);
+	if (r) _mysql_Exception(self);
+	else self->bytes_sent += query.len;
+	if (_mysql_trace_hook)
+		_mysql_trace_query_done(self, PyTuple_GET_ITEM(args, 0),
+					elapsed, r ? mysql_errno(&(self->connection)) : 0,
+					query.len);
+	if (r) return NULL;
 	Py_INCREF(Py_None);
 	return Py_None;
 }
 
+/* Copies the n buffers of views one after the other into query. */
+static void
+_mysql_gather(
+	char *query,
+	Py_buffer *views,
+	Py_ssize_t n)
+{
+	Py_ssize_t i;
+	size_t len = 0;
+
+	for (i=0; i<n; i++) {
+		memcpy(query + len, views[i].buf, views[i].len);
+		len += views[i].len;
+	}
+}
+
+static char _mysql_ConnectionObject_query_parts__doc__[] =
+"query_parts(parts) -- Execute the query made of the sequence of\n\
+strings or buffers parts, as query(''.join(parts)) would, but\n\
+gathering them into the single buffer sent to the server without\n\
+first joining them into a Python string. Non-standard.\n\
+" ;
+
+static PyObject *
+_mysql_ConnectionObject_query_parts(
+	_mysql_ConnectionObject *self,
+	PyObject *args)
+{
+	PyObject *parts, *seq, *sql = NULL, *result = NULL;
+	Py_buffer *views;
+	Py_ssize_t i, k, n;
+	size_t len = 0;
+	char *query = NULL;
+	unsigned PY_LONG_LONG elapsed;
+	unsigned long tid;
+	int r, pinned = 1;
+	if (!PyArg_ParseTuple(args, "O:query_parts", &parts)) return NULL;
+	check_connection(self);
+	if (!(seq = PySequence_Fast(parts, "query_parts() needs a sequence")))
+		return NULL;
+	n = PySequence_Fast_GET_SIZE(seq);
+	if (!(views = PyMem_New(Py_buffer, n + 1))) {
+		Py_DECREF(seq);
+		return PyErr_NoMemory();
+	}
+	for (k=0; k<n; k++) {
+		PyObject *part = PySequence_Fast_GET_ITEM(seq, k);
+		if (!PyArg_Parse(part, "s*:query_parts", &views[k]))
+			goto error;
+		pinned = pinned && _mysql_pinned(part);
+		len += views[k].len;
+	}
+	if (!(query = malloc(len + 1))) {
+		PyErr_NoMemory();
+		goto error;
+	}
+	/* a hook needs the query text as a string, and parts that are not
+	   pinned can only be read with the GIL, so gather those first */
+	if (_mysql_trace_hook || !pinned)
+		_mysql_gather(query, views, n);
+	if (_mysql_trace_hook) {
+		if (!(sql = PyString_FromStringAndSize(query, len)))
+			goto error;
+		_mysql_trace_query(self, sql);
+	}
+	MYSQL_BEGIN_ALLOW_THREADS
+	if (!sql && pinned)
+		_mysql_gather(query, views, n);
+	r = _mysql_ConnectionObject_real_query(self, query, len, &elapsed,
+					       &tid);
+	MYSQL_END_ALLOW_THREADS
+	_mysql_ConnectionObject_count_query(self, elapsed, tid);
+	if (r) _mysql_Exception(self);
+	else self->bytes_sent += len;
+	if (sql && _mysql_trace_hook)
+		_mysql_trace_query_done(self, sql, elapsed,
+					r ? mysql_errno(&(self->connection)) : 0,
+					len);
+	if (r) goto error;
+	Py_INCREF(Py_None);
+	result = Py_None;
+  error:
+	Py_XDECREF(sql);
+	free(query);
+	for (i=0; i<k; i++)
+		PyBuffer_Release(&views[i]);
+	PyMem_Free(views);
+	Py_DECREF(seq);
+	return result;
+}
 
 static char _mysql_ConnectionObject_select_db__doc__[] =
 "Causes the database specified by db to become the default\n\
@@ -850,9 +1262,9 @@ _mysql_ConnectionObject_select_db(
 	int r;
 	if (!PyArg_ParseTuple(args, "s:select_db", &db)) return NULL;
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	r = mysql_select_db(&(self->connection), db);
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (r) 	return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -871,13 +1283,13 @@ _mysql_ConnectionObject_shutdown(
 	int r;
 
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	r = mysql_shutdown(&(self->connection)
 #if MYSQL_VERSION_ID >= 40103
 		, SHUTDOWN_DEFAULT
 #endif
 		);
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (r) return _mysql_Exception(self);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -898,9 +1310,9 @@ _mysql_ConnectionObject_stat(
 	const char *s;
 
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	s = mysql_stat(&(self->connection));
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	if (!s) return _mysql_Exception(self);
 	return PyString_FromString(s);
 }
@@ -908,6 +1320,9 @@ _mysql_ConnectionObject_stat(
 static char _mysql_ConnectionObject_get_result__doc__[] =
 "Returns a result object. If use is True, mysql_use_result()\n\
 is used; otherwise mysql_store_result() is used (the default).\n\
+If spill_dir is given, the rows are instead read into a memory-mapped\n\
+temporary file in that directory; the result then supports the same\n\
+random access as a stored one.\n\
 ";
 
 static PyObject *
@@ -917,16 +1332,20 @@ _mysql_ConnectionObject_get_result(
 	PyObject *kwargs)
 {
 	PyObject *arglist=NULL, *kwarglist=NULL, *result=NULL;
-	static char *kwlist[] = {"use", NULL};
+	static char *kwlist[] = {"use", "spill_dir", NULL};
 	_mysql_ResultObject *r=NULL;
 	int use = 0;
+	PyObject *spill_dir = NULL;
 	
-	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i:get_result", kwlist, &use)) return NULL;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iO:get_result", kwlist, &use, &spill_dir)) return NULL;
 	check_connection(self);
 	arglist = Py_BuildValue("(Oi)", self, use);
 	if (!arglist) goto error;
 	kwarglist = PyDict_New();
 	if (!kwarglist) goto error;
+	if (spill_dir && spill_dir != Py_None &&
+	    PyDict_SetItemString(kwarglist, "spill_dir", spill_dir))
+		goto error;
 	r = MyAlloc(_mysql_ResultObject, _mysql_ResultObject_Type);
 	if (!r) goto error;
 	if (_mysql_ResultObject_Initialize(r, arglist, kwarglist))
@@ -962,12 +1381,102 @@ _mysql_ConnectionObject_thread_id(
 	unsigned long pid;
 
 	check_connection(self);
-	Py_BEGIN_ALLOW_THREADS
+	MYSQL_BEGIN_ALLOW_THREADS
 	pid = mysql_thread_id(&(self->connection));
-	Py_END_ALLOW_THREADS
+	MYSQL_END_ALLOW_THREADS
 	return PyInt_FromLong((long)pid);
 }
 
+static char _mysql_ConnectionObject_stats__doc__[] =
+"Returns a dict of the counters the connection keeps:\n\
+\n\
+queries, rows\n\
+  statements executed and rows fetched from the server\n\
+\n\
+bytes_sent, bytes_received\n\
+  query text sent and row data received\n\
+\n\
+query_ns, result_ns, fetch_ns\n\
+  nanoseconds spent in mysql_real_query(), in mysql_store_result()\n\
+  or mysql_use_result(), and in mysql_fetch_row() for use_result()\n\
+  results (rows from store_result() are already in memory)\n\
+\n\
+reconnects\n\
+  automatic reconnections noticed by ping() or query()\n\
+\n\
+errors\n\
+  a dict mapping MySQL error numbers to how often they were raised\n\
+\n\
+The counters are cheap enough to be always on; reset_stats() zeroes\n\
+them. See latency() for the distribution of query and result times.\n\
+Non-standard.\n\
+";
+
+static PyObject *
+_mysql_ConnectionObject_stats(
+	_mysql_ConnectionObject *self,
+	PyObject *unused)
+{
+	_mysql_ConnectionStats *s = &(self->stats);
+	PyObject *errors, *r;
+
+	if (s->errors)
+		errors = PyDict_Copy(s->errors);
+	else
+		errors = PyDict_New();
+	if (!errors) return NULL;
+	r = Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:N}",
+			  "queries", s->queries,
+			  "rows", s->rows,
+			  "bytes_sent", self->bytes_sent,
+			  "bytes_received", self->bytes_received,
+			  "query_ns", s->query_ns,
+			  "result_ns", s->result_ns,
+			  "fetch_ns", s->fetch_ns,
+			  "reconnects", s->reconnects,
+			  "errors", errors);
+	return r;
+}
+
+static char _mysql_ConnectionObject_latency__doc__[] =
+"Returns a dict of two _mysql.histogram copies of the connection's\n\
+latencies in microseconds: query, the time each statement took to\n\
+execute, and result, the time taken to receive each whole result set\n\
+(store_result(), or use_result() and every fetch until the last row).\n\
+Use histogram.snapshot() for percentiles. Non-standard.\n\
+";
+
+static PyObject *
+_mysql_ConnectionObject_latency(
+	_mysql_ConnectionObject *self,
+	PyObject *unused)
+{
+	return Py_BuildValue("{s:N,s:N}",
+			     "query",
+			     _mysql_HistogramObject_New(&(self->latency_query)),
+			     "result",
+			     _mysql_HistogramObject_New(&(self->latency_result)));
+}
+
+static char _mysql_ConnectionObject_reset_stats__doc__[] =
+"Zeroes the counters returned by stats(), including bytes_sent and\n\
+bytes_received, and empties the latency() histograms. Non-standard.\n\
+";
+
+static PyObject *
+_mysql_ConnectionObject_reset_stats(
+	_mysql_ConnectionObject *self,
+	PyObject *unused)
+{
+	self->bytes_sent = self->bytes_received = 0;
+	Py_CLEAR(self->stats.errors);
+	memset(&(self->stats), 0, sizeof(self->stats));
+	memset(&(self->latency_query), 0, sizeof(self->latency_query));
+	memset(&(self->latency_result), 0, sizeof(self->latency_result));
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
 static void
 _mysql_ConnectionObject_dealloc(
 	_mysql_ConnectionObject *self)
@@ -979,6 +1488,7 @@ _mysql_ConnectionObject_dealloc(
 		o = _mysql_ConnectionObject_close(self, NULL);
 		Py_XDECREF(o);
 	}
+	Py_CLEAR(self->stats.errors);
 	MyFree(self);
 }
 
@@ -1028,6 +1538,14 @@ static PyMethodDef _mysql_ConnectionObject_methods[] = {
 		METH_NOARGS,
 		_mysql_ConnectionObject_next_result__doc__
 	},
+#if MYSQL_VERSION_ID >= 40100
+	{
+		"more_results",
+		(PyCFunction)_mysql_ConnectionObject_more_results,
+		METH_NOARGS,
+		_mysql_ConnectionObject_more_results__doc__
+	},
+#endif
 #if MYSQL_VERSION_ID >= 40100
 	{
 		"set_server_option",
@@ -1162,12 +1680,56 @@ static PyMethodDef _mysql_ConnectionObject_methods[] = {
 		METH_VARARGS,
 		_mysql_ConnectionObject_ping__doc__
 	},
+	{
+		"stats",
+		(PyCFunction)_mysql_ConnectionObject_stats,
+		METH_NOARGS,
+		_mysql_ConnectionObject_stats__doc__
+	},
+	{
+		"latency",
+		(PyCFunction)_mysql_ConnectionObject_latency,
+		METH_NOARGS,
+		_mysql_ConnectionObject_latency__doc__
+	},
+	{
+		"reset_stats",
+		(PyCFunction)_mysql_ConnectionObject_reset_stats,
+		METH_NOARGS,
+		_mysql_ConnectionObject_reset_stats__doc__
+	},
 	{
 		"query",
 		(PyCFunction)_mysql_ConnectionObject_query,
 		METH_VARARGS,
 		_mysql_ConnectionObject_query__doc__
 	},
+	{
+		"query_parts",
+		(PyCFunction)_mysql_ConnectionObject_query_parts,
+		METH_VARARGS,
+		_mysql_ConnectionObject_query_parts__doc__
+	},
+#ifdef HAVE_MYSQL_STMT
+	{
+		"open_blob",
+		(PyCFunction)_mysql_ConnectionObject_open_blob,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_ConnectionObject_open_blob__doc__
+	},
+	{
+		"stmt_execute",
+		(PyCFunction)_mysql_ConnectionObject_stmt_execute,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_ConnectionObject_stmt_execute__doc__
+	},
+#endif
+	{
+		"reset",
+		(PyCFunction)_mysql_ConnectionObject_reset,
+		METH_NOARGS,
+		_mysql_ConnectionObject_reset__doc__
+	},
 	{
 		"select_db",
 		(PyCFunction)_mysql_ConnectionObject_select_db,
@@ -1186,6 +1748,12 @@ static PyMethodDef _mysql_ConnectionObject_methods[] = {
 		METH_NOARGS,
 		_mysql_ConnectionObject_stat__doc__
 	},
+	{
+		"status",
+		(PyCFunction)_mysql_ConnectionObject_status,
+		METH_NOARGS,
+		_mysql_ConnectionObject_status__doc__
+	},
 	{
 		"string_literal",
 		(PyCFunction)_mysql_string_literal,
@@ -1225,58 +1793,45 @@ static struct PyMemberDef _mysql_ConnectionObject_memberlist[] = {
 	{
 		 "client_flag",
 		 T_UINT,
-		 RO,
 		 offsetof(_mysql_ConnectionObject, connection.client_flag),
+		 RO,
 		 "Client flags; refer to MySQLdb.constants.CLIENT"
 	},
+	{
+		"bytes_sent",
+		T_ULONGLONG,
+		offsetof(_mysql_ConnectionObject, bytes_sent),
+		RO,
+		"Uncompressed bytes of query text sent by query()"
+	},
+	{
+		"bytes_received",
+		T_ULONGLONG,
+		offsetof(_mysql_ConnectionObject, bytes_received),
+		RO,
+		"Uncompressed bytes of row data read from result sets"
+	},
 	{NULL} /* Sentinel */
 };
 
 static PyObject *
-_mysql_ConnectionObject_getattr(
+_mysql_ConnectionObject_get_closed(
 	_mysql_ConnectionObject *self,
-	char *name)
+	void *closure)
 {
-	PyObject *res;
-	struct PyMemberDef *l;
-
-	res = Py_FindMethod(_mysql_ConnectionObject_methods, (PyObject *)self, name);
-	if (res != NULL)
-		return res;
-	PyErr_Clear();
-	if (strcmp(name, "closed") == 0)
-		return PyInt_FromLong((long)!(self->open));
-
-	for (l = _mysql_ConnectionObject_memberlist; l->name != NULL; l++) {
-		if (strcmp(l->name, name) == 0)
-			return PyMember_GetOne((char *)self, l);
-	}
-
-	PyErr_SetString(PyExc_AttributeError, name);
-	return NULL;
+	return PyInt_FromLong((long)!(self->open));
 }
 
-static int
-_mysql_ConnectionObject_setattr(
-	_mysql_ConnectionObject *self,
-	char *name,
-	PyObject *v)
-{
-	struct PyMemberDef *l;
-
-	if (v == NULL) {
-		PyErr_SetString(PyExc_AttributeError,
-				"can't delete connection attributes");
-		return -1;
-	}
-
-	for (l = _mysql_ConnectionObject_memberlist; l->name != NULL; l++)
-		if (strcmp(l->name, name) == 0)
-			return PyMember_SetOne((char *)self, l, v);
-
-        PyErr_SetString(PyExc_AttributeError, name);
-        return -1;
-}
+static PyGetSetDef _mysql_ConnectionObject_getset[] = {
+	{
+		"closed",
+		(getter)_mysql_ConnectionObject_get_closed,
+		NULL,
+		"True if connection is closed",
+		NULL
+	},
+	{NULL} /* Sentinel */
+};
 
 PyTypeObject _mysql_ConnectionObject_Type = {
 	PyObject_HEAD_INIT(NULL)
@@ -1286,8 +1841,8 @@ PyTypeObject _mysql_ConnectionObject_Type = {
 	0,
 	(destructor)_mysql_ConnectionObject_dealloc, /* tp_dealloc */
 	0, /*tp_print*/
-	(getattrfunc)_mysql_ConnectionObject_getattr, /* tp_getattr */
-	(setattrfunc)_mysql_ConnectionObject_setattr, /* tp_setattr */
+	0, /* tp_getattr */
+	0, /* tp_setattr */
 	0, /*tp_compare*/
 	(reprfunc)_mysql_ConnectionObject_repr, /* tp_repr */
 
@@ -1332,7 +1887,7 @@ PyTypeObject _mysql_ConnectionObject_Type = {
 	/* Attribute descriptor and subclassing stuff */
 	(struct PyMethodDef *)_mysql_ConnectionObject_methods, /* tp_methods */
 	(struct PyMemberDef *)_mysql_ConnectionObject_memberlist, /* tp_members */
-	0, /* (struct getsetlist *) tp_getset; */
+	(struct PyGetSetDef *)_mysql_ConnectionObject_getset, /* tp_getset */
 	0, /* (struct _typeobject *) tp_base; */
 	0, /* (PyObject *) tp_dict */
 	0, /* (descrgetfunc) tp_descr_get */
@@ -0,0 +1,1425 @@
+/* -*- mode: C; indent-tabs-mode: t; c-basic-offset: 8; -*- */
+
+#include "mysqlmod.h"
+
+#ifdef MS_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define _MYSQL_WRITER_BUFFER_SIZE 65536
+
+/* Output buffer drained either to a file descriptor, which needs no
+   GIL, or to a Python object's write() method, which does. error is
+   the errno of a failed write(2), or -1 if write() raised. */
+typedef struct {
+	int fd;
+	PyObject *write;
+	char *buf;
+	size_t len;
+	int error;
+} _mysql_Writer;
+
+static void
+_mysql_Writer_out(
+	_mysql_Writer *w,
+	const char *s,
+	size_t n)
+{
+	if (w->error)
+		return;
+	if (w->write) {
+		PyObject *chunk, *r = NULL;
+		if ((chunk = PyString_FromStringAndSize(s, n))) {
+			r = PyObject_CallFunctionObjArgs(w->write, chunk, NULL);
+			Py_DECREF(chunk);
+		}
+		if (!r)
+			w->error = -1;
+		Py_XDECREF(r);
+		return;
+	}
+	while (n) {
+		Py_ssize_t k = write(w->fd, s, n);
+		if (k < 0) {
+			if (errno == EINTR)
+				continue;
+			w->error = errno;
+			return;
+		}
+		s += k;
+		n -= k;
+	}
+}
+
+static void
+_mysql_Writer_flush(
+	_mysql_Writer *w)
+{
+	if (w->len)
+		_mysql_Writer_out(w, w->buf, w->len);
+	w->len = 0;
+}
+
+static void
+_mysql_Writer_put(
+	_mysql_Writer *w,
+	const char *s,
+	size_t n)
+{
+	if (w->len + n > _MYSQL_WRITER_BUFFER_SIZE) {
+		_mysql_Writer_flush(w);
+		if (n >= _MYSQL_WRITER_BUFFER_SIZE) {
+			_mysql_Writer_out(w, s, n);
+			return;
+		}
+	}
+	memcpy(w->buf + w->len, s, n);
+	w->len += n;
+}
+
+#define _mysql_Writer_putc(w, c) \
+	do { \
+		if ((w)->len == _MYSQL_WRITER_BUFFER_SIZE) \
+			_mysql_Writer_flush(w); \
+		(w)->buf[(w)->len++] = (c); \
+	} while (0)
+
+/* RFC 4180: quote fields holding a comma, quote or line break, doubling
+   any quotes. Empty strings are quoted too, to tell them from NULL. */
+static void
+_mysql_write_csv(
+	_mysql_Writer *w,
+	const char *s,
+	unsigned long n)
+{
+	unsigned long i, start = 0;
+	int quote = !n;
+
+	for (i=0; i<n && !quote; i++)
+		quote = s[i] == '"' || s[i] == ',' ||
+			s[i] == '\r' || s[i] == '\n';
+	if (!quote) {
+		_mysql_Writer_put(w, s, n);
+		return;
+	}
+	_mysql_Writer_putc(w, '"');
+	for (i=0; i<n; i++)
+		if (s[i] == '"') {
+			_mysql_Writer_put(w, s + start, i + 1 - start);
+			_mysql_Writer_putc(w, '"');
+			start = i + 1;
+		}
+	_mysql_Writer_put(w, s + start, n - start);
+	_mysql_Writer_putc(w, '"');
+}
+
+/* The escapes LOAD DATA INFILE undoes by default. */
+static void
+_mysql_write_tsv(
+	_mysql_Writer *w,
+	const char *s,
+	unsigned long n)
+{
+	unsigned long i, start = 0;
+	char e;
+
+	for (i=0; i<n; i++) {
+		switch (s[i]) {
+		case '\\': e = '\\'; break;
+		case '\t': e = 't'; break;
+		case '\n': e = 'n'; break;
+		case '\r': e = 'r'; break;
+		case '\0': e = '0'; break;
+		default: continue;
+		}
+		_mysql_Writer_put(w, s + start, i - start);
+		_mysql_Writer_putc(w, '\\');
+		_mysql_Writer_putc(w, e);
+		start = i + 1;
+	}
+	_mysql_Writer_put(w, s + start, n - start);
+}
+
+/* Points w at file's descriptor, flushing any Python-level buffer
+   first, or else at its write() method. */
+static int
+_mysql_Writer_open(
+	_mysql_Writer *w,
+	PyObject *file)
+{
+	PyObject *flush, *r;
+
+	memset(w, 0, sizeof(*w));
+	w->fd = -1;
+	if (PyInt_Check(file) || PyLong_Check(file)) {
+		if ((w->fd = PyObject_AsFileDescriptor(file)) < 0)
+			return -1;
+	} else if (PyObject_HasAttrString(file, "fileno")) {
+		if ((w->fd = PyObject_AsFileDescriptor(file)) < 0)
+			PyErr_Clear();
+		else if ((flush = PyObject_GetAttrString(file, "flush"))) {
+			r = PyObject_CallObject(flush, NULL);
+			Py_DECREF(flush);
+			if (!r) return -1;
+			Py_DECREF(r);
+		} else
+			PyErr_Clear();
+	}
+	if (w->fd < 0 && !(w->write = PyObject_GetAttrString(file, "write")))
+		return -1;
+	if (!(w->buf = PyMem_Malloc(_MYSQL_WRITER_BUFFER_SIZE))) {
+		Py_CLEAR(w->write);
+		PyErr_NoMemory();
+		return -1;
+	}
+	return 0;
+}
+
+/* Releases w, returning -1 with an exception set if any write failed. */
+static int
+_mysql_Writer_close(
+	_mysql_Writer *w)
+{
+	PyMem_Free(w->buf);
+	Py_CLEAR(w->write);
+	if (w->error > 0) {
+		errno = w->error;
+		PyErr_SetFromErrno(PyExc_IOError);
+	}
+	return w->error ? -1 : 0;
+}
+
+char _mysql_ResultObject_copy_to__doc__[] =
+"copy_to(file, format='csv', null=None, header=False)\n\
+  Writes the remaining rows to file and returns how many were written.\n\
+  file may be a file descriptor, an object with a fileno(), or any\n\
+  object with a write() method. Cells are written straight from the\n\
+  client library's buffers in 64KB chunks, and with a descriptor the\n\
+  GIL is released for the whole copy.\n\
+\n\
+  format 'csv' follows RFC 4180: comma-separated, CRLF-terminated,\n\
+  fields quoted when needed; NULL is an unquoted empty field and an\n\
+  empty string is \"\". format 'tsv' is the LOAD DATA INFILE default:\n\
+  tab-separated, newline-terminated, backslash escapes, NULL as \\N.\n\
+  null replaces the NULL marker; header writes the column names first.\n\
+";
+
+PyObject *
+_mysql_ResultObject_copy_to(
+	_mysql_ResultObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"file", "format", "null", "header", NULL};
+	PyObject *file;
+	char *format = "csv", *null = NULL;
+	const char *sep, *eol;
+	size_t null_len;
+	int header = 0, csv, more = 1;
+	_mysql_Writer w;
+	MYSQL_FIELD *fields;
+	MYSQL_ROW row;
+	unsigned long *lengths;
+	unsigned PY_LONG_LONG count = 0;
+	_mysql_RowCounts counts = {0, 0, 0};
+	unsigned int i, n;
+	_mysql_GilRelease save = {NULL, NULL, 0};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|szi:copy_to", kwlist,
+					 &file, &format, &null, &header))
+		return NULL;
+	check_result_connection(self);
+	if (!strcmp(format, "csv")) {
+		csv = 1;
+		sep = ",";
+		eol = "\r\n";
+		if (!null) null = "";
+	} else if (!strcmp(format, "tsv")) {
+		csv = 0;
+		sep = "\t";
+		eol = "\n";
+		if (!null) null = "\\N";
+	} else {
+		PyErr_Format(PyExc_ValueError, "unknown format: %s", format);
+		return NULL;
+	}
+	null_len = strlen(null);
+	if (_mysql_Writer_open(&w, file))
+		return NULL;
+
+	n = self->nfields;
+	if (header) {
+		fields = mysql_fetch_fields(self->result);
+		for (i=0; i<n; i++) {
+			if (i) _mysql_Writer_putc(&w, *sep);
+			if (csv)
+				_mysql_write_csv(&w, fields[i].name,
+						 strlen(fields[i].name));
+			else
+				_mysql_write_tsv(&w, fields[i].name,
+						 strlen(fields[i].name));
+		}
+		_mysql_Writer_put(&w, eol, strlen(eol));
+	}
+	if (w.fd >= 0)
+		_mysql_gil_release(&save);
+	while (!w.error &&
+	       (more = _mysql_ResultObject_raw_row(self, &row, &lengths,
+						   &counts))) {
+		for (i=0; i<n; i++) {
+			if (i) _mysql_Writer_putc(&w, *sep);
+			if (!row[i])
+				_mysql_Writer_put(&w, null, null_len);
+			else if (csv)
+				_mysql_write_csv(&w, row[i], lengths[i]);
+			else
+				_mysql_write_tsv(&w, row[i], lengths[i]);
+		}
+		_mysql_Writer_put(&w, eol, strlen(eol));
+		count++;
+	}
+	_mysql_Writer_flush(&w);
+	if (save.save)
+		_mysql_gil_acquire(&save);
+	_mysql_ResultObject_add_counts(self, &counts);
+	_mysql_ResultObject_finished(self);
+	if (_mysql_Writer_close(&w))
+		return NULL;
+	if (!more && !self->spill &&
+	    mysql_errno(&(result_connection(self)->connection)))
+		return _mysql_Exception(result_connection(self));
+	return PyLong_FromUnsignedLongLong(count);
+}
+
+/* Arrow IPC stream output.
+
+   The stream is a Schema message, one RecordBatch message per
+   batch_rows rows, and an end-of-stream marker. Each message is a
+   continuation marker, the length of its FlatBuffer metadata, the
+   metadata padded to 8 bytes, and the body buffers, each padded to 8
+   bytes. The FlatBuffers are built back to front, as the reference
+   builder does, so that every offset points forward. */
+
+#define _FB_MAX_FIELDS 8
+
+typedef struct {
+	char *buf;
+	size_t cap;
+	size_t size;		/* bytes used, at the end of buf */
+	size_t start;		/* size when the open table was started */
+	size_t slots[_FB_MAX_FIELDS];
+	int nfields;
+	int error;
+} _mysql_FlatBuffer;
+
+static void
+_fb_prepend(
+	_mysql_FlatBuffer *b,
+	const void *p,
+	size_t n)
+{
+	if (b->error)
+		return;
+	if (b->size + n > b->cap) {
+		size_t cap = b->cap * 2 + n + 256;
+		char *buf = malloc(cap);
+		if (!buf) {
+			b->error = ENOMEM;
+			return;
+		}
+		if (b->size)
+			memcpy(buf + cap - b->size, b->buf + b->cap - b->size,
+			       b->size);
+		free(b->buf);
+		b->buf = buf;
+		b->cap = cap;
+	}
+	b->size += n;
+	if (p)
+		memcpy(b->buf + b->cap - b->size, p, n);
+	else
+		memset(b->buf + b->cap - b->size, 0, n);
+}
+
+/* Pads so that after extra more bytes the size is a multiple of align;
+   since the finished buffer is 8-aligned, this aligns absolutely. */
+static void
+_fb_prep(
+	_mysql_FlatBuffer *b,
+	size_t align,
+	size_t extra)
+{
+	_fb_prepend(b, NULL, (~(b->size + extra) + 1) & (align - 1));
+}
+
+/* FlatBuffers are little-endian whatever the host. */
+static void
+_fb_scalar(
+	_mysql_FlatBuffer *b,
+	unsigned PY_LONG_LONG v,
+	size_t n)
+{
+	unsigned char le[8];
+	size_t i;
+
+	for (i=0; i<n; i++)
+		le[i] = (unsigned char) (v >> (8 * i));
+	_fb_prep(b, n, 0);
+	_fb_prepend(b, le, n);
+}
+
+static size_t
+_fb_offset(
+	_mysql_FlatBuffer *b,
+	size_t off)
+{
+	_fb_prep(b, 4, 0);
+	_fb_scalar(b, b->size + 4 - off, 4);
+	return b->size;
+}
+
+static size_t
+_fb_string(
+	_mysql_FlatBuffer *b,
+	const char *s,
+	size_t n)
+{
+	_fb_prep(b, 4, n + 1);
+	_fb_prepend(b, NULL, 1);
+	_fb_prepend(b, s, n);
+	_fb_scalar(b, n, 4);
+	return b->size;
+}
+
+static void
+_fb_start_vector(
+	_mysql_FlatBuffer *b,
+	size_t elem,
+	size_t n,
+	size_t align)
+{
+	_fb_prep(b, 4, elem * n);
+	_fb_prep(b, align, elem * n);
+}
+
+static size_t
+_fb_end_vector(
+	_mysql_FlatBuffer *b,
+	size_t n)
+{
+	_fb_scalar(b, n, 4);
+	return b->size;
+}
+
+static void
+_fb_start_table(
+	_mysql_FlatBuffer *b,
+	int nfields)
+{
+	b->nfields = nfields;
+	memset(b->slots, 0, sizeof(b->slots));
+	b->start = b->size;
+}
+
+static void
+_fb_field_scalar(
+	_mysql_FlatBuffer *b,
+	int slot,
+	unsigned PY_LONG_LONG v,
+	size_t n)
+{
+	_fb_scalar(b, v, n);
+	b->slots[slot] = b->size;
+}
+
+static void
+_fb_field_offset(
+	_mysql_FlatBuffer *b,
+	int slot,
+	size_t off)
+{
+	b->slots[slot] = _fb_offset(b, off);
+}
+
+/* Writes the table's offset to its vtable, then the vtable itself just
+   before the table, and points the former at the latter. */
+static size_t
+_fb_end_table(
+	_mysql_FlatBuffer *b)
+{
+	size_t table, vtable;
+	unsigned char *p;
+	int i;
+
+	_fb_scalar(b, 0, 4);
+	table = b->size;
+	for (i=b->nfields-1; i>=0; i--)
+		_fb_scalar(b, b->slots[i] ? table - b->slots[i] : 0, 2);
+	_fb_scalar(b, table - b->start, 2);
+	_fb_scalar(b, 4 + 2 * b->nfields, 2);
+	vtable = b->size;
+	if (b->error)
+		return 0;
+	p = (unsigned char *) b->buf + b->cap - table;
+	for (i=0; i<4; i++)
+		p[i] = (unsigned char) ((vtable - table) >> (8 * i));
+	return table;
+}
+
+static void
+_fb_finish(
+	_mysql_FlatBuffer *b,
+	size_t root)
+{
+	_fb_prep(b, 8, 4);
+	_fb_offset(b, root);
+}
+
+#define _ARROW_INT		1
+#define _ARROW_FLOAT		2
+#define _ARROW_DOUBLE		3
+#define _ARROW_DECIMAL		4
+#define _ARROW_DATE		5
+#define _ARROW_TIMESTAMP	6
+#define _ARROW_DURATION		7
+#define _ARROW_UTF8		8
+#define _ARROW_BINARY		9
+
+/* One column of the batch being built. Fixed-width kinds keep width
+   bytes per row in data; UTF8 and BINARY keep the cell bytes in data
+   and int32 end offsets in offsets. */
+typedef struct {
+	int kind;
+	int width;
+	int is_signed;
+	int precision;
+	int scale;
+	unsigned char *valid;
+	char *data;
+	size_t data_len;
+	size_t data_cap;
+	int *offsets;
+	PY_LONG_LONG nulls;
+} _mysql_ArrowColumn;
+
+static int
+_arrow_little_endian(void)
+{
+	int one = 1;
+	return *(char *) &one;
+}
+
+static void
+_arrow_column_init(
+	_mysql_ArrowColumn *col,
+	MYSQL_FIELD *field,
+	int text)
+{
+	col->is_signed = !(field->flags & UNSIGNED_FLAG);
+	switch (field->type) {
+	case MYSQL_TYPE_TINY:
+		col->kind = _ARROW_INT; col->width = 1; break;
+	case MYSQL_TYPE_SHORT:
+	case MYSQL_TYPE_YEAR:
+		col->kind = _ARROW_INT; col->width = 2; break;
+	case MYSQL_TYPE_LONG:
+	case MYSQL_TYPE_INT24:
+		col->kind = _ARROW_INT; col->width = 4; break;
+	case MYSQL_TYPE_LONGLONG:
+		col->kind = _ARROW_INT; col->width = 8; break;
+	case MYSQL_TYPE_FLOAT:
+		col->kind = _ARROW_FLOAT; col->width = 4; break;
+	case MYSQL_TYPE_DOUBLE:
+		col->kind = _ARROW_DOUBLE; col->width = 8; break;
+	case MYSQL_TYPE_DECIMAL:
+#if MYSQL_VERSION_ID >= 50003
+	case MYSQL_TYPE_NEWDECIMAL:
+#endif
+		/* length counts the sign and the decimal point */
+		col->scale = field->decimals;
+		col->precision = (int) field->length - (field->decimals > 0) -
+			col->is_signed;
+		if (col->precision > 0 && col->precision <= 38) {
+			col->kind = _ARROW_DECIMAL; col->width = 16;
+		} else
+			col->kind = text ? _ARROW_UTF8 : _ARROW_BINARY;
+		break;
+	case MYSQL_TYPE_DATE:
+	case MYSQL_TYPE_NEWDATE:
+		col->kind = _ARROW_DATE; col->width = 4; break;
+	case MYSQL_TYPE_DATETIME:
+	case MYSQL_TYPE_TIMESTAMP:
+		col->kind = _ARROW_TIMESTAMP; col->width = 8; break;
+	case MYSQL_TYPE_TIME:
+		col->kind = _ARROW_DURATION; col->width = 8; break;
+#if MYSQL_VERSION_ID >= 50708 && !defined(MARIADB_BASE_VERSION)
+	case MYSQL_TYPE_JSON:
+		col->kind = text ? _ARROW_UTF8 : _ARROW_BINARY; break;
+#endif
+	default:
+		/* charsetnr 63 is the binary pseudo-charset */
+		col->kind = text && field->charsetnr != 63 ?
+			_ARROW_UTF8 : _ARROW_BINARY;
+	}
+}
+
+/* Reads an optionally signed run of digits; returns the characters
+   used, or 0 if there were no digits or the value overflowed. */
+static size_t
+_arrow_parse_digits(
+	const char *s,
+	size_t n,
+	int *negative,
+	unsigned PY_LONG_LONG *v)
+{
+	size_t i = 0;
+	unsigned PY_LONG_LONG x = 0;
+
+	*negative = 0;
+	if (i < n && (s[i] == '-' || s[i] == '+'))
+		*negative = s[i++] == '-';
+	if (i == n || s[i] < '0' || s[i] > '9')
+		return 0;
+	for (; i<n && s[i] >= '0' && s[i] <= '9'; i++) {
+		unsigned int d = s[i] - '0';
+		if (x > (~(unsigned PY_LONG_LONG) 0 - d) / 10)
+			return 0;
+		x = x * 10 + d;
+	}
+	*v = x;
+	return i;
+}
+
+static PY_LONG_LONG
+_arrow_days_from_civil(
+	PY_LONG_LONG y,
+	unsigned int m,
+	unsigned int d)
+{
+	PY_LONG_LONG era, yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+/* Reads exactly width digits starting at s[*i]. */
+static int
+_arrow_fixed_digits(
+	const char *s,
+	size_t n,
+	size_t *i,
+	int width,
+	unsigned int *v)
+{
+	*v = 0;
+	for (; width; width--, (*i)++) {
+		if (*i >= n || s[*i] < '0' || s[*i] > '9')
+			return -1;
+		*v = *v * 10 + (s[*i] - '0');
+	}
+	return 0;
+}
+
+/* Reads an optional fraction of a second as microseconds. */
+static PY_LONG_LONG
+_arrow_micros(
+	const char *s,
+	size_t n,
+	size_t i)
+{
+	PY_LONG_LONG us = 0;
+	int k;
+
+	if (i >= n || s[i] != '.')
+		return 0;
+	for (i++, k=0; k<6; k++, i++)
+		us = us * 10 + (i < n && s[i] >= '0' && s[i] <= '9' ?
+				s[i] - '0' : 0);
+	return us;
+}
+
+/* Parses one cell into the column's representation at dst; returns
+   -1 if the text does not fit it, which stores NULL instead. */
+static int
+_arrow_parse(
+	_mysql_ArrowColumn *col,
+	const char *s,
+	size_t n,
+	char *dst)
+{
+	unsigned PY_LONG_LONG u;
+	int negative;
+	size_t i;
+
+	switch (col->kind) {
+	case _ARROW_INT: {
+		PY_LONG_LONG x;
+		if (_arrow_parse_digits(s, n, &negative, &u) != n)
+			return -1;
+		if (negative && !col->is_signed && u)
+			return -1;
+		x = negative ? -(PY_LONG_LONG) u : (PY_LONG_LONG) u;
+		switch (col->width) {
+		case 1: { signed char c = (signed char) x; memcpy(dst, &c, 1); break; }
+		case 2: { short h = (short) x; memcpy(dst, &h, 2); break; }
+		case 4: { int w = (int) x; memcpy(dst, &w, 4); break; }
+		default: memcpy(dst, &x, 8);
+		}
+		return 0;
+	}
+	case _ARROW_FLOAT:
+	case _ARROW_DOUBLE: {
+		char buf[64], *end;
+		double d;
+		if (n >= sizeof(buf))
+			return -1;
+		memcpy(buf, s, n);
+		buf[n] = 0;
+		d = strtod(buf, &end);
+		if (end != buf + n)
+			return -1;
+		if (col->kind == _ARROW_FLOAT) {
+			float f = (float) d;
+			memcpy(dst, &f, 4);
+		} else
+			memcpy(dst, &d, 8);
+		return 0;
+	}
+	case _ARROW_DECIMAL: {
+		/* unscaled value as a 128-bit two's complement integer */
+		unsigned PY_LONG_LONG lo = 0, hi = 0;
+		int scale = 0, point = 0;
+		negative = 0;
+		i = 0;
+		if (i < n && (s[i] == '-' || s[i] == '+'))
+			negative = s[i++] == '-';
+		for (;; i++) {
+			unsigned PY_LONG_LONG a, b, carry;
+			unsigned int digit;
+			if (i < n && s[i] == '.' && !point) {
+				point = 1;
+				continue;
+			}
+			if (i < n) {
+				if (s[i] < '0' || s[i] > '9')
+					return -1;
+				if (point && scale == col->scale)
+					continue;
+				digit = s[i] - '0';
+			} else if (scale < col->scale) {
+				digit = 0;
+			} else
+				break;
+			if (point || i >= n)
+				scale++;
+			a = (lo & 0xFFFFFFFFUL) * 10;
+			b = (lo >> 32) * 10 + (a >> 32);
+			carry = b >> 32;
+			lo = (b << 32) | (a & 0xFFFFFFFFUL);
+			hi = hi * 10 + carry;
+			if (lo + digit < lo)
+				hi++;
+			lo += digit;
+		}
+		if (negative) {
+			lo = ~lo + 1;
+			hi = ~hi + (lo == 0);
+		}
+		if (_arrow_little_endian()) {
+			memcpy(dst, &lo, 8);
+			memcpy(dst + 8, &hi, 8);
+		} else {
+			memcpy(dst, &hi, 8);
+			memcpy(dst + 8, &lo, 8);
+		}
+		return 0;
+	}
+	case _ARROW_DATE:
+	case _ARROW_TIMESTAMP: {
+		unsigned int y, m, d, hh = 0, mm = 0, ss = 0;
+		PY_LONG_LONG days, t;
+		i = 0;
+		if (_arrow_fixed_digits(s, n, &i, 4, &y) || i >= n ||
+		    s[i++] != '-' || _arrow_fixed_digits(s, n, &i, 2, &m) ||
+		    i >= n || s[i++] != '-' ||
+		    _arrow_fixed_digits(s, n, &i, 2, &d))
+			return -1;
+		/* zero dates have no Arrow equivalent */
+		if (!y || !m || !d || m > 12 || d > 31)
+			return -1;
+		days = _arrow_days_from_civil(y, m, d);
+		if (col->kind == _ARROW_DATE) {
+			int w = (int) days;
+			memcpy(dst, &w, 4);
+			return 0;
+		}
+		if (i < n && (s[i] == ' ' || s[i] == 'T')) {
+			i++;
+			if (_arrow_fixed_digits(s, n, &i, 2, &hh) ||
+			    i >= n || s[i++] != ':' ||
+			    _arrow_fixed_digits(s, n, &i, 2, &mm) ||
+			    i >= n || s[i++] != ':' ||
+			    _arrow_fixed_digits(s, n, &i, 2, &ss))
+				return -1;
+		}
+		t = (days * 86400 + hh * 3600 + mm * 60 + ss) * 1000000 +
+			_arrow_micros(s, n, i);
+		memcpy(dst, &t, 8);
+		return 0;
+	}
+	case _ARROW_DURATION: {
+		unsigned int mm, ss;
+		PY_LONG_LONG t;
+		i = _arrow_parse_digits(s, n, &negative, &u);
+		if (!i || i >= n || s[i++] != ':' ||
+		    _arrow_fixed_digits(s, n, &i, 2, &mm) ||
+		    i >= n || s[i++] != ':' ||
+		    _arrow_fixed_digits(s, n, &i, 2, &ss))
+			return -1;
+		t = ((PY_LONG_LONG) u * 3600 + mm * 60 + ss) * 1000000 +
+			_arrow_micros(s, n, i);
+		if (negative)
+			t = -t;
+		memcpy(dst, &t, 8);
+		return 0;
+	}
+	}
+	return -1;
+}
+
+static int
+_arrow_reserve(
+	_mysql_ArrowColumn *col,
+	size_t n)
+{
+	char *data;
+	size_t cap;
+
+	if (col->data_len + n <= col->data_cap)
+		return 0;
+	cap = col->data_cap * 2 + n;
+	if (!(data = realloc(col->data, cap)))
+		return -1;
+	col->data = data;
+	col->data_cap = cap;
+	return 0;
+}
+
+static int
+_arrow_append(
+	_mysql_ArrowColumn *col,
+	PY_LONG_LONG row,
+	const char *s,
+	unsigned long n)
+{
+	int valid = s != NULL;
+
+	if (col->kind == _ARROW_UTF8 || col->kind == _ARROW_BINARY) {
+		if (valid) {
+			if (_arrow_reserve(col, n))
+				return -1;
+			memcpy(col->data + col->data_len, s, n);
+			col->data_len += n;
+		}
+		col->offsets[row + 1] = (int) col->data_len;
+	} else {
+		char *dst = col->data + row * col->width;
+		if (valid && _arrow_parse(col, s, n, dst))
+			valid = 0;
+		if (!valid)
+			memset(dst, 0, col->width);
+	}
+	if (valid)
+		col->valid[row >> 3] |= 1 << (row & 7);
+	else
+		col->nulls++;
+	return 0;
+}
+
+static size_t
+_arrow_padded(
+	size_t n)
+{
+	return (n + 7) & ~(size_t) 7;
+}
+
+static void
+_arrow_put_padded(
+	_mysql_Writer *w,
+	const void *p,
+	size_t n)
+{
+	static const char zeros[8];
+
+	_mysql_Writer_put(w, (const char *) p, n);
+	_mysql_Writer_put(w, zeros, _arrow_padded(n) - n);
+}
+
+/* Writes the metadata in b, framed, followed by nothing: the caller
+   writes the body. */
+static void
+_arrow_write_message(
+	_mysql_Writer *w,
+	_mysql_FlatBuffer *b)
+{
+	unsigned char prefix[8];
+	size_t i;
+
+	for (i=0; i<4; i++) {
+		prefix[i] = 0xFF;
+		prefix[4 + i] = (unsigned char) (b->size >> (8 * i));
+	}
+	_mysql_Writer_put(w, (char *) prefix, 8);
+	_mysql_Writer_put(w, b->buf + b->cap - b->size, b->size);
+}
+
+static void
+_arrow_write_schema(
+	_mysql_Writer *w,
+	_mysql_FlatBuffer *b,
+	_mysql_ArrowColumn *cols,
+	MYSQL_FIELD *fields,
+	unsigned int n)
+{
+	size_t *offsets, schema, vec;
+	unsigned int i;
+
+	if (!(offsets = malloc((n + 1) * sizeof(size_t)))) {
+		b->error = ENOMEM;
+		return;
+	}
+	for (i=0; i<n; i++) {
+		_mysql_ArrowColumn *col = &cols[i];
+		size_t name, type, children;
+		int type_id;
+
+		name = _fb_string(b, fields[i].name, strlen(fields[i].name));
+		_fb_start_vector(b, 4, 0, 4);
+		children = _fb_end_vector(b, 0);
+		switch (col->kind) {
+		case _ARROW_INT:
+			_fb_start_table(b, 2);
+			_fb_field_scalar(b, 0, col->width * 8, 4);
+			_fb_field_scalar(b, 1, col->is_signed, 1);
+			type_id = 2;
+			break;
+		case _ARROW_FLOAT:
+		case _ARROW_DOUBLE:
+			_fb_start_table(b, 1);
+			_fb_field_scalar(b, 0, col->kind == _ARROW_FLOAT ? 1 : 2, 2);
+			type_id = 3;
+			break;
+		case _ARROW_DECIMAL:
+			_fb_start_table(b, 3);
+			_fb_field_scalar(b, 0, col->precision, 4);
+			_fb_field_scalar(b, 1, col->scale, 4);
+			_fb_field_scalar(b, 2, 128, 4);
+			type_id = 7;
+			break;
+		case _ARROW_DATE:
+			_fb_start_table(b, 1);
+			_fb_field_scalar(b, 0, 0, 2);	/* DAY */
+			type_id = 8;
+			break;
+		case _ARROW_TIMESTAMP:
+		case _ARROW_DURATION:
+			_fb_start_table(b, 1);
+			_fb_field_scalar(b, 0, 2, 2);	/* MICROSECOND */
+			type_id = col->kind == _ARROW_TIMESTAMP ? 10 : 18;
+			break;
+		default:
+			_fb_start_table(b, 0);
+			type_id = col->kind == _ARROW_UTF8 ? 5 : 4;
+		}
+		type = _fb_end_table(b);
+		_fb_start_table(b, 7);
+		_fb_field_offset(b, 0, name);
+		_fb_field_offset(b, 3, type);
+		_fb_field_offset(b, 5, children);
+		_fb_field_scalar(b, 1, 1, 1);		/* nullable */
+		_fb_field_scalar(b, 2, type_id, 1);
+		offsets[i] = _fb_end_table(b);
+	}
+	_fb_start_vector(b, 4, n, 4);
+	for (i=n; i>0; i--)
+		_fb_offset(b, offsets[i - 1]);
+	vec = _fb_end_vector(b, n);
+	free(offsets);
+	_fb_start_table(b, 4);
+	_fb_field_offset(b, 1, vec);
+	_fb_field_scalar(b, 0, !_arrow_little_endian(), 2);
+	schema = _fb_end_table(b);
+	_fb_start_table(b, 5);
+	_fb_field_offset(b, 2, schema);
+	_fb_field_scalar(b, 3, 0, 8);		/* bodyLength */
+	_fb_field_scalar(b, 0, 4, 2);		/* MetadataVersion V5 */
+	_fb_field_scalar(b, 1, 1, 1);		/* MessageHeader Schema */
+	_fb_finish(b, _fb_end_table(b));
+	if (!b->error)
+		_arrow_write_message(w, b);
+}
+
+static void
+_arrow_write_batch(
+	_mysql_Writer *w,
+	_mysql_FlatBuffer *b,
+	_mysql_ArrowColumn *cols,
+	unsigned int n,
+	PY_LONG_LONG rows)
+{
+	size_t nodes, buffers, batch, body = 0, bitmap = (rows + 7) / 8;
+	unsigned int i;
+	int k;
+
+	/* Buffer structs, last first: validity, then offsets and data
+	   or values, per column */
+	_fb_start_vector(b, 16, 0, 8);
+	for (i=n; i>0; i--) {
+		_mysql_ArrowColumn *col = &cols[i - 1];
+		if (col->kind == _ARROW_UTF8 || col->kind == _ARROW_BINARY)
+			body += _arrow_padded(col->data_len) +
+				_arrow_padded((rows + 1) * 4);
+		else
+			body += _arrow_padded(rows * col->width);
+		body += _arrow_padded(bitmap);
+	}
+	buffers = body;
+	for (i=n, k=0; i>0; i--) {
+		_mysql_ArrowColumn *col = &cols[i - 1];
+		size_t sizes[3];
+		int nbuf = 0;
+		sizes[nbuf++] = bitmap;
+		if (col->kind == _ARROW_UTF8 || col->kind == _ARROW_BINARY) {
+			sizes[nbuf++] = (rows + 1) * 4;
+			sizes[nbuf++] = col->data_len;
+		} else
+			sizes[nbuf++] = rows * col->width;
+		while (nbuf--) {
+			buffers -= _arrow_padded(sizes[nbuf]);
+			_fb_scalar(b, sizes[nbuf], 8);
+			_fb_scalar(b, buffers, 8);
+			k++;
+		}
+	}
+	buffers = _fb_end_vector(b, k);
+	_fb_start_vector(b, 16, n, 8);
+	for (i=n; i>0; i--) {
+		_fb_scalar(b, cols[i - 1].nulls, 8);
+		_fb_scalar(b, rows, 8);
+	}
+	nodes = _fb_end_vector(b, n);
+	_fb_start_table(b, 3);
+	_fb_field_scalar(b, 0, rows, 8);
+	_fb_field_offset(b, 1, nodes);
+	_fb_field_offset(b, 2, buffers);
+	batch = _fb_end_table(b);
+	_fb_start_table(b, 5);
+	_fb_field_scalar(b, 3, body, 8);
+	_fb_field_offset(b, 2, batch);
+	_fb_field_scalar(b, 0, 4, 2);
+	_fb_field_scalar(b, 1, 3, 1);		/* MessageHeader RecordBatch */
+	_fb_finish(b, _fb_end_table(b));
+	if (b->error)
+		return;
+	_arrow_write_message(w, b);
+	for (i=0; i<n; i++) {
+		_mysql_ArrowColumn *col = &cols[i];
+		_arrow_put_padded(w, col->valid, bitmap);
+		if (col->kind == _ARROW_UTF8 || col->kind == _ARROW_BINARY) {
+			_arrow_put_padded(w, col->offsets, (rows + 1) * 4);
+			_arrow_put_padded(w, col->data, col->data_len);
+		} else
+			_arrow_put_padded(w, col->data, rows * col->width);
+	}
+}
+
+/* Writes the rows collected so far as a record batch and empties the
+   columns for the next one. */
+static void
+_arrow_flush_batch(
+	_mysql_Writer *w,
+	_mysql_FlatBuffer *b,
+	_mysql_ArrowColumn *cols,
+	unsigned int n,
+	PY_LONG_LONG rows,
+	PY_LONG_LONG batch_rows)
+{
+	unsigned int i;
+
+	b->size = 0;
+	_arrow_write_batch(w, b, cols, n, rows);
+	for (i=0; i<n; i++) {
+		memset(cols[i].valid, 0, (batch_rows + 7) / 8);
+		cols[i].nulls = 0;
+		if (cols[i].offsets)
+			cols[i].data_len = 0;
+	}
+}
+
+static void
+_arrow_free(
+	_mysql_ArrowColumn *cols,
+	unsigned int n)
+{
+	unsigned int i;
+
+	for (i=0; i<n; i++) {
+		free(cols[i].valid);
+		free(cols[i].data);
+		free(cols[i].offsets);
+	}
+	PyMem_Free(cols);
+}
+
+char _mysql_ResultObject_write_arrow__doc__[] =
+"write_arrow(file=None, batch_rows=65536)\n\
+  Writes the remaining rows as an Apache Arrow IPC stream: a schema\n\
+  derived from the field metadata, then record batches of up to\n\
+  batch_rows rows. file is handled as by copy_to(); if it is None,\n\
+  the stream is returned as a string, otherwise the number of rows.\n\
+\n\
+  Integers, floats, DECIMAL (up to 38 digits), DATE, DATETIME and\n\
+  TIMESTAMP (microseconds, no time zone) and TIME (a duration) get\n\
+  their Arrow types; values that do not fit, such as zero dates,\n\
+  become null. Other columns are utf8 when the connection character\n\
+  set is utf8 or utf8mb4 and the column is not binary, else binary.\n\
+";
+
+PyObject *
+_mysql_ResultObject_write_arrow(
+	_mysql_ResultObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"file", "batch_rows", NULL};
+	PyObject *file = Py_None, *buffer = NULL, *result = NULL;
+	int batch_rows = 65536, more = 1, failed = 0;
+	_mysql_Writer w;
+	_mysql_FlatBuffer b;
+	_mysql_ArrowColumn *cols;
+	MYSQL_FIELD *fields;
+	MYSQL_ROW row;
+	unsigned long *lengths;
+	unsigned PY_LONG_LONG count = 0;
+	_mysql_RowCounts counts = {0, 0, 0};
+	PY_LONG_LONG rows = 0;
+	unsigned int i, n;
+	const char *charset;
+	int text;
+	_mysql_GilRelease save = {NULL, NULL, 0};
+	static const unsigned char eos[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Oi:write_arrow", kwlist,
+					 &file, &batch_rows))
+		return NULL;
+	check_result_connection(self);
+	if (batch_rows < 1) {
+		PyErr_SetString(PyExc_ValueError, "batch_rows must be positive");
+		return NULL;
+	}
+	n = self->nfields;
+	fields = mysql_fetch_fields(self->result);
+	charset = mysql_character_set_name(&(result_connection(self)->connection));
+	text = !strncmp(charset, "utf8", 4);
+	if (!(cols = PyMem_Malloc(n * sizeof(_mysql_ArrowColumn) + 1)))
+		return PyErr_NoMemory();
+	memset(cols, 0, n * sizeof(_mysql_ArrowColumn));
+	for (i=0; i<n; i++) {
+		_mysql_ArrowColumn *col = &cols[i];
+		_arrow_column_init(col, &fields[i], text);
+		col->valid = calloc((batch_rows + 7) / 8, 1);
+		if (col->kind == _ARROW_UTF8 || col->kind == _ARROW_BINARY)
+			col->offsets = calloc(batch_rows + 1, sizeof(int));
+		else
+			col->data = malloc(batch_rows * col->width);
+		if (!col->valid || (!col->data && !col->offsets)) {
+			_arrow_free(cols, n);
+			return PyErr_NoMemory();
+		}
+	}
+	if (file == Py_None) {
+		PyObject *module = PyImport_ImportModule("cStringIO");
+		if (module) {
+			buffer = PyObject_CallMethod(module, "StringIO", NULL);
+			Py_DECREF(module);
+		}
+		if (!buffer) {
+			_arrow_free(cols, n);
+			return NULL;
+		}
+		file = buffer;
+	}
+	if (_mysql_Writer_open(&w, file)) {
+		Py_XDECREF(buffer);
+		_arrow_free(cols, n);
+		return NULL;
+	}
+	memset(&b, 0, sizeof(b));
+
+	if (w.fd >= 0)
+		_mysql_gil_release(&save);
+	_arrow_write_schema(&w, &b, cols, fields, n);
+	while (!w.error && !b.error && !failed &&
+	       (more = _mysql_ResultObject_raw_row(self, &row, &lengths,
+						   &counts))) {
+		/* end the batch when full, or before the int32 offsets of
+		   a variable-width column would overflow */
+		for (i=0; i<n; i++)
+			if (cols[i].offsets && row[i] &&
+			    cols[i].data_len + lengths[i] > 0x7FFFFFFF)
+				break;
+		if (rows == batch_rows || (rows && i < n)) {
+			_arrow_flush_batch(&w, &b, cols, n, rows, batch_rows);
+			rows = 0;
+		}
+		for (i=0; i<n; i++)
+			if (_arrow_append(&cols[i], rows, row[i], lengths[i]))
+				failed = 1;
+		rows++;
+		count++;
+	}
+	if (rows && !w.error && !b.error && !failed)
+		_arrow_flush_batch(&w, &b, cols, n, rows, batch_rows);
+	if (!b.error && !failed)
+		_mysql_Writer_put(&w, (const char *) eos, sizeof(eos));
+	_mysql_Writer_flush(&w);
+	if (save.save)
+		_mysql_gil_acquire(&save);
+	_mysql_ResultObject_add_counts(self, &counts);
+	_mysql_ResultObject_finished(self);
+	free(b.buf);
+	_arrow_free(cols, n);
+	if (_mysql_Writer_close(&w))
+		goto error;
+	if (b.error || failed) {
+		PyErr_NoMemory();
+		goto error;
+	}
+	if (!more && !self->spill &&
+	    mysql_errno(&(result_connection(self)->connection))) {
+		_mysql_Exception(result_connection(self));
+		goto error;
+	}
+	if (buffer)
+		result = PyObject_CallMethod(buffer, "getvalue", NULL);
+	else
+		result = PyLong_FromUnsignedLongLong(count);
+  error:
+	Py_XDECREF(buffer);
+	return result;
+}
+
+/* Sets up col to parse field as the fetch_into() layout code says;
+   returns -1 if the field type does not match. Kind 0 skips. */
+static int
+_fetch_into_column(
+	_mysql_ArrowColumn *col,
+	MYSQL_FIELD *field,
+	char code)
+{
+	int integer = 0, number = 0;
+
+	memset(col, 0, sizeof(*col));
+	switch (field->type) {
+	case MYSQL_TYPE_TINY:
+	case MYSQL_TYPE_SHORT:
+	case MYSQL_TYPE_LONG:
+	case MYSQL_TYPE_INT24:
+	case MYSQL_TYPE_YEAR:
+		integer = 1;
+		break;
+	case MYSQL_TYPE_LONGLONG:
+		/* unsigned BIGINT may not fit an int64 */
+		integer = !(field->flags & UNSIGNED_FLAG);
+		number = 1;
+		break;
+	case MYSQL_TYPE_FLOAT:
+	case MYSQL_TYPE_DOUBLE:
+	case MYSQL_TYPE_DECIMAL:
+#if MYSQL_VERSION_ID >= 50003
+	case MYSQL_TYPE_NEWDECIMAL:
+#endif
+		number = 1;
+		break;
+	default:
+		break;
+	}
+	col->width = 8;
+	col->is_signed = 1;
+	switch (code) {
+	case 'i':
+		col->kind = _ARROW_INT;
+		return integer ? 0 : -1;
+	case 'f':
+		col->kind = _ARROW_DOUBLE;
+		return integer || number ? 0 : -1;
+	case 'M':
+		col->kind = _ARROW_TIMESTAMP;
+		return field->type == MYSQL_TYPE_DATE ||
+			field->type == MYSQL_TYPE_NEWDATE ||
+			field->type == MYSQL_TYPE_DATETIME ||
+			field->type == MYSQL_TYPE_TIMESTAMP ? 0 : -1;
+	case 'm':
+		col->kind = _ARROW_DURATION;
+		return field->type == MYSQL_TYPE_TIME ? 0 : -1;
+	case 'x':
+		col->width = 0;
+		return 0;
+	}
+	return -1;
+}
+
+/* Gets a writable pointer to obj's memory. Objects with the new
+   buffer interface stay pinned until the view is released, so they
+   can be filled without the GIL; *pinned is cleared otherwise. */
+static int
+_fetch_into_buffer(
+	PyObject *obj,
+	Py_buffer *view,
+	int *pinned)
+{
+	memset(view, 0, sizeof(*view));
+	if (PyObject_CheckBuffer(obj))
+		return PyObject_GetBuffer(obj, view, PyBUF_WRITABLE);
+	*pinned = 0;
+	return PyObject_AsWriteBuffer(obj, &view->buf, &view->len);
+}
+
+char _mysql_ResultObject_fetch_into__doc__[] =
+"fetch_into(buffer, layout, maxrows=0, nulls=None)\n\
+  Decodes up to maxrows of the remaining rows, or as many as fit if\n\
+  maxrows is 0, into buffer: any writable buffer, such as a\n\
+  bytearray, an mmap or a NumPy structured array. Each row becomes a\n\
+  packed record of 8-byte fields in native byte order, one for each\n\
+  character of layout other than x:\n\
+\n\
+    i  int64, from an integer field\n\
+    f  double, from an integer, floating point or DECIMAL field\n\
+    M  int64 microseconds since the epoch, from a DATE, DATETIME or\n\
+       TIMESTAMP field (NumPy datetime64[us])\n\
+    m  int64 microseconds, from a TIME field (NumPy timedelta64[us])\n\
+    x  the field is skipped\n\
+\n\
+  layout must have one character per field. NULL, and values that\n\
+  do not fit such as zero dates, are stored as 0, NaN or, for M and\n\
+  m, NaT (the smallest int64). If nulls is given, it is a writable\n\
+  buffer receiving one byte per stored field and row: 1 for such\n\
+  cells, else 0. Returns the number of rows written.\n\
+";
+
+PyObject *
+_mysql_ResultObject_fetch_into(
+	_mysql_ResultObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"buffer", "layout", "maxrows", "nulls", NULL};
+	PyObject *buffer, *nulls = Py_None;
+	char *layout;
+	Py_ssize_t capacity;
+	int layout_len, maxrows = 0, pinned = 1, more = 1;
+	Py_buffer data, mask;
+	_mysql_ArrowColumn *cols;
+	MYSQL_FIELD *fields;
+	MYSQL_ROW row;
+	unsigned long *lengths;
+	_mysql_RowCounts counts = {0, 0, 0};
+	PY_LONG_LONG count = 0, nat = PY_LLONG_MIN;
+	unsigned int i, n, stored = 0;
+	double nan = Py_NAN;
+	_mysql_GilRelease save = {NULL, NULL, 0};
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os#|iO:fetch_into",
+					 kwlist, &buffer, &layout, &layout_len,
+					 &maxrows, &nulls))
+		return NULL;
+	check_result_connection(self);
+	n = self->nfields;
+	if (layout_len != (int) n) {
+		PyErr_Format(PyExc_ValueError,
+			     "layout has %d fields, result has %u",
+			     layout_len, n);
+		return NULL;
+	}
+	fields = mysql_fetch_fields(self->result);
+	if (!(cols = PyMem_Malloc(n * sizeof(_mysql_ArrowColumn) + 1)))
+		return PyErr_NoMemory();
+	for (i=0; i<n; i++) {
+		if (_fetch_into_column(&cols[i], &fields[i], layout[i])) {
+			PyErr_Format(PyExc_TypeError,
+				     "field %u (%s) cannot be stored as '%c'",
+				     i, fields[i].name, layout[i]);
+			PyMem_Free(cols);
+			return NULL;
+		}
+		if (cols[i].width)
+			stored++;
+	}
+	if (!stored) {
+		PyErr_SetString(PyExc_ValueError, "layout stores no fields");
+		PyMem_Free(cols);
+		return NULL;
+	}
+	if (_fetch_into_buffer(buffer, &data, &pinned)) {
+		PyMem_Free(cols);
+		return NULL;
+	}
+	memset(&mask, 0, sizeof(mask));
+	if (nulls != Py_None && _fetch_into_buffer(nulls, &mask, &pinned)) {
+		PyBuffer_Release(&data);
+		PyMem_Free(cols);
+		return NULL;
+	}
+	capacity = data.len / (stored * 8);
+	if (nulls != Py_None && mask.len / stored < capacity)
+		capacity = mask.len / stored;
+	if (maxrows > 0 && maxrows < capacity)
+		capacity = maxrows;
+
+	if (pinned)
+		_mysql_gil_release(&save);
+	while (count < capacity &&
+	       (more = _mysql_ResultObject_raw_row(self, &row, &lengths,
+						   &counts))) {
+		char *dst = (char *) data.buf + count * stored * 8;
+		char *flags = mask.buf ?
+			(char *) mask.buf + count * stored : NULL;
+		for (i=0; i<n; i++) {
+			_mysql_ArrowColumn *col = &cols[i];
+			int null;
+			if (!col->width)
+				continue;
+			null = !row[i] || _arrow_parse(col, row[i], lengths[i],
+						       dst);
+			if (null) {
+				if (col->kind == _ARROW_DOUBLE)
+					memcpy(dst, &nan, 8);
+				else if (col->kind == _ARROW_INT)
+					memset(dst, 0, 8);
+				else
+					memcpy(dst, &nat, 8);
+			}
+			if (flags)
+				*flags++ = (char) null;
+			dst += 8;
+		}
+		count++;
+	}
+	if (save.save)
+		_mysql_gil_acquire(&save);
+	_mysql_ResultObject_add_counts(self, &counts);
+	_mysql_ResultObject_finished(self);
+	PyBuffer_Release(&data);
+	PyBuffer_Release(&mask);
+	PyMem_Free(cols);
+	if (!more && !self->spill &&
+	    mysql_errno(&(result_connection(self)->connection)))
+		return _mysql_Exception(result_connection(self));
+	return PyLong_FromLongLong(count);
+}
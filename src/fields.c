@@ -2,6 +2,34 @@
 
 #include "mysqlmod.h"
 
+#define _MYSQL_FIELD_FREE_LIST_SIZE 256
+
+static PyObject *
+_mysql_FieldObject_free_items[_MYSQL_FIELD_FREE_LIST_SIZE];
+
+_mysql_FreeList _mysql_FieldObject_free_list = {
+	&_mysql_FieldObject_Type,
+	_mysql_FieldObject_free_items,
+	_MYSQL_FIELD_FREE_LIST_SIZE,
+	0, 0, 0
+};
+
+PyObject *
+_mysql_FieldObject_alloc(
+	PyTypeObject *type,
+	Py_ssize_t nitems)
+{
+	return _mysql_FreeList_Alloc(&_mysql_FieldObject_free_list,
+				     type, nitems);
+}
+
+void
+_mysql_FieldObject_free(
+	void *ob)
+{
+	_mysql_FreeList_Free(&_mysql_FieldObject_free_list, ob);
+}
+
 static char _mysql_FieldObject__doc__[] =
 "";
 
@@ -22,7 +50,7 @@ _mysql_FieldObject_Initialize(
 	self->index = index;
 	field = mysql_fetch_field_direct(result->result, index);
 	if (!field) return -1;
-	self->field = *field;
+	self->field = field;
 	self->result = (PyObject *) result;
 	Py_INCREF(result);
 	return 0;
@@ -76,153 +104,167 @@ static struct PyMemberDef _mysql_FieldObject_memberlist[] = {
 		RO,
 		"Result set"
 	},
+	{NULL} /* Sentinel */
+};
+
+/* The MYSQL_FIELD lives in the result's metadata, which is freed when
+   the result is cleared. */
+static MYSQL_FIELD *
+_mysql_FieldObject_metadata(
+	_mysql_FieldObject *self)
+{
+	if (!self->result || !((_mysql_ResultObject *)self->result)->result) {
+		PyErr_SetString(_mysql_ProgrammingError,
+				"result has been cleared");
+		return NULL;
+	}
+	return self->field;
+}
+
+static PyObject *
+_mysql_FieldObject_get_string(
+	_mysql_FieldObject *self,
+	void *offset)
+{
+	MYSQL_FIELD *field;
+	char *s;
+
+	if (!(field = _mysql_FieldObject_metadata(self))) return NULL;
+	s = *(char **)((char *)field + (size_t)offset);
+	if (!s) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	return PyString_FromString(s);
+}
+
+static PyObject *
+_mysql_FieldObject_get_ulong(
+	_mysql_FieldObject *self,
+	void *offset)
+{
+	MYSQL_FIELD *field;
+
+	if (!(field = _mysql_FieldObject_metadata(self))) return NULL;
+	return PyLong_FromUnsignedLong(
+		*(unsigned long *)((char *)field + (size_t)offset));
+}
+
+static PyObject *
+_mysql_FieldObject_get_uint(
+	_mysql_FieldObject *self,
+	void *offset)
+{
+	MYSQL_FIELD *field;
+
+	if (!(field = _mysql_FieldObject_metadata(self))) return NULL;
+	return PyInt_FromLong(
+		(long)*(unsigned int *)((char *)field + (size_t)offset));
+}
+
+static PyGetSetDef _mysql_FieldObject_getset[] = {
 	{
 		"name",
-		T_STRING,
-		offsetof(_mysql_FieldObject, field.name),
-		RO,
+		(getter)_mysql_FieldObject_get_string,
+		NULL,
 		"The name of the field. If the field was given\n\
-an alias with an AS clause, the value of name is the alias."
+an alias with an AS clause, the value of name is the alias.",
+		(void *)offsetof(MYSQL_FIELD, name)
 	},
 	{
 		"org_name",
-		T_STRING,
-		offsetof(_mysql_FieldObject, field.org_name),
-		RO,
-		"The name of the field. Aliases are ignored."
+		(getter)_mysql_FieldObject_get_string,
+		NULL,
+		"The name of the field. Aliases are ignored.",
+		(void *)offsetof(MYSQL_FIELD, org_name)
 	},
 	{
 		"table",
-		T_STRING,
-		offsetof(_mysql_FieldObject, field.table),
-		RO,
+		(getter)_mysql_FieldObject_get_string,
+		NULL,
 		"The name of the table containing this field,\n\
 if it isn't a calculated field. For calculated fields,\n\
 the table value is an empty string. If the column is selected from a view,\n\
 table names the view. If the table or view was given an alias with an AS clause,\n\
-the value of table is the alias.\n"
+the value of table is the alias.\n",
+		(void *)offsetof(MYSQL_FIELD, table)
 	},
 	{
 		"org_table",
-		T_STRING,
-		offsetof(_mysql_FieldObject, field.org_table),
-		RO,
+		(getter)_mysql_FieldObject_get_string,
+		NULL,
 		"The name of the table. Aliases are ignored.\n\
-If the column is selected from a view, org_table names the underlying table.\n"
+If the column is selected from a view, org_table names the underlying table.\n",
+		(void *)offsetof(MYSQL_FIELD, org_table)
 	},
 	{
 		"db",
-		T_STRING,
-		offsetof(_mysql_FieldObject, field.db),
-		RO,
+		(getter)_mysql_FieldObject_get_string,
+		NULL,
 		"The name of the database that the field comes from.\n\
-If the field is a calculated field, db is an empty string."
+If the field is a calculated field, db is an empty string.",
+		(void *)offsetof(MYSQL_FIELD, db)
 	},
 	{
 		"catalog",
-		T_STRING,
-		offsetof(_mysql_FieldObject, field.catalog),
-		RO,
-		"The catalog name. This value is always \"def\"."
+		(getter)_mysql_FieldObject_get_string,
+		NULL,
+		"The catalog name. This value is always \"def\".",
+		(void *)offsetof(MYSQL_FIELD, catalog)
 	},
 	{
 		"length",
-		T_ULONG,
-		offsetof(_mysql_FieldObject, field.length),
-		RO,
+		(getter)_mysql_FieldObject_get_ulong,
+		NULL,
 		"The width of the field.\n\
-as specified in the table definition.\n"
+as specified in the table definition.\n",
+		(void *)offsetof(MYSQL_FIELD, length)
 	},
 	{
 		"max_length",
-		T_ULONG,
-		offsetof(_mysql_FieldObject, field.max_length),
-		RO,
+		(getter)_mysql_FieldObject_get_ulong,
+		NULL,
 		"The maximum width of the field for the result set\n\
 (the length of the longest field value for the rows actually in the\n\
 result set). If you use conn.store_result(), this contains the\n\
 maximum length for the field. If you use conn.use_result(),\n\
-the value of this variable is zero.\n"
+the value of this variable is zero.\n",
+		(void *)offsetof(MYSQL_FIELD, max_length)
 	},
 	{
 		"decimals",
-		T_UINT,
-		offsetof(_mysql_FieldObject, field.decimals),
-		RO,
-		"The number of decimals for numeric fields.\n"
+		(getter)_mysql_FieldObject_get_uint,
+		NULL,
+		"The number of decimals for numeric fields.\n",
+		(void *)offsetof(MYSQL_FIELD, decimals)
 	},
 	{
 		"charsetnr",
-		T_UINT,
-		offsetof(_mysql_FieldObject, field.charsetnr),
-		RO,
-		"The character set number for the field."
+		(getter)_mysql_FieldObject_get_uint,
+		NULL,
+		"The character set number for the field.",
+		(void *)offsetof(MYSQL_FIELD, charsetnr)
 	},
 	{
 		"flags",
-		T_UINT,
-		offsetof(_mysql_FieldObject, field.flags),
-		RO,
+		(getter)_mysql_FieldObject_get_uint,
+		NULL,
 		"Different bit-flags for the field.\n\
 The bits are enumerated in MySQLdb.constants.FLAG.\n\
-The flags value may have zero or more of these bits set.\n"
+The flags value may have zero or more of these bits set.\n",
+		(void *)offsetof(MYSQL_FIELD, flags)
 	},
 	{
 		"type",
-		T_UINT,
-		offsetof(_mysql_FieldObject, field.type),
-		RO,
+		(getter)_mysql_FieldObject_get_uint,
+		NULL,
 		"The type of the field. The type values\n\
-are enumerated in MySQLdb.constants.FIELD_TYPE.\n"
+are enumerated in MySQLdb.constants.FIELD_TYPE.\n",
+		(void *)offsetof(MYSQL_FIELD, type)
 	},
 	{NULL} /* Sentinel */
 };
 
-static PyObject *
-_mysql_FieldObject_getattr(
-	_mysql_FieldObject *self,
-	char *name)
-{
-	PyObject *res;
-	struct PyMemberDef *l;
-
-	res = Py_FindMethod(_mysql_FieldObject_methods, (PyObject *)self, name);
-	if (res != NULL)
-		return res;
-	PyErr_Clear();
-
-	for (l = _mysql_FieldObject_memberlist; l->name != NULL; l++) {
-		if (strcmp(l->name, name) == 0)
-			return PyMember_GetOne((char *)self, l);
-	}
-
-	PyErr_SetString(PyExc_AttributeError, name);
-	return NULL;
-}
-
-static int
-_mysql_FieldObject_setattr(
-	_mysql_FieldObject *self,
-	char *name,
-	PyObject *v)
-{
-	struct PyMemberDef *l;
-
-	if (v == NULL) {
-		PyErr_SetString(PyExc_AttributeError,
-				"can't delete attributes");
-		return -1;
-	}
-
-
-	for (l = _mysql_FieldObject_memberlist; l->name != NULL; l++)
-		if (strcmp(l->name, name) == 0)
-			return PyMember_SetOne((char *)self, l, v);
-
-        PyErr_SetString(PyExc_AttributeError, name);
-        return -1;
-}
-
 PyTypeObject _mysql_FieldObject_Type = {
 	PyObject_HEAD_INIT(NULL)
 	0,
@@ -231,8 +273,8 @@ PyTypeObject _mysql_FieldObject_Type = {
 	0,
 	(destructor)_mysql_FieldObject_dealloc, /* tp_dealloc */
 	0, /*tp_print*/
-	(getattrfunc)_mysql_FieldObject_getattr, /* tp_getattr */
-	(setattrfunc)_mysql_FieldObject_setattr, /* tp_setattr */
+	0, /* tp_getattr */
+	0, /* tp_setattr */
 	0, /*tp_compare*/
 	(reprfunc)_mysql_FieldObject_repr, /* tp_repr */
 
@@ -277,7 +319,7 @@ PyTypeObject _mysql_FieldObject_Type = {
 	/* Attribute descriptor and subclassing stuff */
 	(struct PyMethodDef *)_mysql_FieldObject_methods, /* tp_methods */
 	(struct PyMemberDef *)_mysql_FieldObject_memberlist, /*tp_members */
-	0, /* (struct getsetlist *) tp_getset; */
+	(struct PyGetSetDef *)_mysql_FieldObject_getset, /* tp_getset */
 	0, /* (struct _typeobject *) tp_base; */
 	0, /* (PyObject *) tp_dict */
 	0, /* (descrgetfunc) tp_descr_get */
@@ -0,0 +1,484 @@
+/* -*- mode: C; indent-tabs-mode: t; c-basic-offset: 8; -*- */
+
+#include "mysqlmod.h"
+#include "pythread.h"
+
+/* GIL profiling. gil_profile(True) replaces every method of the
+   connection, result and blob types, and every function of the module,
+   with a probe that times each call and counts how long the GIL was
+   held, how long it was released (MYSQL_BEGIN_ALLOW_THREADS) and how
+   long it took to get back; gil_profile(False) puts the originals back.
+   Nothing but the flag test in _mysql_gil_release() is left on the
+   normal path. */
+
+/* Thread-local key of the timer of the profiled call running in each
+   thread, if any; created by the first gil_profile(True). Python code
+   run during a call (a trace hook, a file's read()) can switch threads,
+   so a timer, which lives on its call's stack, is only ever seen by
+   the thread that made the call. */
+static int _mysql_gil_key = -1;
+
+/* The counters of one entry point. */
+typedef struct {
+	unsigned PY_LONG_LONG calls;
+	unsigned PY_LONG_LONG held_ns;
+	unsigned PY_LONG_LONG released_ns;
+	unsigned PY_LONG_LONG wait_ns;
+	_mysql_Histogram held;
+	_mysql_Histogram wait;
+} _mysql_GilSite;
+
+/* A probe installed in place of target under key in owner (a type or a
+   module dict) owns its site; the probe bound to an instance for one
+   call shares its parent's. */
+typedef struct {
+	PyObject_HEAD
+	PyObject *target;
+	PyObject *name;
+	PyObject *owner;
+	PyObject *key;
+	PyObject *parent;
+	_mysql_GilSite *site;
+} _mysql_GilProbeObject;
+
+static PyObject *_mysql_gil_probes = NULL;
+static int _mysql_gil_enabled = 0;
+
+static _mysql_GilTimer *
+_mysql_gil_current(void)
+{
+	if (_mysql_gil_key == -1)
+		return NULL;
+	return (_mysql_GilTimer *) PyThread_get_key_value(_mysql_gil_key);
+}
+
+/* PyThread_set_key_value() keeps a value already set, so the old one
+   is deleted first. If it fails, the thread's calls are not nested. */
+static void
+_mysql_gil_set_current(
+	_mysql_GilTimer *timer)
+{
+	PyThread_delete_key_value(_mysql_gil_key);
+	if (timer)
+		PyThread_set_key_value(_mysql_gil_key, timer);
+}
+
+void
+_mysql_gil_release(
+	_mysql_GilRelease *r)
+{
+	r->timer = _mysql_gil_enabled ? _mysql_gil_current() : NULL;
+	if (r->timer)
+		r->mark = _mysql_clock_ns();
+	r->save = PyEval_SaveThread();
+}
+
+void
+_mysql_gil_acquire(
+	_mysql_GilRelease *r)
+{
+	unsigned PY_LONG_LONG now;
+
+	if (!r->timer) {
+		PyEval_RestoreThread(r->save);
+		return;
+	}
+	now = _mysql_clock_ns();
+	r->timer->released += now - r->mark;
+	PyEval_RestoreThread(r->save);
+	r->timer->waited += _mysql_clock_ns() - now;
+}
+
+static _mysql_GilProbeObject *
+_mysql_GilProbe_New(
+	PyObject *target,
+	PyObject *name,
+	_mysql_GilProbeObject *parent)
+{
+	_mysql_GilProbeObject *p;
+
+	if (!(p = MyAlloc(_mysql_GilProbeObject, _mysql_GilProbeObject_Type)))
+		return NULL;
+	if (parent)
+		p->site = parent->site;
+	else if (!(p->site = calloc(1, sizeof(_mysql_GilSite)))) {
+		Py_DECREF(p);
+		PyErr_NoMemory();
+		return NULL;
+	}
+	Py_INCREF(target);
+	p->target = target;
+	Py_INCREF(name);
+	p->name = name;
+	Py_XINCREF(parent);
+	p->parent = (PyObject *) parent;
+	return p;
+}
+
+static void
+_mysql_GilProbeObject_dealloc(
+	_mysql_GilProbeObject *self)
+{
+	if (!self->parent)
+		free(self->site);
+	Py_XDECREF(self->target);
+	Py_XDECREF(self->name);
+	Py_XDECREF(self->owner);
+	Py_XDECREF(self->key);
+	Py_XDECREF(self->parent);
+	MyFree(self);
+}
+
+static PyObject *
+_mysql_GilProbeObject_repr(
+	_mysql_GilProbeObject *self)
+{
+	return PyString_FromFormat("<_mysql.gil_probe for %s>",
+				   PyString_AsString(self->name));
+}
+
+/* Binds the replaced method to obj, in a probe for just this call. */
+static PyObject *
+_mysql_GilProbeObject_descr_get(
+	_mysql_GilProbeObject *self,
+	PyObject *obj,
+	PyObject *type)
+{
+	descrgetfunc get = self->target->ob_type->tp_descr_get;
+	PyObject *bound;
+	_mysql_GilProbeObject *p;
+
+	if (!get) {
+		Py_INCREF(self);
+		return (PyObject *) self;
+	}
+	if (!(bound = get(self->target, obj, type)))
+		return NULL;
+	if (!obj)
+		return bound;
+	p = _mysql_GilProbe_New(bound, self->name, self);
+	Py_DECREF(bound);
+	return (PyObject *) p;
+}
+
+static PyObject *
+_mysql_GilProbeObject_call(
+	_mysql_GilProbeObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	_mysql_GilTimer timer = {0, 0}, *outer = _mysql_gil_current();
+	_mysql_GilSite *site = self->site;
+	unsigned PY_LONG_LONG start, elapsed, held;
+	PyObject *r;
+
+	_mysql_gil_set_current(&timer);
+	start = _mysql_clock_ns();
+	r = PyObject_Call(self->target, args, kwargs);
+	elapsed = _mysql_clock_ns() - start;
+	_mysql_gil_set_current(outer);
+	if (outer) {
+		outer->released += timer.released;
+		outer->waited += timer.waited;
+	}
+	held = timer.released + timer.waited;
+	held = elapsed > held ? elapsed - held : 0;
+	site->calls++;
+	site->held_ns += held;
+	site->released_ns += timer.released;
+	site->wait_ns += timer.waited;
+	_mysql_Histogram_record(&(site->held), held);
+	_mysql_Histogram_record(&(site->wait), timer.waited);
+	return r;
+}
+
+/* Replaces the function or method descriptor key in owner's dict with
+   a probe named name, reusing the probe from an earlier gil_profile()
+   so that its counts carry on. */
+static int
+_mysql_gil_install(
+	PyObject *owner,
+	PyObject *dict,
+	PyObject *key,
+	const char *prefix)
+{
+	PyObject *target, *name;
+	_mysql_GilProbeObject *p;
+	Py_ssize_t i, n = PyList_GET_SIZE(_mysql_gil_probes);
+
+	if (!(target = PyDict_GetItem(dict, key)) ||
+	    target->ob_type == &_mysql_GilProbeObject_Type)
+		return 0;
+	for (i=0; i<n; i++) {
+		p = (_mysql_GilProbeObject *)
+			PyList_GET_ITEM(_mysql_gil_probes, i);
+		if (p->owner == owner &&
+		    PyObject_RichCompareBool(p->key, key, Py_EQ) == 1 &&
+		    p->target == target)
+			return PyDict_SetItem(dict, key, (PyObject *) p);
+	}
+	if (!(name = PyString_FromFormat("%s.%s", prefix,
+					 PyString_AsString(key))))
+		return -1;
+	p = _mysql_GilProbe_New(target, name, NULL);
+	Py_DECREF(name);
+	if (!p)
+		return -1;
+	Py_INCREF(owner);
+	p->owner = owner;
+	Py_INCREF(key);
+	p->key = key;
+	if (PyList_Append(_mysql_gil_probes, (PyObject *) p) ||
+	    PyDict_SetItem(dict, key, (PyObject *) p)) {
+		Py_DECREF(p);
+		return -1;
+	}
+	Py_DECREF(p);
+	return 0;
+}
+
+static int
+_mysql_gil_install_type(
+	PyTypeObject *type,
+	const char *prefix)
+{
+	PyMethodDef *m;
+
+	for (m = type->tp_methods; m && m->ml_name; m++) {
+		PyObject *key = PyString_FromString(m->ml_name);
+		int err = !key || _mysql_gil_install((PyObject *) type,
+						     type->tp_dict, key,
+						     prefix);
+		Py_XDECREF(key);
+		if (err) return -1;
+	}
+	PyType_Modified(type);
+	return 0;
+}
+
+static int
+_mysql_gil_install_all(void)
+{
+	PyObject *module, *dict, *key, *value, *keys;
+	Py_ssize_t i;
+	int err = 0;
+
+	if (!_mysql_gil_probes && !(_mysql_gil_probes = PyList_New(0)))
+		return -1;
+	if (_mysql_gil_install_type(&_mysql_ConnectionObject_Type,
+				    "connection") ||
+	    _mysql_gil_install_type(&_mysql_ResultObject_Type, "result"))
+		return -1;
+#ifdef HAVE_MYSQL_STMT
+	if (_mysql_gil_install_type(&_mysql_BlobObject_Type, "blob"))
+		return -1;
+#endif
+	if (!(module = PyImport_AddModule("_mysql")) ||
+	    !(dict = PyModule_GetDict(module)) ||
+	    !(keys = PyDict_Keys(dict)))
+		return -1;
+	for (i=0; !err && i<PyList_GET_SIZE(keys); i++) {
+		key = PyList_GET_ITEM(keys, i);
+		value = PyDict_GetItem(dict, key);
+		if (!value || !PyCFunction_Check(value) ||
+		    ((PyCFunctionObject *) value)->m_ml->ml_meth ==
+		    (PyCFunction) _mysql_gil_profile ||
+		    ((PyCFunctionObject *) value)->m_ml->ml_meth ==
+		    (PyCFunction) _mysql_gil_stats)
+			continue;
+		err = _mysql_gil_install(dict, dict, key, "_mysql");
+	}
+	Py_DECREF(keys);
+	return err ? -1 : 0;
+}
+
+/* Puts back what every installed probe replaced, if it is still in
+   place. */
+static int
+_mysql_gil_uninstall_all(void)
+{
+	Py_ssize_t i;
+
+	if (!_mysql_gil_probes)
+		return 0;
+	for (i=0; i<PyList_GET_SIZE(_mysql_gil_probes); i++) {
+		_mysql_GilProbeObject *p = (_mysql_GilProbeObject *)
+			PyList_GET_ITEM(_mysql_gil_probes, i);
+		PyObject *dict = PyType_Check(p->owner) ?
+			((PyTypeObject *) p->owner)->tp_dict : p->owner;
+		if (PyDict_GetItem(dict, p->key) != (PyObject *) p)
+			continue;
+		if (PyDict_SetItem(dict, p->key, p->target))
+			return -1;
+		if (PyType_Check(p->owner))
+			PyType_Modified((PyTypeObject *) p->owner);
+	}
+	return 0;
+}
+
+char _mysql_gil_profile__doc__[] =
+"gil_profile(flag) -- Starts (if flag is true) or stops profiling how\n\
+long each method of connection, result and blob objects, and each\n\
+function of this module, holds the GIL, and returns the previous\n\
+setting. While profiling, calls are slower and the methods are\n\
+replaced by probes; functions imported from _mysql beforehand (as in\n\
+from _mysql import escape) are not profiled. See gil_stats().\n\
+";
+
+PyObject *
+_mysql_gil_profile(
+	PyObject *self,
+	PyObject *args)
+{
+	int flag, previous = _mysql_gil_enabled, err;
+
+	if (!PyArg_ParseTuple(args, "i:gil_profile", &flag))
+		return NULL;
+	flag = flag != 0;
+	if (flag == previous)
+		return PyBool_FromLong(previous);
+	if (flag && _mysql_gil_key == -1 &&
+	    (_mysql_gil_key = PyThread_create_key()) == -1)
+		return PyErr_NoMemory();
+	err = flag ? _mysql_gil_install_all() : _mysql_gil_uninstall_all();
+	if (err) {
+		_mysql_gil_uninstall_all();
+		_mysql_gil_enabled = 0;
+		return NULL;
+	}
+	_mysql_gil_enabled = flag;
+	return PyBool_FromLong(previous);
+}
+
+char _mysql_gil_stats__doc__[] =
+"gil_stats(reset=False) -- Returns a dict mapping the name of each\n\
+entry point called while gil_profile() was on, as in\n\
+'result.fetch_row', to a dict of:\n\
+\n\
+calls\n\
+  the number of calls\n\
+\n\
+held_ns, released_ns, wait_ns\n\
+  nanoseconds spent holding the GIL, with it released around client\n\
+  library calls, and waiting to get it back afterwards\n\
+\n\
+held, wait\n\
+  _mysql.histogram of the GIL held and waited for per call\n\
+\n\
+Entry points that hold the GIL long per call are the ones to batch\n\
+or to make yield. If reset is true, the counts are zeroed afterwards.\n\
+";
+
+PyObject *
+_mysql_gil_stats(
+	PyObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"reset", NULL};
+	int reset = 0;
+	Py_ssize_t i, n;
+	PyObject *r;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i:gil_stats", kwlist,
+					 &reset))
+		return NULL;
+	if (!(r = PyDict_New()))
+		return NULL;
+	n = _mysql_gil_probes ? PyList_GET_SIZE(_mysql_gil_probes) : 0;
+	for (i=0; i<n; i++) {
+		_mysql_GilProbeObject *p = (_mysql_GilProbeObject *)
+			PyList_GET_ITEM(_mysql_gil_probes, i);
+		_mysql_GilSite *s = p->site;
+		PyObject *v;
+		int err;
+		if (!s->calls)
+			continue;
+		v = Py_BuildValue("{s:K,s:K,s:K,s:K,s:N,s:N}",
+				  "calls", s->calls,
+				  "held_ns", s->held_ns,
+				  "released_ns", s->released_ns,
+				  "wait_ns", s->wait_ns,
+				  "held", _mysql_HistogramObject_New(&(s->held)),
+				  "wait", _mysql_HistogramObject_New(&(s->wait)));
+		err = !v || PyDict_SetItem(r, p->name, v);
+		Py_XDECREF(v);
+		if (err) {
+			Py_DECREF(r);
+			return NULL;
+		}
+	}
+	if (reset)
+		for (i=0; i<n; i++)
+			memset(((_mysql_GilProbeObject *)
+				PyList_GET_ITEM(_mysql_gil_probes, i))->site,
+			       0, sizeof(_mysql_GilSite));
+	return r;
+}
+
+PyTypeObject _mysql_GilProbeObject_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,
+	"_mysql.gil_probe",
+	sizeof(_mysql_GilProbeObject),
+	0,
+	(destructor)_mysql_GilProbeObject_dealloc, /* tp_dealloc */
+	0, /*tp_print*/
+	0, /* tp_getattr */
+	0, /* tp_setattr */
+	0, /*tp_compare*/
+	(reprfunc)_mysql_GilProbeObject_repr, /* tp_repr */
+
+	/* Method suites for standard classes */
+
+	0, /* (PyNumberMethods *) tp_as_number */
+	0, /* (PySequenceMethods *) tp_as_sequence */
+	0, /* (PyMappingMethods *) tp_as_mapping */
+
+	/* More standard operations (here for binary compatibility) */
+
+	0, /* (hashfunc) tp_hash */
+	(ternaryfunc)_mysql_GilProbeObject_call, /* (ternaryfunc) tp_call */
+	0, /* (reprfunc) tp_str */
+	0, /* (getattrofunc) tp_getattro */
+	0, /* (setattrofunc) tp_setattro */
+
+	/* Functions to access object as input/output buffer */
+	0, /* (PyBufferProcs *) tp_as_buffer */
+
+	/* Flags to define presence of optional/expanded features */
+	Py_TPFLAGS_DEFAULT, /* (long) tp_flags */
+
+	"A _mysql entry point replaced while gil_profile() is on.", /* tp_doc */
+	/* call function for all accessible objects */
+	0, /* tp_traverse */
+	/* delete references to contained objects */
+	0, /* tp_clear */
+
+	/* rich comparisons */
+	0, /* (richcmpfunc) tp_richcompare */
+
+	/* weak reference enabler */
+	0, /* (long) tp_weaklistoffset */
+
+	/* Iterators */
+	0, /* (getiterfunc) tp_iter */
+	0, /* (iternextfunc) tp_iternext */
+
+	/* Attribute descriptor and subclassing stuff */
+	0, /* (struct PyMethodDef *) tp_methods */
+	0, /* (struct PyMemberDef *) tp_members */
+	0, /* (struct getsetlist *) tp_getset; */
+	0, /* (struct _typeobject *) tp_base; */
+	0, /* (PyObject *) tp_dict */
+	(descrgetfunc)_mysql_GilProbeObject_descr_get, /* tp_descr_get */
+	0, /* (descrsetfunc) tp_descr_set */
+	0, /* (long) tp_dictoffset */
+	0, /* tp_init */
+	NULL, /* tp_alloc */
+	NULL, /* tp_new */
+	NULL, /* tp_free Low-level free-memory routine */
+	0, /* (PyObject *) tp_bases */
+	0, /* (PyObject *) tp_mro method resolution order */
+	0, /* (PyObject *) tp_defined */
+};
@@ -0,0 +1,404 @@
+/* -*- mode: C; indent-tabs-mode: t; c-basic-offset: 8; -*- */
+
+#include "mysqlmod.h"
+
+/* Buckets are exact below 2 * HISTOGRAM_SUB microseconds; above that
+   every power of two is split into HISTOGRAM_SUB equal buckets, which
+   bounds the relative error of any value by 1 / HISTOGRAM_SUB. */
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+
+_mysql_Histogram _mysql_latency_query;
+_mysql_Histogram _mysql_latency_result;
+int _mysql_latency_aggregate = 0;
+
+static int
+_mysql_Histogram_index(
+	unsigned PY_LONG_LONG v)
+{
+	int msb = 0, shift;
+
+	if (v < 2 * HISTOGRAM_SUB)
+		return (int) v;
+	if (v >= (unsigned PY_LONG_LONG) 1 << HISTOGRAM_MAX_BITS)
+		v = ((unsigned PY_LONG_LONG) 1 << HISTOGRAM_MAX_BITS) - 1;
+	while (v >> (msb + 1))
+		msb++;
+	shift = msb - HISTOGRAM_SUB_BITS;
+	return (shift + 1) * HISTOGRAM_SUB + (int) (v >> shift) - HISTOGRAM_SUB;
+}
+
+/* Smallest value, in microseconds, that falls into bucket i; the
+   bucket ends where bucket i + 1 starts. */
+static unsigned PY_LONG_LONG
+_mysql_Histogram_lower(
+	int i)
+{
+	int shift;
+
+	if (i < 2 * HISTOGRAM_SUB)
+		return i;
+	shift = i / HISTOGRAM_SUB - 1;
+	return (unsigned PY_LONG_LONG) (i % HISTOGRAM_SUB + HISTOGRAM_SUB)
+		<< shift;
+}
+
+void
+_mysql_Histogram_record(
+	_mysql_Histogram *h,
+	unsigned PY_LONG_LONG ns)
+{
+	unsigned PY_LONG_LONG us = (ns + 500) / 1000;
+
+	h->counts[_mysql_Histogram_index(us)]++;
+	if (!h->count || us < h->min)
+		h->min = us;
+	if (us > h->max)
+		h->max = us;
+	h->count++;
+	h->sum += us;
+}
+
+static void
+_mysql_Histogram_merge(
+	_mysql_Histogram *h,
+	const _mysql_Histogram *other)
+{
+	int i;
+
+	if (!other->count)
+		return;
+	for (i=0; i<HISTOGRAM_BUCKETS; i++)
+		h->counts[i] += other->counts[i];
+	if (!h->count || other->min < h->min)
+		h->min = other->min;
+	if (other->max > h->max)
+		h->max = other->max;
+	h->count += other->count;
+	h->sum += other->sum;
+}
+
+/* The value at or below which percent of the samples fall: the top of
+   the bucket holding that sample, capped at the largest sample. */
+static unsigned PY_LONG_LONG
+_mysql_Histogram_percentile(
+	const _mysql_Histogram *h,
+	double percent)
+{
+	unsigned PY_LONG_LONG rank, seen = 0, top;
+	int i;
+
+	if (!h->count)
+		return 0;
+	if (percent <= 0)
+		return h->min;
+	rank = (unsigned PY_LONG_LONG) (percent / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i=0; i<HISTOGRAM_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen >= rank)
+			break;
+	}
+	if (i >= HISTOGRAM_BUCKETS - 1)
+		return h->max;
+	top = _mysql_Histogram_lower(i + 1) - 1;
+	return top < h->max ? top : h->max;
+}
+
+/* Records the time one statement took to execute, for the connection
+   and, when enabled, module-wide. Needs the GIL. */
+void
+_mysql_record_query_latency(
+	_mysql_ConnectionObject *c,
+	unsigned PY_LONG_LONG ns)
+{
+	_mysql_Histogram_record(&(c->latency_query), ns);
+	if (_mysql_latency_aggregate)
+		_mysql_Histogram_record(&_mysql_latency_query, ns);
+}
+
+/* Likewise for the time taken to receive one whole result set. */
+void
+_mysql_record_result_latency(
+	_mysql_ConnectionObject *c,
+	unsigned PY_LONG_LONG ns)
+{
+	_mysql_Histogram_record(&(c->latency_result), ns);
+	if (_mysql_latency_aggregate)
+		_mysql_Histogram_record(&_mysql_latency_result, ns);
+}
+
+PyObject *
+_mysql_HistogramObject_New(
+	const _mysql_Histogram *h)
+{
+	_mysql_HistogramObject *r;
+
+	if (!(r = MyAlloc(_mysql_HistogramObject, _mysql_HistogramObject_Type)))
+		return NULL;
+	if (h)
+		memcpy(&(r->h), h, sizeof(*h));
+	return (PyObject *) r;
+}
+
+static char _mysql_HistogramObject_record__doc__[] =
+"record(microseconds) -- Adds one sample.\n\
+";
+
+static PyObject *
+_mysql_HistogramObject_record(
+	_mysql_HistogramObject *self,
+	PyObject *args)
+{
+	unsigned PY_LONG_LONG us;
+
+	if (!PyArg_ParseTuple(args, "K:record", &us)) return NULL;
+	_mysql_Histogram_record(&(self->h), us * 1000);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static char _mysql_HistogramObject_merge__doc__[] =
+"merge(other) -- Adds the samples of the histogram other to this one.\n\
+All histograms share the same buckets, so nothing is lost.\n\
+";
+
+static PyObject *
+_mysql_HistogramObject_merge(
+	_mysql_HistogramObject *self,
+	PyObject *args)
+{
+	_mysql_HistogramObject *other;
+
+	if (!PyArg_ParseTuple(args, "O!:merge", &_mysql_HistogramObject_Type,
+			      &other))
+		return NULL;
+	_mysql_Histogram_merge(&(self->h), &(other->h));
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static char _mysql_HistogramObject_percentile__doc__[] =
+"percentile(p) -- Returns the number of microseconds at or below which\n\
+p percent of the samples fall, to within the bucket precision, or 0\n\
+if there are none.\n\
+";
+
+static PyObject *
+_mysql_HistogramObject_percentile(
+	_mysql_HistogramObject *self,
+	PyObject *args)
+{
+	double p;
+
+	if (!PyArg_ParseTuple(args, "d:percentile", &p)) return NULL;
+	return PyLong_FromUnsignedLongLong(
+		_mysql_Histogram_percentile(&(self->h), p));
+}
+
+static char _mysql_HistogramObject_snapshot__doc__[] =
+"snapshot() -- Returns a dict of count, sum, min, max and mean (all\n\
+times in microseconds), percentiles (a dict mapping 50, 90, 99, 99.9\n\
+and 99.99 to values) and buckets, a list of (lower, upper, count) for\n\
+every non-empty bucket of samples lower <= value < upper.\n\
+";
+
+static PyObject *
+_mysql_HistogramObject_snapshot(
+	_mysql_HistogramObject *self,
+	PyObject *unused)
+{
+	static const double percents[] = {50, 90, 99, 99.9, 99.99};
+	_mysql_Histogram *h = &(self->h);
+	PyObject *percentiles = NULL, *buckets = NULL;
+	unsigned int i;
+
+	if (!(percentiles = PyDict_New())) goto error;
+	for (i=0; i<sizeof(percents)/sizeof(percents[0]); i++) {
+		PyObject *k, *v;
+		int err;
+		k = PyFloat_FromDouble(percents[i]);
+		v = PyLong_FromUnsignedLongLong(
+			_mysql_Histogram_percentile(h, percents[i]));
+		err = !k || !v || PyDict_SetItem(percentiles, k, v);
+		Py_XDECREF(k);
+		Py_XDECREF(v);
+		if (err) goto error;
+	}
+	if (!(buckets = PyList_New(0))) goto error;
+	for (i=0; i<HISTOGRAM_BUCKETS; i++) {
+		PyObject *t;
+		if (!h->counts[i])
+			continue;
+		t = Py_BuildValue("(KKK)", _mysql_Histogram_lower(i),
+				  _mysql_Histogram_lower(i + 1), h->counts[i]);
+		if (!t || PyList_Append(buckets, t)) {
+			Py_XDECREF(t);
+			goto error;
+		}
+		Py_DECREF(t);
+	}
+	return Py_BuildValue("{s:K,s:K,s:K,s:K,s:d,s:N,s:N}",
+			     "count", h->count,
+			     "sum", h->sum,
+			     "min", h->min,
+			     "max", h->max,
+			     "mean", h->count ?
+			     (double) h->sum / h->count : 0.0,
+			     "percentiles", percentiles,
+			     "buckets", buckets);
+  error:
+	Py_XDECREF(percentiles);
+	Py_XDECREF(buckets);
+	return NULL;
+}
+
+static char _mysql_HistogramObject_reset__doc__[] =
+"reset() -- Discards all samples.\n\
+";
+
+static PyObject *
+_mysql_HistogramObject_reset(
+	_mysql_HistogramObject *self,
+	PyObject *unused)
+{
+	memset(&(self->h), 0, sizeof(self->h));
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static void
+_mysql_HistogramObject_dealloc(
+	_mysql_HistogramObject *self)
+{
+	MyFree(self);
+}
+
+static PyObject *
+_mysql_HistogramObject_repr(
+	_mysql_HistogramObject *self)
+{
+	char buf[300];
+	sprintf(buf, "<_mysql.histogram of %lu samples at %lx>",
+		(unsigned long) self->h.count, (long)self);
+	return PyString_FromString(buf);
+}
+
+static PyMethodDef _mysql_HistogramObject_methods[] = {
+	{
+		"record",
+		(PyCFunction)_mysql_HistogramObject_record,
+		METH_VARARGS,
+		_mysql_HistogramObject_record__doc__
+	},
+	{
+		"merge",
+		(PyCFunction)_mysql_HistogramObject_merge,
+		METH_VARARGS,
+		_mysql_HistogramObject_merge__doc__
+	},
+	{
+		"percentile",
+		(PyCFunction)_mysql_HistogramObject_percentile,
+		METH_VARARGS,
+		_mysql_HistogramObject_percentile__doc__
+	},
+	{
+		"snapshot",
+		(PyCFunction)_mysql_HistogramObject_snapshot,
+		METH_NOARGS,
+		_mysql_HistogramObject_snapshot__doc__
+	},
+	{
+		"reset",
+		(PyCFunction)_mysql_HistogramObject_reset,
+		METH_NOARGS,
+		_mysql_HistogramObject_reset__doc__
+	},
+	{NULL,              NULL} /* sentinel */
+};
+
+static struct PyMemberDef _mysql_HistogramObject_memberlist[] = {
+	{
+		"count",
+		T_ULONGLONG,
+		offsetof(_mysql_HistogramObject, h.count),
+		RO,
+		"Number of samples"
+	},
+	{NULL} /* Sentinel */
+};
+
+static char _mysql_HistogramObject__doc__[] =
+"A log-bucketed latency histogram, in microseconds. Below 32 every\n\
+value has its own bucket; above, each power of two is split into 16,\n\
+so values are kept to within about 6%. histogram() makes an empty one\n\
+to merge others into.\n\
+";
+
+PyTypeObject _mysql_HistogramObject_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,
+	"_mysql.histogram",
+	sizeof(_mysql_HistogramObject),
+	0,
+	(destructor)_mysql_HistogramObject_dealloc, /* tp_dealloc */
+	0, /*tp_print*/
+	0, /* tp_getattr */
+	0, /* tp_setattr */
+	0, /*tp_compare*/
+	(reprfunc)_mysql_HistogramObject_repr, /* tp_repr */
+
+	/* Method suites for standard classes */
+
+	0, /* (PyNumberMethods *) tp_as_number */
+	0, /* (PySequenceMethods *) tp_as_sequence */
+	0, /* (PyMappingMethods *) tp_as_mapping */
+
+	/* More standard operations (here for binary compatibility) */
+
+	0, /* (hashfunc) tp_hash */
+	0, /* (ternaryfunc) tp_call */
+	0, /* (reprfunc) tp_str */
+	0, /* (getattrofunc) tp_getattro */
+	0, /* (setattrofunc) tp_setattro */
+
+	/* Functions to access object as input/output buffer */
+	0, /* (PyBufferProcs *) tp_as_buffer */
+
+	/* Flags to define presence of optional/expanded features */
+	Py_TPFLAGS_DEFAULT, /* (long) tp_flags */
+
+	_mysql_HistogramObject__doc__, /* (char *) tp_doc Documentation string */
+	/* call function for all accessible objects */
+	0, /* tp_traverse */
+	/* delete references to contained objects */
+	0, /* tp_clear */
+
+	/* rich comparisons */
+	0, /* (richcmpfunc) tp_richcompare */
+
+	/* weak reference enabler */
+	0, /* (long) tp_weaklistoffset */
+
+	/* Iterators */
+	0, /* (getiterfunc) tp_iter */
+	0, /* (iternextfunc) tp_iternext */
+
+	/* Attribute descriptor and subclassing stuff */
+	(struct PyMethodDef *)_mysql_HistogramObject_methods, /* tp_methods */
+	(struct PyMemberDef *)_mysql_HistogramObject_memberlist, /*tp_members */
+	0, /* (struct getsetlist *) tp_getset; */
+	0, /* (struct _typeobject *) tp_base; */
+	0, /* (PyObject *) tp_dict */
+	0, /* (descrgetfunc) tp_descr_get */
+	0, /* (descrsetfunc) tp_descr_set */
+	0, /* (long) tp_dictoffset */
+	0, /* tp_init */
+	NULL, /* tp_alloc */
+	NULL, /* tp_new */
+	NULL, /* tp_free Low-level free-memory routine */
+	0, /* (PyObject *) tp_bases */
+	0, /* (PyObject *) tp_mro method resolution order */
+	0, /* (PyObject *) tp_defined */
+};
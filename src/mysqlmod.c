@@ -2,6 +2,10 @@
 
 #include "mysqlmod.h"
 
+#ifndef MS_WIN32
+#include <time.h>
+#endif
+
 PyObject *_mysql_MySQLError;
  PyObject *_mysql_Warning;
  PyObject *_mysql_Error;
@@ -14,14 +18,20 @@ PyObject *_mysql_MySQLError;
   PyObject *_mysql_ProgrammingError;
   PyObject *_mysql_NotSupportedError;
 PyObject *_mysql_error_map;
+PyObject *_mysql_trace_hook = NULL;
 
 int _mysql_server_init_done = 0;
+int _mysql_alloc_profile = 0;
+_mysql_AllocStats _mysql_alloc_total;
 
-PyObject *
-_mysql_Exception(_mysql_ConnectionObject *c)
+/* Raises the exception class error_map gives for merr, with the
+   arguments (merr, message). */
+static PyObject *
+_mysql_RaiseError(
+	unsigned int merr,
+	const char *message)
 {
 	PyObject *t, *e;
-	int merr;
 
 	if (!(t = PyTuple_New(2))) return NULL;
 	if (!_mysql_server_init_done) {
@@ -32,7 +42,6 @@ _mysql_Exception(_mysql_ConnectionObject *c)
 		Py_DECREF(t);
 		return NULL;
 	}
-	merr = mysql_errno(&(c->connection));
 	if (!merr)
 		e = _mysql_InterfaceError;
 	else if (merr > CR_MAX_ERROR) {
@@ -52,12 +61,378 @@ _mysql_Exception(_mysql_ConnectionObject *c)
 		}
 	}
 	PyTuple_SET_ITEM(t, 0, PyInt_FromLong((long)merr));
-	PyTuple_SET_ITEM(t, 1, PyString_FromString(mysql_error(&(c->connection))));
+	PyTuple_SET_ITEM(t, 1, PyString_FromString(message));
 	PyErr_SetObject(e, t);
 	Py_DECREF(t);
 	return NULL;
 }
 
+/* Adds one to the connection's count of errors with errno merr. Runs
+   before the exception is set, and loses the count rather than fail. */
+static void
+_mysql_count_error(
+	_mysql_ConnectionObject *c,
+	unsigned int merr)
+{
+	PyObject *key, *count;
+	long n = 1;
+
+	if (!merr)
+		return;
+	if (!c->stats.errors && !(c->stats.errors = PyDict_New())) {
+		PyErr_Clear();
+		return;
+	}
+	if (!(key = PyInt_FromLong((long) merr))) {
+		PyErr_Clear();
+		return;
+	}
+	if ((count = PyDict_GetItem(c->stats.errors, key)))
+		n += PyInt_AS_LONG(count);
+	if (!(count = PyInt_FromLong(n)) ||
+	    PyDict_SetItem(c->stats.errors, key, count))
+		PyErr_Clear();
+	Py_XDECREF(count);
+	Py_DECREF(key);
+}
+
+PyObject *
+_mysql_Exception(_mysql_ConnectionObject *c)
+{
+	unsigned int merr;
+
+	if (!_mysql_server_init_done)
+		return _mysql_RaiseError(0, NULL);
+	merr = mysql_errno(&(c->connection));
+	_mysql_count_error(c, merr);
+	return _mysql_RaiseError(merr, mysql_error(&(c->connection)));
+}
+
+#ifdef HAVE_MYSQL_STMT
+PyObject *
+_mysql_StmtException(
+	_mysql_ConnectionObject *c,
+	MYSQL_STMT *stmt)
+{
+	_mysql_count_error(c, mysql_stmt_errno(stmt));
+	return _mysql_RaiseError(mysql_stmt_errno(stmt),
+				 mysql_stmt_error(stmt));
+}
+#endif
+
+/* Calls the trace hook as hook(event, connection, info), where info is
+   the dict built from format and the remaining arguments as by
+   Py_BuildValue(). Call sites test _mysql_trace_hook first, so none of
+   this costs anything without a hook. An exception already set (the
+   one a failed query is about to raise) is kept, and one raised by the
+   hook is reported rather than propagated, so tracing never changes the
+   outcome of the traced call. Needs the GIL. */
+void
+_mysql_trace(
+	const char *event,
+	_mysql_ConnectionObject *c,
+	const char *format,
+	...)
+{
+	PyObject *hook = _mysql_trace_hook, *info, *r = NULL;
+	PyObject *type, *value, *tb;
+	va_list va;
+
+	if (!hook)
+		return;
+	PyErr_Fetch(&type, &value, &tb);
+	Py_INCREF(hook);
+	va_start(va, format);
+	info = Py_VaBuildValue(format, va);
+	va_end(va);
+	if (info)
+		r = PyObject_CallFunction(hook, "sOO", event, c, info);
+	if (!r)
+		PyErr_WriteUnraisable(hook);
+	Py_XDECREF(r);
+	Py_XDECREF(info);
+	Py_DECREF(hook);
+	PyErr_Restore(type, value, tb);
+}
+
+/* A monotonic clock in nanoseconds, for timing client library calls.
+   Needs no GIL. */
+unsigned PY_LONG_LONG
+_mysql_clock_ns(void)
+{
+#ifdef MS_WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+	return (unsigned PY_LONG_LONG) (t.QuadPart / freq.QuadPart) *
+		1000000000 + (unsigned PY_LONG_LONG) (t.QuadPart %
+		freq.QuadPart) * 1000000000 / freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned PY_LONG_LONG) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+PyObject *
+_mysql_FreeList_Alloc(
+	_mysql_FreeList *fl,
+	PyTypeObject *type,
+	Py_ssize_t nitems)
+{
+	PyObject *ob;
+
+	if (type != fl->type || !fl->numfree) {
+		fl->misses++;
+		return PyType_GenericAlloc(type, nitems);
+	}
+	fl->hits++;
+	ob = fl->items[--fl->numfree];
+	/* same initialization PyType_GenericAlloc() would have done */
+	memset(ob, '\0', type->tp_basicsize);
+	(void) PyObject_INIT(ob, type);
+	PyObject_GC_Track(ob);
+	return ob;
+}
+
+void
+_mysql_FreeList_Free(
+	_mysql_FreeList *fl,
+	void *ob)
+{
+	if (((PyObject *)ob)->ob_type == fl->type && fl->numfree < fl->size)
+		fl->items[fl->numfree++] = (PyObject *)ob;
+	else
+		PyObject_GC_Del(ob);
+}
+
+static char _mysql_free_list_stats__doc__[] =
+"Returns a dict describing the free lists used to recycle result and\n\
+field objects. For each of 'result' and 'field' there is a dict with\n\
+hits (allocations served from the free list), misses (allocations\n\
+that went to the allocator), free (objects currently on the list)\n\
+and size (maximum length of the list).\n\
+";
+
+static PyObject *
+_mysql_free_list_stats(
+	PyObject *self,
+	PyObject *unused)
+{
+	return Py_BuildValue("{s:{s:k,s:k,s:i,s:i},s:{s:k,s:k,s:i,s:i}}",
+			     "result",
+			     "hits", _mysql_ResultObject_free_list.hits,
+			     "misses", _mysql_ResultObject_free_list.misses,
+			     "free", _mysql_ResultObject_free_list.numfree,
+			     "size", _mysql_ResultObject_free_list.size,
+			     "field",
+			     "hits", _mysql_FieldObject_free_list.hits,
+			     "misses", _mysql_FieldObject_free_list.misses,
+			     "free", _mysql_FieldObject_free_list.numfree,
+			     "size", _mysql_FieldObject_free_list.size);
+}
+
+static char _mysql_set_trace_hook__doc__[] =
+"set_trace_hook(hook) -- Installs hook, a callable, to be called as\n\
+hook(event, connection, info) around the work of every connection, or\n\
+removes it if hook is None. Returns the previous hook or None. info\n\
+is a dict; every event has thread_id, and the events are:\n\
+\n\
+query\n\
+  before a statement is sent; sql is the query as passed to query()\n\
+  or stmt_execute(), or the joined parts of query_parts()\n\
+\n\
+query_done\n\
+  after it has executed; sql, ns (nanoseconds taken), errno (0 on\n\
+  success) and bytes (length of the query)\n\
+\n\
+result\n\
+  after store_result() or use_result() returns a result set; ns, use\n\
+  (true for use_result()), fields, and rows (None for use_result(),\n\
+  whose size is not known yet)\n\
+\n\
+fetch_done\n\
+  once the last row of a result set has been read; ns (total time\n\
+  spent receiving the result), rows and bytes (of row data)\n\
+\n\
+The hook runs with the connection busy and must not use it. Errors it\n\
+raises are printed and otherwise ignored. Without a hook, the cost is\n\
+one pointer test per event.\n\
+";
+
+static PyObject *
+_mysql_set_trace_hook(
+	PyObject *self,
+	PyObject *args)
+{
+	PyObject *hook, *previous;
+
+	if (!PyArg_ParseTuple(args, "O:set_trace_hook", &hook))
+		return NULL;
+	if (hook == Py_None)
+		hook = NULL;
+	else if (!PyCallable_Check(hook)) {
+		PyErr_SetString(PyExc_TypeError, "hook must be callable");
+		return NULL;
+	}
+	previous = _mysql_trace_hook;
+	Py_XINCREF(hook);
+	_mysql_trace_hook = hook;
+	if (!previous) {
+		Py_INCREF(Py_None);
+		previous = Py_None;
+	}
+	return previous;
+}
+
+static char _mysql_aggregate_latency__doc__[] =
+"aggregate_latency(flag) -- Enables (if flag is true) or disables\n\
+recording the query and result latencies of every connection in the\n\
+module-wide histograms returned by latency(), and returns the previous\n\
+setting. Off by default.\n\
+";
+
+static PyObject *
+_mysql_aggregate_latency(
+	PyObject *self,
+	PyObject *args)
+{
+	int flag, previous = _mysql_latency_aggregate;
+
+	if (!PyArg_ParseTuple(args, "i:aggregate_latency", &flag))
+		return NULL;
+	_mysql_latency_aggregate = flag != 0;
+	return PyBool_FromLong(previous);
+}
+
+static char _mysql_latency__doc__[] =
+"latency(reset=False) -- Returns the module-wide latencies, in the\n\
+form of connection.latency(), collected while aggregate_latency() is\n\
+enabled. If reset is true, the histograms are emptied afterwards.\n\
+";
+
+static PyObject *
+_mysql_latency(
+	PyObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"reset", NULL};
+	int reset = 0;
+	PyObject *r;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i:latency", kwlist,
+					 &reset))
+		return NULL;
+	r = Py_BuildValue("{s:N,s:N}",
+			  "query",
+			  _mysql_HistogramObject_New(&_mysql_latency_query),
+			  "result",
+			  _mysql_HistogramObject_New(&_mysql_latency_result));
+	if (r && reset) {
+		memset(&_mysql_latency_query, 0, sizeof(_mysql_latency_query));
+		memset(&_mysql_latency_result, 0,
+		       sizeof(_mysql_latency_result));
+	}
+	return r;
+}
+
+/* Counts o, just built for a row, in a and in the module totals,
+   unless it is shared: None, and the cached empty and one-character
+   strings, are already referenced elsewhere. The size is what
+   sys.getsizeof() reports. */
+void
+_mysql_AllocStats_count(
+	_mysql_AllocStats *a,
+	PyObject *o)
+{
+	Py_ssize_t size;
+
+	if (Py_REFCNT(o) != 1)
+		return;
+	size = o->ob_type->tp_basicsize;
+	if (o->ob_type->tp_itemsize)
+		size += Py_SIZE(o) * o->ob_type->tp_itemsize;
+	if (PyList_CheckExact(o))
+		size += ((PyListObject *) o)->allocated * sizeof(PyObject *);
+	if (PyObject_IS_GC(o))
+		size += sizeof(PyGC_Head);
+	a->objects++;
+	a->bytes += size;
+	_mysql_alloc_total.objects++;
+	_mysql_alloc_total.bytes += size;
+}
+
+PyObject *
+_mysql_AllocStats_New(
+	const _mysql_AllocStats *a)
+{
+	double rows = a->rows ? (double) a->rows : 1.0;
+
+	return Py_BuildValue("{s:K,s:K,s:K,s:d,s:d}",
+			     "rows", a->rows,
+			     "objects", a->objects,
+			     "bytes", a->bytes,
+			     "objects_per_row", a->objects / rows,
+			     "bytes_per_row", a->bytes / rows);
+}
+
+static char _mysql_alloc_profile__doc__[] =
+"alloc_profile([flag]) -- Enables (if flag is true) or disables\n\
+counting the Python objects, and their bytes, allocated for the rows\n\
+fetched from every result, and returns the previous setting; with no\n\
+argument, just returns the setting. The counts are kept by each\n\
+result, see result.alloc_stats(), and module-wide, see alloc_stats().\n\
+Off by default.\n\
+";
+
+static PyObject *
+_mysql_alloc_profile_set(
+	PyObject *self,
+	PyObject *args)
+{
+	PyObject *flag = NULL;
+	int previous = _mysql_alloc_profile, r;
+
+	if (!PyArg_ParseTuple(args, "|O:alloc_profile", &flag))
+		return NULL;
+	if (flag) {
+		if ((r = PyObject_IsTrue(flag)) < 0)
+			return NULL;
+		_mysql_alloc_profile = r;
+	}
+	return PyBool_FromLong(previous);
+}
+
+static char _mysql_alloc_stats__doc__[] =
+"alloc_stats(reset=False) -- Returns the module-wide allocation counts\n\
+collected while alloc_profile() is enabled, in the form of\n\
+result.alloc_stats(). If reset is true, they are zeroed afterwards.\n\
+";
+
+static PyObject *
+_mysql_alloc_stats(
+	PyObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"reset", NULL};
+	int reset = 0;
+	PyObject *r;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i:alloc_stats", kwlist,
+					 &reset))
+		return NULL;
+	r = _mysql_AllocStats_New(&_mysql_alloc_total);
+	if (r && reset)
+		memset(&_mysql_alloc_total, 0, sizeof(_mysql_alloc_total));
+	return r;
+}
+
 static char _mysql_server_init__doc__[] =
 "Initialize embedded server. If this client is not linked against\n\
 the embedded server library, this function does nothing.\n\
@@ -299,6 +674,54 @@ _mysql_methods[] = {
 		_mysql_thread_safe__doc__
 	},
 #endif
+	{
+		"free_list_stats",
+		(PyCFunction)_mysql_free_list_stats,
+		METH_NOARGS,
+		_mysql_free_list_stats__doc__
+	},
+	{
+		"set_trace_hook",
+		(PyCFunction)_mysql_set_trace_hook,
+		METH_VARARGS,
+		_mysql_set_trace_hook__doc__
+	},
+	{
+		"gil_profile",
+		(PyCFunction)_mysql_gil_profile,
+		METH_VARARGS,
+		_mysql_gil_profile__doc__
+	},
+	{
+		"gil_stats",
+		(PyCFunction)_mysql_gil_stats,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_gil_stats__doc__
+	},
+	{
+		"aggregate_latency",
+		(PyCFunction)_mysql_aggregate_latency,
+		METH_VARARGS,
+		_mysql_aggregate_latency__doc__
+	},
+	{
+		"latency",
+		(PyCFunction)_mysql_latency,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_latency__doc__
+	},
+	{
+		"alloc_profile",
+		(PyCFunction)_mysql_alloc_profile_set,
+		METH_VARARGS,
+		_mysql_alloc_profile__doc__
+	},
+	{
+		"alloc_stats",
+		(PyCFunction)_mysql_alloc_stats,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_alloc_stats__doc__
+	},
 	{
 		"server_init",
 		(PyCFunction)_mysql_server_init,
@@ -361,12 +784,56 @@ init_mysql(void)
 	_mysql_ConnectionObject_Type.tp_alloc = PyType_GenericAlloc;
 	_mysql_ConnectionObject_Type.tp_new = PyType_GenericNew;
 	_mysql_ConnectionObject_Type.tp_free = _PyObject_GC_Del;
-	_mysql_ResultObject_Type.tp_alloc = PyType_GenericAlloc;
+	_mysql_ResultObject_Type.tp_alloc = _mysql_ResultObject_alloc;
 	_mysql_ResultObject_Type.tp_new = PyType_GenericNew;
-	_mysql_ResultObject_Type.tp_free = _PyObject_GC_Del;
-	_mysql_FieldObject_Type.tp_alloc = PyType_GenericAlloc;
+	_mysql_ResultObject_Type.tp_free = _mysql_ResultObject_free;
+	_mysql_FieldObject_Type.tp_alloc = _mysql_FieldObject_alloc;
 	_mysql_FieldObject_Type.tp_new = PyType_GenericNew;
-	_mysql_FieldObject_Type.tp_free = _PyObject_GC_Del;
+	_mysql_FieldObject_Type.tp_free = _mysql_FieldObject_free;
+	_mysql_HistogramObject_Type.ob_type = &PyType_Type;
+	_mysql_HistogramObject_Type.tp_alloc = PyType_GenericAlloc;
+	_mysql_HistogramObject_Type.tp_new = PyType_GenericNew;
+	_mysql_HistogramObject_Type.tp_free = PyObject_Del;
+	_mysql_HistogramObject_Type.tp_getattro = PyObject_GenericGetAttr;
+	_mysql_SyntheticResultObject_Type.ob_type = &PyType_Type;
+	_mysql_SyntheticResultObject_Type.tp_alloc = PyType_GenericAlloc;
+	_mysql_SyntheticResultObject_Type.tp_new = PyType_GenericNew;
+	_mysql_SyntheticResultObject_Type.tp_free = PyObject_Del;
+	_mysql_SyntheticResultObject_Type.tp_getattro = PyObject_GenericGetAttr;
+	_mysql_GilProbeObject_Type.ob_type = &PyType_Type;
+	_mysql_GilProbeObject_Type.tp_alloc = PyType_GenericAlloc;
+	_mysql_GilProbeObject_Type.tp_free = PyObject_Del;
+	_mysql_GilProbeObject_Type.tp_getattro = PyObject_GenericGetAttr;
+#ifdef HAVE_MYSQL_STMT
+	_mysql_BlobObject_Type.ob_type = &PyType_Type;
+	_mysql_BlobObject_Type.tp_alloc = PyType_GenericAlloc;
+	_mysql_BlobObject_Type.tp_free = _PyObject_GC_Del;
+	_mysql_BlobObject_Type.tp_getattro = PyObject_GenericGetAttr;
+#endif
+
+	/* Attribute lookup goes through tp_methods/tp_members/tp_getset */
+	_mysql_ConnectionObject_Type.tp_getattro = PyObject_GenericGetAttr;
+	_mysql_ConnectionObject_Type.tp_setattro = PyObject_GenericSetAttr;
+	_mysql_ResultObject_Type.tp_getattro = PyObject_GenericGetAttr;
+	_mysql_ResultObject_Type.tp_setattro = PyObject_GenericSetAttr;
+	_mysql_FieldObject_Type.tp_getattro = PyObject_GenericGetAttr;
+	_mysql_FieldObject_Type.tp_setattro = PyObject_GenericSetAttr;
+	if (PyType_Ready(&_mysql_ConnectionObject_Type) < 0)
+		return;
+	if (PyType_Ready(&_mysql_ResultObject_Type) < 0)
+		return;
+	if (PyType_Ready(&_mysql_FieldObject_Type) < 0)
+		return;
+	if (PyType_Ready(&_mysql_HistogramObject_Type) < 0)
+		return;
+	if (PyType_Ready(&_mysql_SyntheticResultObject_Type) < 0)
+		return;
+	if (PyType_Ready(&_mysql_GilProbeObject_Type) < 0)
+		return;
+#ifdef HAVE_MYSQL_STMT
+	if (PyType_Ready(&_mysql_BlobObject_Type) < 0)
+		return;
+#endif
 
 	if (!(dict = PyModule_GetDict(module)))
 		goto error;
@@ -396,6 +863,20 @@ init_mysql(void)
 			       (PyObject *)&_mysql_FieldObject_Type))
 		goto error;
 	Py_INCREF(&_mysql_FieldObject_Type);
+	if (PyDict_SetItemString(dict, "histogram",
+			       (PyObject *)&_mysql_HistogramObject_Type))
+		goto error;
+	Py_INCREF(&_mysql_HistogramObject_Type);
+	if (PyDict_SetItemString(dict, "_synthetic_result",
+			       (PyObject *)&_mysql_SyntheticResultObject_Type))
+		goto error;
+	Py_INCREF(&_mysql_SyntheticResultObject_Type);
+#ifdef HAVE_MYSQL_STMT
+	if (PyDict_SetItemString(dict, "blob",
+			       (PyObject *)&_mysql_BlobObject_Type))
+		goto error;
+	Py_INCREF(&_mysql_BlobObject_Type);
+#endif
 
 	/* Reach into the exceptions module. */
 	if (!(emod = PyImport_ImportModule("MySQLdb.exceptions")))
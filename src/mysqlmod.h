@@ -22,18 +22,126 @@ typedef int Py_ssize_t;
 #define PY_SSIZE_T_MIN INT_MIN
 #endif
 
+#if MYSQL_VERSION_ID >= 80018 && !defined(MARIADB_BASE_VERSION)
+#define HAVE_MYSQL_OPT_COMPRESSION_ALGORITHMS 1
+#endif
+
+#ifndef MS_WIN32
+#define HAVE_SPILL 1
+#endif
+
+#if MYSQL_VERSION_ID >= 40100
+#define HAVE_MYSQL_STMT 1
+#endif
+
+/* MySQL 8.0 dropped my_bool for the C99 bool in MYSQL_BIND */
+#if MYSQL_VERSION_ID >= 80001 && !defined(MARIADB_BASE_VERSION)
+typedef bool _mysql_bool;
+#else
+typedef my_bool _mysql_bool;
+#endif
+
+/* Counters kept by every connection for connection.stats(). The _ns
+   fields are nanoseconds spent inside mysql_real_query() (and
+   prepared statement execution), mysql_store_result() or
+   mysql_use_result(), and mysql_fetch_row() on use_result() results.
+   errors maps errno to count; it is created on the first error. */
+typedef struct {
+	unsigned PY_LONG_LONG queries;
+	unsigned PY_LONG_LONG rows;
+	unsigned PY_LONG_LONG query_ns;
+	unsigned PY_LONG_LONG result_ns;
+	unsigned PY_LONG_LONG fetch_ns;
+	unsigned PY_LONG_LONG reconnects;
+	PyObject *errors;
+} _mysql_ConnectionStats;
+
+/* Log-bucketed latency histogram in microseconds: values below
+   2 * HISTOGRAM_SUB get a bucket each, and every power of two above is
+   split into HISTOGRAM_SUB buckets, up to 2 ** HISTOGRAM_MAX_BITS
+   (about 19 hours) where everything larger is clamped. */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_MAX_BITS 36
+#define HISTOGRAM_BUCKETS \
+	((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+typedef struct {
+	unsigned PY_LONG_LONG counts[HISTOGRAM_BUCKETS];
+	unsigned PY_LONG_LONG count;
+	unsigned PY_LONG_LONG sum;
+	unsigned PY_LONG_LONG min;
+	unsigned PY_LONG_LONG max;
+} _mysql_Histogram;
+
+typedef struct {
+	PyObject_HEAD
+	_mysql_Histogram h;
+} _mysql_HistogramObject;
+
+extern PyTypeObject _mysql_HistogramObject_Type;
+
 typedef struct {
 	PyObject_HEAD
 	MYSQL connection;
 	int open;
+	unsigned PY_LONG_LONG bytes_sent;
+	unsigned PY_LONG_LONG bytes_received;
+	_mysql_ConnectionStats stats;
+	_mysql_Histogram latency_query;
+	_mysql_Histogram latency_result;
 } _mysql_ConnectionObject;
 
 #define check_connection(c) if (!(c->open)) return _mysql_Exception(c)
 #define result_connection(r) ((_mysql_ConnectionObject *)r->conn)
-#define check_result_connection(r) check_connection(result_connection(r))
+#define check_result_connection(r) \
+	do { \
+		if (!(r)->result) { \
+			PyErr_SetString(_mysql_ProgrammingError, \
+					"result has been cleared"); \
+			return NULL; \
+		} \
+		check_connection(result_connection(r)); \
+	} while (0)
 
 extern PyTypeObject _mysql_ConnectionObject_Type;
 
+/* A result set read with mysql_use_result() and written to an unlinked
+   temporary file, then memory-mapped. Each row is a sequence of cells,
+   each a 4-byte length (SPILL_NULL for NULL) followed by its bytes;
+   index holds the file offset of every row. values and lengths
+   describe the row last returned by _mysql_SpillFile_Next(). */
+typedef struct {
+	char *data;
+	size_t data_size;
+	unsigned PY_LONG_LONG *index;
+	size_t index_size;
+	my_ulonglong rows;
+	my_ulonglong pos;
+	unsigned int nfields;
+	char **values;
+	unsigned long *lengths;
+} _mysql_SpillFile;
+
+#define SPILL_NULL 0xFFFFFFFFUL
+
+/* Python objects, and their bytes as sys.getsizeof() counts them,
+   created for rows by the fetch paths while alloc_profile() is on. */
+typedef struct {
+	unsigned PY_LONG_LONG rows;
+	unsigned PY_LONG_LONG objects;
+	unsigned PY_LONG_LONG bytes;
+} _mysql_AllocStats;
+
+/* Rows, bytes of row data and fetch time gathered by
+   _mysql_ResultObject_raw_row() without the GIL, until
+   _mysql_ResultObject_add_counts() adds them to the result and its
+   connection. */
+typedef struct {
+	unsigned PY_LONG_LONG rows;
+	unsigned PY_LONG_LONG bytes;
+	unsigned PY_LONG_LONG fetch_ns;
+} _mysql_RowCounts;
+
 typedef struct {
 	PyObject_HEAD
 	PyObject *conn;
@@ -41,19 +149,183 @@ typedef struct {
 	int nfields;
 	int use;
 	PyObject *fields;
+	_mysql_SpillFile *spill;
+	/* Nanoseconds spent receiving the result so far, the rows and
+	   bytes of row data read from it, and whether its last row has
+	   been read (1), and reported (2) by
+	   _mysql_ResultObject_finished(). */
+	unsigned PY_LONG_LONG retrieval_ns;
+	unsigned PY_LONG_LONG rows;
+	unsigned PY_LONG_LONG bytes;
+	int exhausted;
+	/* Bytes of buffered rows of a stored result, as memory_usage()
+	   counts them, or STORED_UNKNOWN until it first has. */
+	unsigned PY_LONG_LONG stored;
+	_mysql_AllocStats alloc;
 } _mysql_ResultObject;
 
+#define STORED_UNKNOWN ((unsigned PY_LONG_LONG) -1)
+
 extern PyTypeObject _mysql_ResultObject_Type;
 
 typedef struct {
 	PyObject_HEAD
 	PyObject *result;
-	MYSQL_FIELD field;
+	MYSQL_FIELD *field; /* points into the result's metadata */
 	unsigned int index;
 } _mysql_FieldObject;
 
 extern PyTypeObject _mysql_FieldObject_Type;
 
+#ifdef HAVE_MYSQL_STMT
+/* One BLOB cell of the single row fetched by a prepared statement,
+   read piecewise with mysql_stmt_fetch_column(). The statement, and
+   with it the connection, stays busy until the blob is closed. bind,
+   lengths and nulls belong to the statement's result binding. */
+typedef struct {
+	PyObject_HEAD
+	PyObject *conn;
+	MYSQL_STMT *stmt;
+	MYSQL_BIND *bind;
+	unsigned long *lengths;
+	_mysql_bool *nulls;
+	unsigned int column;
+	unsigned long size;
+	unsigned long pos;
+} _mysql_BlobObject;
+
+extern PyTypeObject _mysql_BlobObject_Type;
+#endif
+
+/* Bounded free list of deallocated objects of exactly one type, reused
+   by tp_alloc instead of going back to the allocator. */
+typedef struct {
+	PyTypeObject *type;
+	PyObject **items;
+	int size;
+	int numfree;
+	unsigned long hits;
+	unsigned long misses;
+} _mysql_FreeList;
+
+extern _mysql_FreeList _mysql_ResultObject_free_list;
+extern _mysql_FreeList _mysql_FieldObject_free_list;
+
+extern PyObject *
+_mysql_FreeList_Alloc(
+	_mysql_FreeList *fl,
+	PyTypeObject *type,
+	Py_ssize_t nitems);
+
+extern void
+_mysql_FreeList_Free(
+	_mysql_FreeList *fl,
+	void *ob);
+
+extern PyObject *
+_mysql_ResultObject_alloc(
+	PyTypeObject *type,
+	Py_ssize_t nitems);
+
+extern void
+_mysql_ResultObject_free(
+	void *ob);
+
+extern PyObject *
+_mysql_FieldObject_alloc(
+	PyTypeObject *type,
+	Py_ssize_t nitems);
+
+extern void
+_mysql_FieldObject_free(
+	void *ob);
+
+extern _mysql_SpillFile *
+_mysql_SpillFile_New(
+	MYSQL *conn,
+	MYSQL_RES *result,
+	const char *dir,
+	unsigned PY_LONG_LONG *bytes);
+
+extern void
+_mysql_SpillFile_Free(
+	_mysql_SpillFile *spill);
+
+extern MYSQL_ROW
+_mysql_SpillFile_Next(
+	_mysql_SpillFile *spill);
+
+extern PyObject *
+_mysql_SpillFile_Fetch(
+	_mysql_SpillFile *spill,
+	_mysql_AllocStats *alloc);
+
+extern PyObject *
+_mysql_escape_bytes(
+	MYSQL *mysql,
+	const char *in,
+	int size,
+	int quote);
+
+extern PyObject *
+_mysql_row_to_tuple(
+	MYSQL_ROW row,
+	unsigned long *lengths,
+	unsigned int n,
+	_mysql_AllocStats *alloc);
+
+extern int _mysql_alloc_profile;
+extern _mysql_AllocStats _mysql_alloc_total;
+
+extern void
+_mysql_AllocStats_count(
+	_mysql_AllocStats *a,
+	PyObject *o);
+
+extern PyObject *
+_mysql_AllocStats_New(
+	const _mysql_AllocStats *a);
+
+extern int
+_mysql_ResultObject_raw_row(
+	_mysql_ResultObject *self,
+	MYSQL_ROW *row,
+	unsigned long **lengths,
+	_mysql_RowCounts *counts);
+
+extern void
+_mysql_ResultObject_add_counts(
+	_mysql_ResultObject *self,
+	const _mysql_RowCounts *counts);
+
+extern void
+_mysql_ResultObject_finished(
+	_mysql_ResultObject *self);
+
+extern char _mysql_ResultObject_copy_to__doc__[];
+
+extern PyObject *
+_mysql_ResultObject_copy_to(
+	_mysql_ResultObject *self,
+	PyObject *args,
+	PyObject *kwargs);
+
+extern char _mysql_ResultObject_write_arrow__doc__[];
+
+extern PyObject *
+_mysql_ResultObject_write_arrow(
+	_mysql_ResultObject *self,
+	PyObject *args,
+	PyObject *kwargs);
+
+extern char _mysql_ResultObject_fetch_into__doc__[];
+
+extern PyObject *
+_mysql_ResultObject_fetch_into(
+	_mysql_ResultObject *self,
+	PyObject *args,
+	PyObject *kwargs);
+
 extern int _mysql_server_init_done;
 #if MYSQL_VERSION_ID >= 40000
 #define check_server_init(x) if (!_mysql_server_init_done) { if (mysql_server_init(0, NULL, NULL)) { _mysql_Exception(NULL); return x; } else { _mysql_server_init_done = 1;} }
@@ -73,10 +345,136 @@ extern PyObject *_mysql_InternalError;
 extern PyObject *_mysql_ProgrammingError;
 extern PyObject *_mysql_NotSupportedError;
 extern PyObject *_mysql_error_map;
+extern PyObject *_mysql_trace_hook;
+
+extern void
+_mysql_trace(
+	const char *event,
+	_mysql_ConnectionObject *c,
+	const char *format,
+	...);
 
 extern PyObject *
 _mysql_Exception(_mysql_ConnectionObject *c);
 
+extern unsigned PY_LONG_LONG
+_mysql_clock_ns(void);
+
+/* Time the GIL was released, and then waited for, during one call of an
+   entry point profiled by gil_profile(). Each thread finds the timer of
+   its innermost profiled call in thread-local storage. */
+typedef struct {
+	unsigned PY_LONG_LONG released;
+	unsigned PY_LONG_LONG waited;
+} _mysql_GilTimer;
+
+/* State of one MYSQL_BEGIN_ALLOW_THREADS section. */
+typedef struct {
+	PyThreadState *save;
+	_mysql_GilTimer *timer;
+	unsigned PY_LONG_LONG mark;
+} _mysql_GilRelease;
+
+extern void
+_mysql_gil_release(_mysql_GilRelease *r);
+
+extern void
+_mysql_gil_acquire(_mysql_GilRelease *r);
+
+/* Py_BEGIN_ALLOW_THREADS and Py_END_ALLOW_THREADS, accounted to the
+   profiled entry point; without profiling they cost a flag test. */
+#define MYSQL_BEGIN_ALLOW_THREADS { \
+	_mysql_GilRelease _gil; \
+	_mysql_gil_release(&_gil);
+#define MYSQL_END_ALLOW_THREADS \
+	_mysql_gil_acquire(&_gil); }
+
+extern PyTypeObject _mysql_GilProbeObject_Type;
+
+extern PyTypeObject _mysql_SyntheticResultObject_Type;
+
+extern char _mysql_gil_profile__doc__[];
+
+extern PyObject *
+_mysql_gil_profile(
+	PyObject *self,
+	PyObject *args);
+
+extern char _mysql_gil_stats__doc__[];
+
+extern PyObject *
+_mysql_gil_stats(
+	PyObject *self,
+	PyObject *args,
+	PyObject *kwargs);
+
+extern int
+_mysql_ConnectionObject_real_query(
+	_mysql_ConnectionObject *self,
+	const char *query,
+	unsigned long len,
+	unsigned PY_LONG_LONG *elapsed,
+	unsigned long *tid);
+
+extern void
+_mysql_trace_query(
+	_mysql_ConnectionObject *self,
+	PyObject *sql);
+
+extern void
+_mysql_trace_query_done(
+	_mysql_ConnectionObject *self,
+	PyObject *sql,
+	unsigned PY_LONG_LONG elapsed,
+	unsigned int merr,
+	Py_ssize_t len);
+
+extern _mysql_Histogram _mysql_latency_query;
+extern _mysql_Histogram _mysql_latency_result;
+extern int _mysql_latency_aggregate;
+
+extern void
+_mysql_Histogram_record(
+	_mysql_Histogram *h,
+	unsigned PY_LONG_LONG ns);
+
+extern void
+_mysql_record_query_latency(
+	_mysql_ConnectionObject *c,
+	unsigned PY_LONG_LONG ns);
+
+extern void
+_mysql_record_result_latency(
+	_mysql_ConnectionObject *c,
+	unsigned PY_LONG_LONG ns);
+
+extern PyObject *
+_mysql_HistogramObject_New(
+	const _mysql_Histogram *h);
+
+#ifdef HAVE_MYSQL_STMT
+extern PyObject *
+_mysql_StmtException(
+	_mysql_ConnectionObject *c,
+	MYSQL_STMT *stmt);
+
+extern char _mysql_ConnectionObject_open_blob__doc__[];
+
+extern PyObject *
+_mysql_ConnectionObject_open_blob(
+	_mysql_ConnectionObject *self,
+	PyObject *args,
+	PyObject *kwargs);
+
+extern char _mysql_ConnectionObject_stmt_execute__doc__[];
+
+extern PyObject *
+_mysql_ConnectionObject_stmt_execute(
+	_mysql_ConnectionObject *self,
+	PyObject *args,
+	PyObject *kwargs);
+#endif
+
 extern int
 _mysql_ResultObject_Initialize(
 	_mysql_ResultObject *self,
@@ -2,42 +2,69 @@
 
 #include "mysqlmod.h"
 
+#define _MYSQL_RESULT_FREE_LIST_SIZE 16
+
+static PyObject *
+_mysql_ResultObject_free_items[_MYSQL_RESULT_FREE_LIST_SIZE];
+
+_mysql_FreeList _mysql_ResultObject_free_list = {
+	&_mysql_ResultObject_Type,
+	_mysql_ResultObject_free_items,
+	_MYSQL_RESULT_FREE_LIST_SIZE,
+	0, 0, 0
+};
+
+PyObject *
+_mysql_ResultObject_alloc(
+	PyTypeObject *type,
+	Py_ssize_t nitems)
+{
+	return _mysql_FreeList_Alloc(&_mysql_ResultObject_free_list,
+				     type, nitems);
+}
+
+void
+_mysql_ResultObject_free(
+	void *ob)
+{
+	_mysql_FreeList_Free(&_mysql_ResultObject_free_list, ob);
+}
+
 static PyObject *
 _mysql_ResultObject_get_fields(
 	_mysql_ResultObject *self,
 	PyObject *unused)
 {
-	PyObject *arglist=NULL, *kwarglist=NULL;
 	PyObject *fields=NULL;
 	_mysql_FieldObject *field=NULL;
+	MYSQL_FIELD *metadata;
 	unsigned int i, n;
 
 	check_result_connection(self);
-	kwarglist = PyDict_New();
-	if (!kwarglist) goto error;
 	n = mysql_num_fields(self->result);
+	metadata = mysql_fetch_fields(self->result);
 	if (!(fields = PyTuple_New(n))) return NULL;
 	for (i=0; i<n; i++) {
-		arglist = Py_BuildValue("(Oi)", self, i);
-		if (!arglist) goto error;
 		field = MyAlloc(_mysql_FieldObject, _mysql_FieldObject_Type);
 		if (!field) goto error;
-		if (_mysql_FieldObject_Initialize(field, arglist, kwarglist))
-			goto error;
-		Py_DECREF(arglist);
+		field->result = (PyObject *) self;
+		Py_INCREF(self);
+		field->field = &metadata[i];
+		field->index = i;
 		PyTuple_SET_ITEM(fields, i, (PyObject *) field);
 	}
-	Py_DECREF(kwarglist);
 	return fields;
   error:
-	Py_XDECREF(arglist);
-	Py_XDECREF(kwarglist);
 	Py_XDECREF(fields);
 	return NULL;
 }
 
 static char _mysql_ResultObject__doc__[] =
-"result(connection, use=0) -- Result set from a query.\n\
+"result(connection, use=0, spill_dir=None) -- Result set from a query.\n\
+\n\
+If spill_dir is given, the rows are streamed with mysql_use_result()\n\
+into a temporary file in that directory, which is memory-mapped and\n\
+then read like a stored result.\n\
 \n\
 Creating instances of this class directly is an excellent way to\n\
 shoot yourself in the foot. If using _mysql.connection directly,\n\
@@ -51,32 +78,98 @@ _mysql_ResultObject_Initialize(
 	PyObject *args,
 	PyObject *kwargs)
 {
-	static char *kwlist[] = {"connection", "use", NULL};
+	static char *kwlist[] = {"connection", "use", "spill_dir", NULL};
 	MYSQL_RES *result;
 	_mysql_ConnectionObject *conn = NULL;
 	int use = 0;
 	int n;
+	char *spill_dir = NULL;
+	unsigned PY_LONG_LONG start, elapsed;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", kwlist,
-					  &conn, &use))
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iz", kwlist,
+					  &conn, &use, &spill_dir))
 		return -1;
+#ifndef HAVE_SPILL
+	if (spill_dir) {
+		PyErr_SetString(_mysql_NotSupportedError,
+				"spill_dir is not supported on this platform");
+		return -1;
+	}
+#endif
 
 	self->conn = (PyObject *) conn;
 	Py_INCREF(conn);
-	self->use = use;
-	Py_BEGIN_ALLOW_THREADS ;
-	if (use)
+	self->use = use && !spill_dir;
+	self->retrieval_ns = self->rows = self->bytes = 0;
+	self->exhausted = 0;
+	self->stored = STORED_UNKNOWN;
+	memset(&(self->alloc), 0, sizeof(self->alloc));
+	MYSQL_BEGIN_ALLOW_THREADS ;
+	start = _mysql_clock_ns();
+	if (use || spill_dir)
 		result = mysql_use_result(&(conn->connection));
 	else
 		result = mysql_store_result(&(conn->connection));
 	self->result = result;
-	Py_END_ALLOW_THREADS ;
+	elapsed = _mysql_clock_ns() - start;
+	MYSQL_END_ALLOW_THREADS ;
+	conn->stats.result_ns += elapsed;
 	if (!result) {
 		return 0;
 	}
+	self->retrieval_ns = elapsed;
+	if (!use && !spill_dir)
+		_mysql_record_result_latency(conn, elapsed);
 	n = mysql_num_fields(result);
 	self->nfields = n;
+#ifdef HAVE_SPILL
+	if (spill_dir) {
+		_mysql_SpillFile *spill;
+		unsigned PY_LONG_LONG received = 0;
+
+		MYSQL_BEGIN_ALLOW_THREADS ;
+		start = _mysql_clock_ns();
+		spill = _mysql_SpillFile_New(&(conn->connection), result,
+					     spill_dir, &received);
+		start = _mysql_clock_ns() - start;
+		MYSQL_END_ALLOW_THREADS ;
+		conn->stats.fetch_ns += start;
+		conn->bytes_received += received;
+		if (spill) {
+			conn->stats.rows += spill->rows;
+			self->retrieval_ns += start;
+			self->rows = spill->rows;
+			self->bytes = received;
+			_mysql_record_result_latency(conn,
+						     self->retrieval_ns);
+		}
+		if (!spill) {
+			if (errno)
+				PyErr_SetFromErrnoWithFilename(PyExc_IOError,
+							       spill_dir);
+			else
+				_mysql_Exception(conn);
+			return -1;
+		}
+		self->spill = spill;
+	}
+#endif
 	self->fields = _mysql_ResultObject_get_fields(self, NULL);
+	if (_mysql_trace_hook) {
+		PyObject *rows;
+		if (self->use) {
+			Py_INCREF(Py_None);
+			rows = Py_None;
+		} else
+			rows = PyLong_FromUnsignedLongLong(self->spill ?
+				self->spill->rows : mysql_num_rows(result));
+		_mysql_trace("result", conn, "{s:k,s:K,s:O,s:i,s:N}",
+			     "thread_id", mysql_thread_id(&(conn->connection)),
+			     "ns", self->retrieval_ns,
+			     "use", self->use ? Py_True : Py_False,
+			     "fields", n,
+			     "rows", rows);
+	}
 
 	return 0;
 }
@@ -87,12 +180,65 @@ _mysql_ResultObject_traverse(
 	visitproc visit,
 	void *arg)
 {
-	int r;
-	if (self->fields) {
-		if (!(r = visit(self->fields, arg))) return r;
+	Py_VISIT(self->fields);
+	Py_VISIT(self->conn);
+	return 0;
+}
+
+/* Reports a result set whose last row has been read: records the time
+   taken to receive a use_result() result, and calls the trace hook.
+   Fetches that happen without the GIL only set exhausted, so their
+   callers, and clear(), call this once they hold it again. It runs
+   Python code, so it is never called from tp_clear or dealloc. */
+void
+_mysql_ResultObject_finished(
+	_mysql_ResultObject *self)
+{
+	_mysql_ConnectionObject *conn = result_connection(self);
+
+	if (self->exhausted != 1 || !conn)
+		return;
+	self->exhausted = 2;
+	if (self->use)
+		_mysql_record_result_latency(conn, self->retrieval_ns);
+	if (_mysql_trace_hook)
+		_mysql_trace("fetch_done", conn, "{s:k,s:K,s:K,s:K}",
+			     "thread_id", mysql_thread_id(&(conn->connection)),
+			     "ns", self->retrieval_ns,
+			     "rows", self->rows,
+			     "bytes", self->bytes);
+}
+
+/* Notes that the last row has been read, with the GIL held. */
+static void
+_mysql_ResultObject_eof(
+	_mysql_ResultObject *self)
+{
+	if (!self->exhausted) {
+		self->exhausted = 1;
+		_mysql_ResultObject_finished(self);
+	}
+}
+
+/* Releases the MYSQL_RES before the connection it may still read from,
+   and never raises or runs Python code, so it is safe as tp_clear and
+   from dealloc. */
+static int
+_mysql_ResultObject_release(
+	_mysql_ResultObject *self)
+{
+	Py_CLEAR(self->fields);
+#ifdef HAVE_SPILL
+	if (self->spill) {
+		_mysql_SpillFile_Free(self->spill);
+		self->spill = NULL;
+	}
+#endif
+	if (self->result) {
+		mysql_free_result(self->result);
+		self->result = NULL;
 	}
-	if (self->conn)
-		return visit(self->conn, arg);
+	Py_CLEAR(self->conn);
 	return 0;
 }
 
@@ -133,6 +279,134 @@ _mysql_ResultObject_describe(
 	return NULL;
 }
 
+/* Builds the tuple of strings (None for NULL) for the n cells of row,
+   whose lengths are given, and counts what it allocated in alloc unless
+   that is NULL. Touches no connection, so the spill file and the
+   synthetic benchmark result share it. */
+PyObject *
+_mysql_row_to_tuple(
+	MYSQL_ROW row,
+	unsigned long *lengths,
+	unsigned int n,
+	_mysql_AllocStats *alloc)
+{
+	unsigned int i;
+	PyObject *r;
+
+	if (!(r = PyTuple_New(n))) return NULL;
+	for (i=0; i<n; i++) {
+		PyObject *v;
+		if (row[i]) {
+			v = PyString_FromStringAndSize(row[i], lengths[i]);
+			if (!v) goto error;
+		} else /* NULL */ {
+			v = Py_None;
+			Py_INCREF(v);
+		}
+		PyTuple_SET_ITEM(r, i, v);
+	}
+	if (alloc) {
+		alloc->rows++;
+		_mysql_alloc_total.rows++;
+		_mysql_AllocStats_count(alloc, r);
+		for (i=0; i<n; i++)
+			_mysql_AllocStats_count(alloc,
+						PyTuple_GET_ITEM(r, i));
+	}
+	return r;
+  error:
+	Py_DECREF(r);
+	return NULL;
+}
+
+/* Builds the tuple for the current row, counting it and its bytes. */
+static PyObject *
+_mysql_ResultObject_row_tuple(
+	_mysql_ResultObject *self,
+	MYSQL_ROW row,
+	unsigned int n)
+{
+	unsigned int i;
+	unsigned long *length;
+	unsigned PY_LONG_LONG bytes = 0;
+	PyObject *r;
+
+	length = mysql_fetch_lengths(self->result);
+	if (!(r = _mysql_row_to_tuple(row, length, n, _mysql_alloc_profile ?
+				      &(self->alloc) : NULL)))
+		return NULL;
+	for (i=0; i<n; i++)
+		if (row[i])
+			bytes += length[i];
+	result_connection(self)->stats.rows++;
+	result_connection(self)->bytes_received += bytes;
+	self->rows++;
+	self->bytes += bytes;
+	return r;
+}
+
+/* Fetches the next row without creating Python objects, from the
+   spill file or the client library, so it may be called without the
+   GIL. Returns 0 at the end of the result set or on error; the caller
+   tells them apart with mysql_errno(). The row is counted in *counts
+   rather than the result and connection, for the caller to add with
+   _mysql_ResultObject_add_counts() once it has the GIL. */
+int
+_mysql_ResultObject_raw_row(
+	_mysql_ResultObject *self,
+	MYSQL_ROW *row,
+	unsigned long **lengths,
+	_mysql_RowCounts *counts)
+{
+	unsigned int i, n = self->nfields;
+
+#ifdef HAVE_SPILL
+	if (self->spill) {
+		if (!(*row = _mysql_SpillFile_Next(self->spill))) {
+			if (!self->exhausted)
+				self->exhausted = 1;
+			return 0;
+		}
+		*lengths = self->spill->lengths;
+		return 1;
+	}
+#endif
+	if (self->use) {
+		unsigned PY_LONG_LONG start = _mysql_clock_ns();
+		*row = mysql_fetch_row(self->result);
+		counts->fetch_ns += _mysql_clock_ns() - start;
+	} else
+		*row = mysql_fetch_row(self->result);
+	if (!*row) {
+		if (!self->exhausted &&
+		    !mysql_errno(&(result_connection(self)->connection)))
+			self->exhausted = 1;
+		return 0;
+	}
+	counts->rows++;
+	*lengths = mysql_fetch_lengths(self->result);
+	for (i=0; i<n; i++)
+		counts->bytes += (*lengths)[i];
+	return 1;
+}
+
+/* Adds what _mysql_ResultObject_raw_row() counted to the result and
+   its connection; needs the GIL. */
+void
+_mysql_ResultObject_add_counts(
+	_mysql_ResultObject *self,
+	const _mysql_RowCounts *counts)
+{
+	_mysql_ConnectionObject *conn = result_connection(self);
+
+	conn->stats.rows += counts->rows;
+	conn->stats.fetch_ns += counts->fetch_ns;
+	conn->bytes_received += counts->bytes;
+	self->rows += counts->rows;
+	self->bytes += counts->bytes;
+	self->retrieval_ns += counts->fetch_ns;
+}
+
 static char _mysql_ResultObject_fetch_row__doc__[] =
 "fetchrow()\n\
   Fetches one row as a tuple of strings.\n\
@@ -145,49 +419,164 @@ _mysql_ResultObject_fetch_row(
 	_mysql_ResultObject *self,
  	PyObject *unused)
  {
-	unsigned int n, i;
-	unsigned long *length;
+	unsigned int n;
 	PyObject *r=NULL;
 	MYSQL_ROW row;
 	
  	check_result_connection(self);
+#ifdef HAVE_SPILL
+	if (self->spill) {
+		r = _mysql_SpillFile_Fetch(self->spill, _mysql_alloc_profile ?
+					   &(self->alloc) : NULL);
+		if (r == Py_None)
+			_mysql_ResultObject_eof(self);
+		return r;
+	}
+#endif
  	
 	if (!self->use)
 		row = mysql_fetch_row(self->result);
 	else {
- 		Py_BEGIN_ALLOW_THREADS;
+		_mysql_ConnectionObject *conn = result_connection(self);
+		unsigned PY_LONG_LONG start;
+ 		MYSQL_BEGIN_ALLOW_THREADS;
+		start = _mysql_clock_ns();
 		row = mysql_fetch_row(self->result);
- 		Py_END_ALLOW_THREADS;
+		start = _mysql_clock_ns() - start;
+ 		MYSQL_END_ALLOW_THREADS;
+		conn->stats.fetch_ns += start;
+		self->retrieval_ns += start;
 	}
 	if (!row && mysql_errno(&(((_mysql_ConnectionObject *)(self->conn))->connection))) {
 		_mysql_Exception((_mysql_ConnectionObject *)self->conn);
 		goto error;
 	}
 	if (!row) {
+		_mysql_ResultObject_eof(self);
 		Py_INCREF(Py_None);
 		return Py_None;
 	}
 	
 	n = mysql_num_fields(self->result);
-	if (!(r = PyTuple_New(n))) return NULL;
-	length = mysql_fetch_lengths(self->result);
-	for (i=0; i<n; i++) {
-		PyObject *v;
-		if (row[i]) {
-			v = PyString_FromStringAndSize(row[i], length[i]);
-			if (!v) goto error;
-		} else /* NULL */ {
-			v = Py_None;
-			Py_INCREF(v);
- 		}
-		PyTuple_SET_ITEM(r, i, v);
- 	}
-	return r;
+	return _mysql_ResultObject_row_tuple(self, row, n);
   error:
 	Py_XDECREF(r);
 	return NULL;
 }
 
+static char _mysql_ResultObject_fetch_all__doc__[] =
+"fetch_all([maxrows])\n\
+  Fetches all remaining rows, or at most maxrows of them if\n\
+  maxrows is positive, as a list of tuples of strings.\n\
+  NULL is returned as None. With store_result(), the list is\n\
+  allocated once at its final size from num_rows().\n\
+";
+
+static PyObject *
+_mysql_ResultObject_fetch_all(
+	_mysql_ResultObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"maxrows", NULL};
+	unsigned int n;
+	int maxrows = 0;
+	Py_ssize_t i = 0, size = 0;
+	PyObject *rows, *r;
+	MYSQL_ROW row;
+	_mysql_AllocStats *alloc = _mysql_alloc_profile ?
+		&(self->alloc) : NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i:fetch_all", kwlist,
+					 &maxrows))
+		return NULL;
+	check_result_connection(self);
+#ifdef HAVE_SPILL
+	if (self->spill) {
+		_mysql_SpillFile *spill = self->spill;
+		size = (Py_ssize_t) (spill->rows - spill->pos);
+		if (maxrows > 0 && size > maxrows)
+			size = maxrows;
+		if (!(rows = PyList_New(size))) return NULL;
+		for (i=0; i<size; i++) {
+			if (!(r = _mysql_SpillFile_Fetch(spill, alloc)))
+				goto error;
+			PyList_SET_ITEM(rows, i, r);
+		}
+		if (spill->pos == spill->rows)
+			_mysql_ResultObject_eof(self);
+		if (alloc)
+			_mysql_AllocStats_count(alloc, rows);
+		return rows;
+	}
+#endif
+	n = mysql_num_fields(self->result);
+	if (!self->use)
+		size = (Py_ssize_t) mysql_num_rows(self->result);
+	if (maxrows > 0 && size > maxrows)
+		size = maxrows;
+	if (!(rows = PyList_New(size))) return NULL;
+	while (maxrows <= 0 || i < maxrows) {
+		if (!self->use)
+			row = mysql_fetch_row(self->result);
+		else {
+			_mysql_ConnectionObject *conn = result_connection(self);
+			unsigned PY_LONG_LONG start;
+			MYSQL_BEGIN_ALLOW_THREADS;
+			start = _mysql_clock_ns();
+			row = mysql_fetch_row(self->result);
+			start = _mysql_clock_ns() - start;
+			MYSQL_END_ALLOW_THREADS;
+			conn->stats.fetch_ns += start;
+			self->retrieval_ns += start;
+		}
+		if (!row) {
+			if (mysql_errno(&(result_connection(self)->connection))) {
+				_mysql_Exception(result_connection(self));
+				goto error;
+			}
+			_mysql_ResultObject_eof(self);
+			break;
+		}
+		if (!(r = _mysql_ResultObject_row_tuple(self, row, n)))
+			goto error;
+		if (i < size)
+			PyList_SET_ITEM(rows, i, r);
+		else {
+			if (PyList_Append(rows, r)) {
+				Py_DECREF(r);
+				goto error;
+			}
+			Py_DECREF(r);
+		}
+		i++;
+	}
+	/* rows already fetched before this call leave the tail unused */
+	if (i < size && PyList_SetSlice(rows, i, size, NULL))
+		goto error;
+	if (alloc)
+		_mysql_AllocStats_count(alloc, rows);
+	return rows;
+  error:
+	Py_DECREF(rows);
+	return NULL;
+}
+
+static char _mysql_ResultObject_alloc_stats__doc__[] =
+"alloc_stats() -- Returns a dict of the rows fetched, and the Python\n\
+objects and bytes allocated for them, while alloc_profile() was on:\n\
+rows, objects, bytes, objects_per_row and bytes_per_row. Still\n\
+available after clear().\n\
+";
+
+static PyObject *
+_mysql_ResultObject_alloc_stats(
+	_mysql_ResultObject *self,
+	PyObject *unused)
+{
+	return _mysql_AllocStats_New(&(self->alloc));
+}
+
 static char _mysql_ResultObject_field_flags__doc__[] =
 "Returns a tuple of field flags, one for each column in the result.\n\
 " ;
@@ -230,9 +619,18 @@ _mysql_ResultObject_clear(
 {
 	if (self->result) {
 		if (self->use) {
-			Py_BEGIN_ALLOW_THREADS;
-			while (mysql_fetch_row(self->result));
-			Py_END_ALLOW_THREADS;
+			unsigned PY_LONG_LONG received = 0;
+			unsigned int i, n = mysql_num_fields(self->result);
+			unsigned long *length;
+
+			MYSQL_BEGIN_ALLOW_THREADS;
+			while (mysql_fetch_row(self->result)) {
+				length = mysql_fetch_lengths(self->result);
+				for (i=0; i<n; i++)
+					received += length[i];
+			}
+			MYSQL_END_ALLOW_THREADS;
+			result_connection(self)->bytes_received += received;
 
 			if (mysql_errno(&(((_mysql_ConnectionObject *)(self->conn))->connection))) {
 				_mysql_Exception((_mysql_ConnectionObject *)self->conn);
@@ -240,14 +638,8 @@ _mysql_ResultObject_clear(
 			}
 		}
 	}
-	Py_XDECREF(self->fields);
-	self->fields = NULL;
-	Py_XDECREF(self->conn);
-	self->conn = NULL;
-	if (self->result) {
-		mysql_free_result(self->result);
-		self->result = NULL;
-	}
+	_mysql_ResultObject_finished(self);
+	_mysql_ResultObject_release(self);
 	Py_INCREF(Py_None);
 	return Py_None;
 }
@@ -302,9 +694,79 @@ _mysql_ResultObject_num_rows(
 	PyObject *unused)
 {
 	check_result_connection(self);
+#ifdef HAVE_SPILL
+	if (self->spill)
+		return PyLong_FromUnsignedLongLong(self->spill->rows);
+#endif
 	return PyLong_FromUnsignedLongLong(mysql_num_rows(self->result));
 }
 
+static char _mysql_ResultObject_memory_usage__doc__[] =
+"Returns the approximate number of bytes held by the client\n\
+library for this result set: field metadata plus, for\n\
+store_result(), every buffered row, or for use_result(), the\n\
+current row only. A stored result is complete by the time it can\n\
+be measured; its rows are walked on the first call. Spilled rows\n\
+live in a mapped file and are not counted.\n\
+";
+
+/* Walks the rows of a stored result through the public API, then
+   puts the row cursor back where it was. */
+static unsigned PY_LONG_LONG
+_mysql_stored_rows_size(
+	MYSQL_RES *result,
+	unsigned int n)
+{
+	MYSQL_ROW_OFFSET offset = mysql_row_tell(result);
+	unsigned PY_LONG_LONG total = 0;
+	unsigned long *lengths;
+	unsigned int i;
+
+	mysql_data_seek(result, 0);
+	while (mysql_fetch_row(result)) {
+		total += sizeof(MYSQL_ROWS) + (n+1) * sizeof(char *) + n;
+		lengths = mysql_fetch_lengths(result);
+		for (i=0; lengths && i<n; i++)
+			total += lengths[i];
+	}
+	mysql_row_seek(result, offset);
+	return total;
+}
+
+static PyObject *
+_mysql_ResultObject_memory_usage(
+	_mysql_ResultObject *self,
+	PyObject *unused)
+{
+	MYSQL_FIELD *fields;
+	unsigned long *lengths;
+	unsigned int i, n;
+	unsigned PY_LONG_LONG total;
+
+	check_result_connection(self);
+	n = mysql_num_fields(self->result);
+	fields = mysql_fetch_fields(self->result);
+	total = sizeof(MYSQL_RES) + n * (sizeof(MYSQL_FIELD) +
+					 sizeof(unsigned long));
+#if MYSQL_VERSION_ID >= 40100
+	for (i=0; i<n; i++)
+		total += fields[i].name_length + fields[i].org_name_length +
+			fields[i].table_length + fields[i].org_table_length +
+			fields[i].db_length + fields[i].catalog_length + 6;
+#endif
+	if (self->spill)
+		;
+	else if (!self->use) {
+		if (self->stored == STORED_UNKNOWN)
+			self->stored = _mysql_stored_rows_size(self->result, n);
+		total += self->stored;
+	} else if ((lengths = mysql_fetch_lengths(self->result))) {
+		for (i=0; i<n; i++)
+			total += lengths[i];
+	}
+	return PyLong_FromUnsignedLongLong(total);
+}
+
 
 static char _mysql_ResultObject_data_seek__doc__[] =
 "data_seek(n) -- seek to row n of result set";
@@ -316,6 +778,14 @@ _mysql_ResultObject_data_seek(
 	unsigned int row;
 	if (!PyArg_ParseTuple(args, "i:data_seek", &row)) return NULL;
 	check_result_connection(self);
+#ifdef HAVE_SPILL
+	if (self->spill) {
+		self->spill->pos = row < self->spill->rows ?
+			row : self->spill->rows;
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+#endif
 	mysql_data_seek(self->result, row);
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -337,6 +807,19 @@ _mysql_ResultObject_row_seek(
 				"cannot be used with connection.use_result()");
 		return NULL;
 	}
+#ifdef HAVE_SPILL
+	if (self->spill) {
+		_mysql_SpillFile *spill = self->spill;
+		if (offset < 0 && (my_ulonglong) -offset > spill->pos)
+			spill->pos = 0;
+		else if (offset > 0 && spill->pos + offset > spill->rows)
+			spill->pos = spill->rows;
+		else
+			spill->pos += offset;
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+#endif
 	r = mysql_row_tell(self->result);
 	mysql_row_seek(self->result, r+offset);
 	Py_INCREF(Py_None);
@@ -358,6 +841,10 @@ _mysql_ResultObject_row_tell(
 				"cannot be used with connection.use_result()");
 		return NULL;
 	}
+#ifdef HAVE_SPILL
+	if (self->spill)
+		return PyLong_FromUnsignedLongLong(self->spill->pos);
+#endif
 	r = mysql_row_tell(self->result);
 	return PyInt_FromLong(r-self->result->data->data);
 }
@@ -367,8 +854,7 @@ _mysql_ResultObject_dealloc(
 	_mysql_ResultObject *self)
 {
 	PyObject_GC_UnTrack((PyObject *)self);
-	_mysql_ResultObject_clear(self, NULL);
-	mysql_free_result(self->result);
+	_mysql_ResultObject_release(self);
 	MyFree(self);
 }
 
@@ -401,12 +887,24 @@ static PyMethodDef _mysql_ResultObject_methods[] = {
 		METH_NOARGS,
 		_mysql_ResultObject_row_tell__doc__
 	},
+	{
+		"alloc_stats",
+		(PyCFunction)_mysql_ResultObject_alloc_stats,
+		METH_NOARGS,
+		_mysql_ResultObject_alloc_stats__doc__
+	},
 	{
 		"clear",
 		(PyCFunction)_mysql_ResultObject_clear,
 		METH_NOARGS,
 		_mysql_ResultObject_clear__doc__
 	},
+	{
+		"copy_to",
+		(PyCFunction)_mysql_ResultObject_copy_to,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_ResultObject_copy_to__doc__
+	},
 	{
 		"describe",
 		(PyCFunction)_mysql_ResultObject_describe,
@@ -420,6 +918,18 @@ static PyMethodDef _mysql_ResultObject_methods[] = {
 		_mysql_ResultObject_fetch_row__doc__
 	},
 
+	{
+		"fetch_all",
+		(PyCFunction)_mysql_ResultObject_fetch_all,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_ResultObject_fetch_all__doc__
+	},
+	{
+		"fetch_into",
+		(PyCFunction)_mysql_ResultObject_fetch_into,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_ResultObject_fetch_into__doc__
+	},
 	{
 		"field_flags",
 		(PyCFunction)_mysql_ResultObject_field_flags,
@@ -438,6 +948,18 @@ static PyMethodDef _mysql_ResultObject_methods[] = {
 		METH_NOARGS,
 		_mysql_ResultObject_num_rows__doc__
 	},
+	{
+		"write_arrow",
+		(PyCFunction)_mysql_ResultObject_write_arrow,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_ResultObject_write_arrow__doc__
+	},
+	{
+		"memory_usage",
+		(PyCFunction)_mysql_ResultObject_memory_usage,
+		METH_NOARGS,
+		_mysql_ResultObject_memory_usage__doc__
+	},
 	{NULL,              NULL} /* sentinel */
 };
 
@@ -445,7 +967,7 @@ static struct PyMemberDef _mysql_ResultObject_memberlist[] = {
 	{
 		"connection",
 		T_OBJECT,
-		offsetof(_mysql_ConnectionObject, connection),
+		offsetof(_mysql_ResultObject, conn),
 		RO,
 		"Connection associated with result"
 	},
@@ -466,50 +988,6 @@ static struct PyMemberDef _mysql_ResultObject_memberlist[] = {
 	{NULL} /* Sentinel */
 };
 
-static PyObject *
-_mysql_ResultObject_getattr(
-	_mysql_ResultObject *self,
-	char *name)
-{
-	PyObject *res;
-	struct PyMemberDef *l;
-
-	res = Py_FindMethod(_mysql_ResultObject_methods, (PyObject *)self, name);
-	if (res != NULL)
-		return res;
-	PyErr_Clear();
-
-	for (l = _mysql_ResultObject_memberlist; l->name != NULL; l++) {
-		if (strcmp(l->name, name) == 0)
-			return PyMember_GetOne((char *)self, l);
-	}
-
-	PyErr_SetString(PyExc_AttributeError, name);
-	return NULL;
-}
-
-static int
-_mysql_ResultObject_setattr(
-	_mysql_ResultObject *self,
-	char *name,
-	PyObject *v)
-{
-	struct PyMemberDef *l;
-
-	if (v == NULL) {
-		PyErr_SetString(PyExc_AttributeError,
-				"can't delete connection attributes");
-		return -1;
-	}
-
-	for (l = _mysql_ResultObject_memberlist; l->name != NULL; l++)
-		if (strcmp(l->name, name) == 0)
-			return PyMember_SetOne((char *)self, l, v);
-
-        PyErr_SetString(PyExc_AttributeError, name);
-        return -1;
-}
-
 PyTypeObject _mysql_ResultObject_Type = {
 	PyObject_HEAD_INIT(NULL)
 	0,
@@ -518,8 +996,8 @@ PyTypeObject _mysql_ResultObject_Type = {
 	0,
 	(destructor)_mysql_ResultObject_dealloc, /* tp_dealloc */
 	0, /*tp_print*/
-	(getattrfunc)_mysql_ResultObject_getattr, /* tp_getattr */
-	(setattrfunc)_mysql_ResultObject_setattr, /* tp_setattr */
+	0, /* tp_getattr */
+	0, /* tp_setattr */
 	0, /*tp_compare*/
 	(reprfunc)_mysql_ResultObject_repr, /* tp_repr */
 
@@ -547,7 +1025,7 @@ PyTypeObject _mysql_ResultObject_Type = {
 	/* call function for all accessible objects */
 	(traverseproc)_mysql_ResultObject_traverse, /* tp_traverse */
 	/* delete references to contained objects */
-	(inquiry)_mysql_ResultObject_clear, /* tp_clear */
+	(inquiry)_mysql_ResultObject_release, /* tp_clear */
 
 	/* rich comparisons */
 	0, /* (richcmpfunc) tp_richcompare */
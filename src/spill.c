@@ -0,0 +1,194 @@
+/* -*- mode: C; indent-tabs-mode: t; c-basic-offset: 8; -*- */
+
+#include "mysqlmod.h"
+
+#ifdef HAVE_SPILL
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Opens an anonymous read/write file in dir: it is unlinked at once, so
+   nothing is left behind if the process dies. */
+static FILE *
+_mysql_spill_tmpfile(
+	const char *dir)
+{
+	char *path;
+	size_t n;
+	int fd, saved;
+	FILE *f;
+
+	n = strlen(dir);
+	if (!(path = malloc(n + 20))) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	sprintf(path, "%s/mysql-spill-XXXXXX", dir);
+	fd = mkstemp(path);
+	if (fd < 0) {
+		saved = errno;
+		free(path);
+		errno = saved;
+		return NULL;
+	}
+	unlink(path);
+	free(path);
+	if (!(f = fdopen(fd, "w+b"))) {
+		saved = errno;
+		close(fd);
+		errno = saved;
+	}
+	return f;
+}
+
+static void *
+_mysql_spill_map(
+	FILE *f,
+	size_t size)
+{
+	void *p;
+
+	if (!size)
+		return NULL;
+	p = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(f), 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+/* Reads every remaining row of result, which must come from
+   mysql_use_result(), into a new spill file and maps it. Touches no
+   Python objects, so it may run without the GIL. Returns NULL with
+   errno set on I/O errors, or with errno 0 if fetching a row failed,
+   in which case mysql_errno() has the details. *bytes is increased by
+   the number of cell bytes read. */
+_mysql_SpillFile *
+_mysql_SpillFile_New(
+	MYSQL *conn,
+	MYSQL_RES *result,
+	const char *dir,
+	unsigned PY_LONG_LONG *bytes)
+{
+	_mysql_SpillFile *spill;
+	FILE *data = NULL, *index = NULL;
+	unsigned PY_LONG_LONG offset = 0;
+	unsigned int i, n = mysql_num_fields(result);
+	unsigned long *lengths;
+	MYSQL_ROW row;
+	int saved;
+
+	if (!(spill = calloc(1, sizeof(_mysql_SpillFile)))) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	spill->nfields = n;
+	spill->values = calloc(n + 1, sizeof(char *));
+	spill->lengths = calloc(n + 1, sizeof(unsigned long));
+	if (!spill->values || !spill->lengths) {
+		errno = ENOMEM;
+		goto error;
+	}
+	if (!(data = _mysql_spill_tmpfile(dir))) goto error;
+	if (!(index = _mysql_spill_tmpfile(dir))) goto error;
+	while ((row = mysql_fetch_row(result))) {
+		if (fwrite(&offset, sizeof(offset), 1, index) != 1)
+			goto error;
+		lengths = mysql_fetch_lengths(result);
+		for (i=0; i<n; i++) {
+			unsigned int len = row[i] ? lengths[i] : SPILL_NULL;
+			if (fwrite(&len, sizeof(len), 1, data) != 1)
+				goto error;
+			offset += sizeof(len);
+			if (!row[i]) continue;
+			if (lengths[i] &&
+			    fwrite(row[i], lengths[i], 1, data) != 1)
+				goto error;
+			offset += lengths[i];
+			*bytes += lengths[i];
+		}
+		spill->rows++;
+	}
+	if (mysql_errno(conn)) {
+		errno = 0;
+		goto error;
+	}
+	if (fflush(data) || fflush(index)) goto error;
+	spill->data_size = (size_t) offset;
+	spill->index_size = (size_t) spill->rows * sizeof(offset);
+	if (spill->data_size &&
+	    !(spill->data = _mysql_spill_map(data, spill->data_size)))
+		goto error;
+	if (spill->index_size &&
+	    !(spill->index = _mysql_spill_map(index, spill->index_size)))
+		goto error;
+	fclose(data);
+	fclose(index);
+	return spill;
+  error:
+	saved = errno;
+	if (data) fclose(data);
+	if (index) fclose(index);
+	_mysql_SpillFile_Free(spill);
+	errno = saved;
+	return NULL;
+}
+
+void
+_mysql_SpillFile_Free(
+	_mysql_SpillFile *spill)
+{
+	if (spill->data) munmap(spill->data, spill->data_size);
+	if (spill->index) munmap((void *) spill->index, spill->index_size);
+	free(spill->values);
+	free(spill->lengths);
+	free(spill);
+}
+
+/* Points spill->values and spill->lengths at the cells of the row at
+   the current position and advances, like mysql_fetch_row(). Returns
+   NULL past the last row. Needs no GIL. */
+MYSQL_ROW
+_mysql_SpillFile_Next(
+	_mysql_SpillFile *spill)
+{
+	const char *p;
+	unsigned int i, len;
+
+	if (spill->pos >= spill->rows)
+		return NULL;
+	p = spill->data + spill->index[spill->pos++];
+	for (i=0; i<spill->nfields; i++) {
+		memcpy(&len, p, sizeof(len));
+		p += sizeof(len);
+		if (len == SPILL_NULL) {
+			spill->values[i] = NULL;
+			spill->lengths[i] = 0;
+		} else {
+			spill->values[i] = (char *) p;
+			spill->lengths[i] = len;
+			p += len;
+		}
+	}
+	return spill->values;
+}
+
+/* Returns the row at the current position as a tuple and advances,
+   or None past the last row. Allocations are counted in alloc unless
+   it is NULL. */
+PyObject *
+_mysql_SpillFile_Fetch(
+	_mysql_SpillFile *spill,
+	_mysql_AllocStats *alloc)
+{
+	MYSQL_ROW row;
+
+	if (!(row = _mysql_SpillFile_Next(spill))) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	return _mysql_row_to_tuple(row, spill->lengths, spill->nfields, alloc);
+}
+
+#endif /* HAVE_SPILL */
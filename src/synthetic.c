@@ -0,0 +1,355 @@
+/* -*- mode: C; indent-tabs-mode: t; c-basic-offset: 8; -*- */
+
+#include "mysqlmod.h"
+
+/* A result set held in memory, for benchmarking the code that turns
+   rows into Python objects, and the escaping code, without a server.
+   The cells are packed into data; cells points at each of them (NULL
+   for NULL) row after row, with lengths alongside, the way
+   mysql_fetch_row() and mysql_fetch_lengths() hand out a stored
+   result. mysql has only been through mysql_init(), for escaping. */
+typedef struct {
+	PyObject_HEAD
+	unsigned int nfields;
+	Py_ssize_t nrows;
+	char **cells;
+	unsigned long *lengths;
+	char *data;
+	MYSQL *mysql;
+} _mysql_SyntheticResultObject;
+
+static void
+_mysql_SyntheticResultObject_release(
+	_mysql_SyntheticResultObject *self)
+{
+	PyMem_Free(self->cells);
+	PyMem_Free(self->lengths);
+	PyMem_Free(self->data);
+	self->cells = NULL;
+	self->lengths = NULL;
+	self->data = NULL;
+	self->nrows = 0;
+	self->nfields = 0;
+	if (self->mysql) {
+		mysql_close(self->mysql);
+		self->mysql = NULL;
+	}
+}
+
+static char _mysql_SyntheticResultObject__doc__[] =
+"_synthetic_result(rows) -- A result set held in memory, for\n\
+benchmarking without a server. rows is a sequence of tuples of equal\n\
+length whose items are strings, or None for NULL, as the server would\n\
+send them. Not part of the API; see tests/bench_decode.py.\n\
+";
+
+static int
+_mysql_SyntheticResultObject_Initialize(
+	_mysql_SyntheticResultObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"rows", NULL};
+	PyObject *rows, *seq;
+	Py_ssize_t i, nrows, size = 0, cells;
+	unsigned int j, n = 0;
+	char *p;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O:_synthetic_result",
+					 kwlist, &rows))
+		return -1;
+	check_server_init(-1);
+	_mysql_SyntheticResultObject_release(self);
+	if (!(seq = PySequence_Fast(rows, "rows must be a sequence")))
+		return -1;
+	nrows = PySequence_Fast_GET_SIZE(seq);
+	for (i=0; i<nrows; i++) {
+		PyObject *row = PySequence_Fast_GET_ITEM(seq, i);
+		if (!PyTuple_Check(row)) {
+			PyErr_SetString(PyExc_TypeError,
+					"rows must be tuples");
+			goto error;
+		}
+		if (!i)
+			n = (unsigned int) PyTuple_GET_SIZE(row);
+		else if (PyTuple_GET_SIZE(row) != (Py_ssize_t) n) {
+			PyErr_SetString(PyExc_ValueError,
+					"rows must be of equal length");
+			goto error;
+		}
+		for (j=0; j<n; j++) {
+			PyObject *v = PyTuple_GET_ITEM(row, j);
+			if (v == Py_None)
+				continue;
+			if (!PyString_Check(v)) {
+				PyErr_SetString(PyExc_TypeError,
+						"cells must be strings or None");
+				goto error;
+			}
+			size += PyString_GET_SIZE(v);
+		}
+	}
+	cells = nrows * n;
+	self->cells = PyMem_Malloc(cells * sizeof(char *) + 1);
+	self->lengths = PyMem_Malloc(cells * sizeof(unsigned long) + 1);
+	self->data = PyMem_Malloc(size + 1);
+	if (!self->cells || !self->lengths || !self->data) {
+		PyErr_NoMemory();
+		goto error;
+	}
+	p = self->data;
+	for (i=0; i<nrows; i++) {
+		PyObject *row = PySequence_Fast_GET_ITEM(seq, i);
+		for (j=0; j<n; j++) {
+			PyObject *v = PyTuple_GET_ITEM(row, j);
+			Py_ssize_t k = i * n + j;
+			if (v == Py_None) {
+				self->cells[k] = NULL;
+				self->lengths[k] = 0;
+				continue;
+			}
+			self->cells[k] = p;
+			self->lengths[k] = PyString_GET_SIZE(v);
+			memcpy(p, PyString_AS_STRING(v), self->lengths[k]);
+			p += self->lengths[k];
+		}
+	}
+	if (!(self->mysql = mysql_init(NULL))) {
+		PyErr_NoMemory();
+		goto error;
+	}
+	self->nrows = nrows;
+	self->nfields = n;
+	Py_DECREF(seq);
+	return 0;
+  error:
+	Py_DECREF(seq);
+	_mysql_SyntheticResultObject_release(self);
+	return -1;
+}
+
+/* Returns every row as a tuple, like result.fetch_all() on a stored
+   result. */
+static PyObject *
+_mysql_SyntheticResultObject_rows(
+	_mysql_SyntheticResultObject *self)
+{
+	PyObject *rows, *r;
+	Py_ssize_t i;
+	unsigned int n = self->nfields;
+
+	if (!(rows = PyList_New(self->nrows))) return NULL;
+	for (i=0; i<self->nrows; i++) {
+		if (!(r = _mysql_row_to_tuple(self->cells + i * n,
+					      self->lengths + i * n, n,
+					      NULL))) {
+			Py_DECREF(rows);
+			return NULL;
+		}
+		PyList_SET_ITEM(rows, i, r);
+	}
+	return rows;
+}
+
+static char _mysql_SyntheticResultObject_fetch_all__doc__[] =
+"fetch_all() -- Returns every row as a tuple of strings, with None\n\
+for NULL, built by the same code as result.fetch_all().\n\
+";
+
+static PyObject *
+_mysql_SyntheticResultObject_fetch_all(
+	_mysql_SyntheticResultObject *self,
+	PyObject *unused)
+{
+	return _mysql_SyntheticResultObject_rows(self);
+}
+
+static char _mysql_SyntheticResultObject_decode__doc__[] =
+"decode(loops=1) -- Builds the list of row tuples loops times and\n\
+returns the nanoseconds taken, not counting freeing the lists.\n\
+";
+
+static PyObject *
+_mysql_SyntheticResultObject_decode(
+	_mysql_SyntheticResultObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"loops", NULL};
+	int loops = 1;
+	unsigned PY_LONG_LONG start, total = 0;
+	PyObject *rows;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i:decode", kwlist,
+					 &loops))
+		return NULL;
+	while (loops-- > 0) {
+		start = _mysql_clock_ns();
+		rows = _mysql_SyntheticResultObject_rows(self);
+		total += _mysql_clock_ns() - start;
+		if (!rows) return NULL;
+		Py_DECREF(rows);
+	}
+	return PyLong_FromUnsignedLongLong(total);
+}
+
+static char _mysql_SyntheticResultObject_escape__doc__[] =
+"escape(loops=1, quote=False) -- Escapes every non-NULL cell loops\n\
+times, as connection.escape_string() does, or string_literal() if\n\
+quote is true, and returns the nanoseconds taken. The default client\n\
+character set is used.\n\
+";
+
+static PyObject *
+_mysql_SyntheticResultObject_escape(
+	_mysql_SyntheticResultObject *self,
+	PyObject *args,
+	PyObject *kwargs)
+{
+	static char *kwlist[] = {"loops", "quote", NULL};
+	int loops = 1, quote = 0;
+	Py_ssize_t k, cells = self->nrows * self->nfields;
+	unsigned PY_LONG_LONG start;
+	PyObject *s;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ii:escape", kwlist,
+					 &loops, &quote))
+		return NULL;
+	start = _mysql_clock_ns();
+	while (loops-- > 0) {
+		for (k=0; k<cells; k++) {
+			if (!self->cells[k])
+				continue;
+			s = _mysql_escape_bytes(self->mysql, self->cells[k],
+						(int) self->lengths[k], quote);
+			if (!s) return NULL;
+			Py_DECREF(s);
+		}
+	}
+	return PyLong_FromUnsignedLongLong(_mysql_clock_ns() - start);
+}
+
+static void
+_mysql_SyntheticResultObject_dealloc(
+	_mysql_SyntheticResultObject *self)
+{
+	_mysql_SyntheticResultObject_release(self);
+	MyFree(self);
+}
+
+static PyObject *
+_mysql_SyntheticResultObject_repr(
+	_mysql_SyntheticResultObject *self)
+{
+	char buf[300];
+	sprintf(buf, "<_mysql._synthetic_result of %ld rows at %lx>",
+		(long) self->nrows, (long)self);
+	return PyString_FromString(buf);
+}
+
+static PyMethodDef _mysql_SyntheticResultObject_methods[] = {
+	{
+		"fetch_all",
+		(PyCFunction)_mysql_SyntheticResultObject_fetch_all,
+		METH_NOARGS,
+		_mysql_SyntheticResultObject_fetch_all__doc__
+	},
+	{
+		"decode",
+		(PyCFunction)_mysql_SyntheticResultObject_decode,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_SyntheticResultObject_decode__doc__
+	},
+	{
+		"escape",
+		(PyCFunction)_mysql_SyntheticResultObject_escape,
+		METH_VARARGS | METH_KEYWORDS,
+		_mysql_SyntheticResultObject_escape__doc__
+	},
+	{NULL,              NULL} /* sentinel */
+};
+
+static struct PyMemberDef _mysql_SyntheticResultObject_memberlist[] = {
+	{
+		"num_fields",
+		T_UINT,
+		offsetof(_mysql_SyntheticResultObject, nfields),
+		RO,
+		"Number of columns"
+	},
+	{
+		"num_rows",
+		T_PYSSIZET,
+		offsetof(_mysql_SyntheticResultObject, nrows),
+		RO,
+		"Number of rows"
+	},
+	{NULL} /* Sentinel */
+};
+
+PyTypeObject _mysql_SyntheticResultObject_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,
+	"_mysql._synthetic_result",
+	sizeof(_mysql_SyntheticResultObject),
+	0,
+	(destructor)_mysql_SyntheticResultObject_dealloc, /* tp_dealloc */
+	0, /*tp_print*/
+	0, /* tp_getattr */
+	0, /* tp_setattr */
+	0, /*tp_compare*/
+	(reprfunc)_mysql_SyntheticResultObject_repr, /* tp_repr */
+
+	/* Method suites for standard classes */
+
+	0, /* (PyNumberMethods *) tp_as_number */
+	0, /* (PySequenceMethods *) tp_as_sequence */
+	0, /* (PyMappingMethods *) tp_as_mapping */
+
+	/* More standard operations (here for binary compatibility) */
+
+	0, /* (hashfunc) tp_hash */
+	0, /* (ternaryfunc) tp_call */
+	0, /* (reprfunc) tp_str */
+	0, /* (getattrofunc) tp_getattro */
+	0, /* (setattrofunc) tp_setattro */
+
+	/* Functions to access object as input/output buffer */
+	0, /* (PyBufferProcs *) tp_as_buffer */
+
+	/* Flags to define presence of optional/expanded features */
+	Py_TPFLAGS_DEFAULT, /* (long) tp_flags */
+
+	_mysql_SyntheticResultObject__doc__, /* (char *) tp_doc Documentation string */
+	/* call function for all accessible objects */
+	0, /* tp_traverse */
+	/* delete references to contained objects */
+	0, /* tp_clear */
+
+	/* rich comparisons */
+	0, /* (richcmpfunc) tp_richcompare */
+
+	/* weak reference enabler */
+	0, /* (long) tp_weaklistoffset */
+
+	/* Iterators */
+	0, /* (getiterfunc) tp_iter */
+	0, /* (iternextfunc) tp_iternext */
+
+	/* Attribute descriptor and subclassing stuff */
+	(struct PyMethodDef *)_mysql_SyntheticResultObject_methods, /* tp_methods */
+	(struct PyMemberDef *)_mysql_SyntheticResultObject_memberlist, /*tp_members */
+	0, /* (struct getsetlist *) tp_getset; */
+	0, /* (struct _typeobject *) tp_base; */
+	0, /* (PyObject *) tp_dict */
+	0, /* (descrgetfunc) tp_descr_get */
+	0, /* (descrsetfunc) tp_descr_set */
+	0, /* (long) tp_dictoffset */
+	(initproc)_mysql_SyntheticResultObject_Initialize, /* tp_init */
+	NULL, /* tp_alloc */
+	NULL, /* tp_new */
+	NULL, /* tp_free Low-level free-memory routine */
+	0, /* (PyObject *) tp_bases */
+	0, /* (PyObject *) tp_mro method resolution order */
+	0, /* (PyObject *) tp_defined */
+};
@@ -0,0 +1,169 @@
+"""A minimal reader for Arrow IPC streams.
+
+It understands exactly the subset _mysql.result.write_arrow() produces
+(flat schemas of Int, FloatingPoint, Decimal, Date, Timestamp,
+Duration, Utf8 and Binary columns) and exists so the tests can check
+that output without depending on pyarrow.
+
+"""
+
+import datetime
+import struct
+from decimal import Decimal
+
+
+class Table(object):
+
+    """A FlatBuffers table at pos in buf."""
+
+    def __init__(self, buf, pos):
+        self.buf = buf
+        self.pos = pos
+        vtable = pos - struct.unpack_from('<i', buf, pos)[0]
+        size = struct.unpack_from('<H', buf, vtable)[0]
+        self.slots = struct.unpack_from('<%dH' % ((size - 4) // 2),
+                                        buf, vtable + 4)
+
+    def _slot(self, i):
+        if i < len(self.slots) and self.slots[i]:
+            return self.pos + self.slots[i]
+        return None
+
+    def scalar(self, i, fmt, default=0):
+        pos = self._slot(i)
+        if pos is None:
+            return default
+        return struct.unpack_from('<' + fmt, self.buf, pos)[0]
+
+    def _indirect(self, i):
+        pos = self._slot(i)
+        if pos is None:
+            return None
+        return pos + struct.unpack_from('<I', self.buf, pos)[0]
+
+    def table(self, i):
+        pos = self._indirect(i)
+        return pos is not None and Table(self.buf, pos) or None
+
+    def string(self, i):
+        pos = self._indirect(i)
+        if pos is None:
+            return None
+        n = struct.unpack_from('<I', self.buf, pos)[0]
+        return self.buf[pos+4:pos+4+n]
+
+    def tables(self, i):
+        pos = self._indirect(i)
+        if pos is None:
+            return []
+        n = struct.unpack_from('<I', self.buf, pos)[0]
+        return [ Table(self.buf, p + struct.unpack_from('<I', self.buf, p)[0])
+                 for p in xrange(pos + 4, pos + 4 + 4 * n, 4) ]
+
+    def structs(self, i, fmt):
+        pos = self._indirect(i)
+        if pos is None:
+            return []
+        n = struct.unpack_from('<I', self.buf, pos)[0]
+        size = struct.calcsize('<' + fmt)
+        return [ struct.unpack_from('<' + fmt, self.buf, p)
+                 for p in xrange(pos + 4, pos + 4 + size * n, size) ]
+
+
+def _messages(data):
+    pos = 0
+    while pos < len(data):
+        marker, size = struct.unpack_from('<Ii', data, pos)
+        if marker != 0xFFFFFFFF:
+            raise ValueError("bad continuation marker at %d" % pos)
+        pos += 8
+        if not size:
+            return
+        meta = data[pos:pos+size]
+        pos += size
+        message = Table(meta, struct.unpack_from('<I', meta, 0)[0])
+        length = message.scalar(3, 'q')
+        yield message, data[pos:pos+length]
+        pos += length
+    raise ValueError("stream ended without an end-of-stream marker")
+
+
+_EPOCH = datetime.datetime(1970, 1, 1)
+_UNITS = (1, 1000, 1000000, 1000000000)
+
+
+def _column(field):
+    kind = field.scalar(2, 'B')
+    t = field.table(3)
+    if kind == 2:
+        bits, signed = t.scalar(0, 'i'), t.scalar(1, '?')
+        fmt = {8: 'b', 16: 'h', 32: 'i', 64: 'q'}[bits]
+        return 'fixed', signed and fmt or fmt.upper(), None
+    if kind == 3:
+        return 'fixed', t.scalar(0, 'h') == 1 and 'f' or 'd', None
+    if kind == 7:
+        scale = t.scalar(1, 'i')
+        return 'fixed', '16s', lambda v: _decimal(v, scale)
+    if kind == 8:
+        return 'fixed', 'i', lambda v: (_EPOCH + datetime.timedelta(v)).date()
+    if kind in (10, 18):
+        per = _UNITS[t.scalar(0, 'h')]
+        delta = lambda v: datetime.timedelta(seconds=v // per,
+                                             microseconds=v % per * 1000000 // per)
+        if kind == 10:
+            return 'fixed', 'q', lambda v: _EPOCH + delta(v)
+        return 'fixed', 'q', delta
+    if kind == 5:
+        return 'binary', None, lambda v: v.decode('utf8')
+    if kind == 4:
+        return 'binary', None, None
+    raise ValueError("unsupported Arrow type %d" % kind)
+
+
+def _decimal(v, scale):
+    lo, hi = struct.unpack('<Qq', v)
+    return Decimal((hi << 64) | lo).scaleb(-scale)
+
+
+def read_stream(data):
+    """Decode an Arrow IPC stream; return (names, rows), where rows is a
+    list of tuples with None for nulls."""
+    names, columns, rows = None, None, []
+    for message, body in _messages(data):
+        kind = message.scalar(1, 'B')
+        header = message.table(2)
+        if kind == 1:
+            fields = header.tables(1)
+            names = [ f.string(0) for f in fields ]
+            columns = [ _column(f) for f in fields ]
+            continue
+        if kind != 3 or columns is None:
+            raise ValueError("unexpected message type %d" % kind)
+        n = header.scalar(0, 'q')
+        buffers = iter(header.structs(2, 'qq'))
+        values = []
+        for layout, fmt, convert in columns:
+            offset, length = buffers.next()
+            valid = body[offset:offset+length]
+            if layout == 'fixed':
+                offset, length = buffers.next()
+                cells = struct.unpack_from('<%d%s' % (n, fmt), body, offset) \
+                        if fmt != '16s' else \
+                        [ body[offset+16*i:offset+16*i+16] for i in xrange(n) ]
+            else:
+                offset, length = buffers.next()
+                ends = struct.unpack_from('<%di' % (n + 1), body, offset)
+                offset, length = buffers.next()
+                cells = [ body[offset+ends[i]:offset+ends[i+1]]
+                          for i in xrange(n) ]
+            column = []
+            for i in xrange(n):
+                if valid and not ord(valid[i // 8]) & (1 << (i % 8)):
+                    column.append(None)
+                elif convert is not None:
+                    column.append(convert(cells[i]))
+                else:
+                    column.append(cells[i])
+            values.append(column)
+        rows.extend(zip(*values) if values else [()] * n)
+    return names, rows
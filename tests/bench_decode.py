@@ -0,0 +1,191 @@
+#!/usr/bin/env python
+"""Microbenchmarks of row decoding and escaping, without a server.
+
+Each type mix is a synthetic result held in memory by
+_mysql._synthetic_result, whose rows are turned into tuples by the same
+C code as result.fetch_all(). For each mix this reports, per stage:
+
+fetch
+  the C code building tuples of strings from the rows
+convert
+  MySQLdb.converters turning those into Python values, as the cursor
+  does with the default decoders
+escape
+  connection.escape_string() applied to every non-NULL cell
+
+ns/cell, and for fetch and convert the objects and bytes allocated per
+row: objects referenced by nothing but the row (so not None, interned
+one-character strings or cached small ints), measured on one pass.
+
+    python tests/bench_decode.py [--rows N] [--loops N] [--json]
+"""
+
+import json
+import time
+from optparse import OptionParser
+
+import _mysql
+from MySQLdb.constants import FIELD_TYPE
+from MySQLdb.converters import default_decoders, default_row_formatter, \
+    get_codec
+from MySQLdb.cursors import allocations
+
+BINARY, UTF8 = 63, 33
+
+# name: (FIELD_TYPE, charset, text of the value for row i)
+COLUMNS = {
+    'tiny': (FIELD_TYPE.TINY, BINARY, lambda i: str(i % 100)),
+    'int': (FIELD_TYPE.LONG, BINARY, lambda i: str(i * 7919 % 2000000)),
+    'bigint': (FIELD_TYPE.LONGLONG, BINARY,
+               lambda i: str(i * 2654435761 % 2 ** 62)),
+    'double': (FIELD_TYPE.DOUBLE, BINARY, lambda i: repr(i / 7.0)),
+    'decimal': (FIELD_TYPE.NEWDECIMAL, BINARY,
+                lambda i: "%d.%02d" % (i * 13, i % 100)),
+    'date': (FIELD_TYPE.DATE, BINARY,
+             lambda i: "20%02d-%02d-%02d" % (i % 30, 1 + i % 12, 1 + i % 28)),
+    'datetime': (FIELD_TYPE.DATETIME, BINARY,
+                 lambda i: "2024-%02d-%02d %02d:%02d:%02d"
+                 % (1 + i % 12, 1 + i % 28, i % 24, i % 60, (i * 7) % 60)),
+    'time': (FIELD_TYPE.TIME, BINARY,
+             lambda i: "%02d:%02d:%02d" % (i % 24, i % 60, (i * 7) % 60)),
+    'varchar': (FIELD_TYPE.VAR_STRING, UTF8,
+                lambda i: ("name %d" % i).ljust(16, 'x')),
+    'varbinary': (FIELD_TYPE.VAR_STRING, BINARY,
+                  lambda i: ("key:%d" % i).ljust(16, '\0')),
+    'text': (FIELD_TYPE.BLOB, UTF8,
+             lambda i: ("text %d it's \"quoted\"\n" % i) * 32),
+    'blob': (FIELD_TYPE.BLOB, BINARY,
+             lambda i: "".join([ chr((i + j) % 256) for j in range(1024) ])),
+    }
+
+MIXES = [
+    ('ints', ['int'] * 8, 0.0),
+    ('bigints', ['bigint'] * 8, 0.0),
+    ('smallints', ['tiny'] * 8, 0.0),
+    ('doubles', ['double'] * 8, 0.0),
+    ('decimals', ['decimal'] * 8, 0.0),
+    ('temporal', ['date', 'datetime', 'time'] * 2, 0.0),
+    ('strings', ['varchar'] * 8, 0.0),
+    ('binary', ['varbinary'] * 8, 0.0),
+    ('text', ['text'] * 2, 0.0),
+    ('blobs', ['blob'] * 2, 0.0),
+    ('mixed', ['int', 'bigint', 'double', 'decimal', 'date', 'datetime',
+               'varchar', 'text'], 0.0),
+    ('mixed_nulls', ['int', 'bigint', 'double', 'decimal', 'date',
+                     'datetime', 'varchar', 'text'], 0.3),
+    ]
+
+
+class Connection(object):
+
+    def character_set_name(self):
+        return 'utf8'
+
+
+class Result(object):
+
+    connection = Connection()
+
+
+class Field(object):
+
+    """Stands in for _mysql.field: what the decoders look at."""
+
+    result = Result()
+
+    def __init__(self, type, charsetnr):
+        self.type = type
+        self.charsetnr = charsetnr
+
+
+def make_rows(names, nulls, n):
+    values = [ COLUMNS[name][2] for name in names ]
+    every = nulls and int(round(1 / nulls)) or 0
+    rows = []
+    for i in range(n):
+        row = []
+        for j, value in enumerate(values):
+            if every and (i * len(values) + j) % every == every - 1:
+                row.append(None)
+            else:
+                row.append(value(i))
+        rows.append(tuple(row))
+    return rows
+
+
+def per_row(rows):
+    """Return the (objects, bytes) that MySQLdb.cursors.allocations()
+    counts for rows, per row."""
+    objects, size = allocations(rows)
+    n = float(len(rows) or 1)
+    return objects / n, size / n
+
+
+def bench(names, nulls, nrows, loops):
+    rows = make_rows(names, nulls, nrows)
+    result = _mysql._synthetic_result(rows)
+    fields = [ Field(*COLUMNS[name][:2]) for name in names ]
+    decoders = tuple([ get_codec(f, default_decoders) for f in fields ])
+
+    fetched = result.fetch_all()
+    fetch_objects, fetch_bytes = per_row(fetched)
+    fetch_ns = min([ result.decode() for i in range(loops) ])
+
+    converted = map(default_row_formatter, [decoders] * len(fetched), fetched)
+    convert_objects, convert_bytes = per_row(converted)
+    del converted
+    runs = []
+    for i in range(loops):
+        t = time.time()
+        map(default_row_formatter, [decoders] * len(fetched), fetched)
+        runs.append((time.time() - t) * 1e9)
+    convert_ns = min(runs)
+
+    escape_ns = result.escape(loops)
+    non_null = sum([ 1 for row in rows for v in row if v is not None ])
+    per_cell = float(nrows * len(names))
+    return {
+        'columns': names,
+        'nulls': nulls,
+        'rows': nrows,
+        'fetch': {'ns_per_cell': fetch_ns / per_cell,
+                  'objects_per_row': fetch_objects,
+                  'bytes_per_row': fetch_bytes},
+        'convert': {'ns_per_cell': convert_ns / per_cell,
+                    'objects_per_row': convert_objects,
+                    'bytes_per_row': convert_bytes},
+        'escape': {'ns_per_cell': escape_ns / float(non_null * loops or 1)},
+        }
+
+
+def main():
+    parser = OptionParser(usage="%prog [options] [mix ...]")
+    parser.add_option("--rows", type="int", default=10000)
+    parser.add_option("--loops", type="int", default=5,
+                      help="runs of each stage; the fastest is reported")
+    parser.add_option("--json", action="store_true",
+                      help="print the results as JSON")
+    options, args = parser.parse_args()
+    mixes = [ m for m in MIXES if not args or m[0] in args ]
+    results = {}
+    if not options.json:
+        print "%-12s %10s %10s %10s %10s %10s %10s %10s" % (
+            "mix", "fetch", "objs/row", "bytes/row", "convert", "objs/row",
+            "bytes/row", "escape")
+    for name, columns, nulls in mixes:
+        r = results[name] = bench(columns, nulls, options.rows, options.loops)
+        if not options.json:
+            print "%-12s %10.1f %10.2f %10.1f %10.1f %10.2f %10.1f %10.1f" % (
+                name, r['fetch']['ns_per_cell'],
+                r['fetch']['objects_per_row'], r['fetch']['bytes_per_row'],
+                r['convert']['ns_per_cell'],
+                r['convert']['objects_per_row'],
+                r['convert']['bytes_per_row'], r['escape']['ns_per_cell'])
+    if options.json:
+        print json.dumps(results, indent=2, sort_keys=True)
+    else:
+        print "(fetch, convert and escape in ns/cell)"
+
+
+if __name__ == "__main__":
+    main()
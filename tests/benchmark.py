@@ -0,0 +1,401 @@
+#!/usr/bin/env python
+"""Benchmarks for MySQLdb against a throwaway local server.
+
+Boots a private mysqld with its data directory in a temporary
+directory, listening only on a unix socket, runs the benchmarks and
+writes the results as JSON:
+
+    python tests/benchmark.py -o results.json
+    python tests/benchmark.py -o new.json --compare results.json
+
+--socket runs against an already running server instead, using the
+given user and database; the benchmark tables are created there.
+--mock runs against tests/mockserver.py, which answers the benchmark
+queries with synthetic rows of the same shape: this measures the client
+side alone, without a database installed.
+
+Each benchmark is run --repeat times and reports the best run (the
+least disturbed by the rest of the machine) along with all the runs.
+Every result is a rate, so higher is better, except connect, which is
+a latency in microseconds.
+"""
+
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from optparse import OptionParser
+
+import _mysql
+import MySQLdb
+
+NARROW = "CREATE TABLE narrow (id INT PRIMARY KEY, v INT, s VARCHAR(20))"
+WIDE_COLUMNS = 30
+
+
+def wide_table():
+    columns = ["id INT PRIMARY KEY"]
+    for i in range(WIDE_COLUMNS - 1):
+        kind = ("INT", "DOUBLE", "VARCHAR(32)", "DECIMAL(10,2)",
+                "DATETIME")[i % 5]
+        columns.append("c%d %s" % (i, kind))
+    return "CREATE TABLE wide (%s)" % ", ".join(columns)
+
+
+def wide_row(i):
+    row = [i]
+    for j in range(WIDE_COLUMNS - 1):
+        row.append((i * j, i / 7.0, "value %d %d" % (i, j), "%d.%02d" % (i, j),
+                    "2024-01-%02d 12:34:56" % (1 + (i + j) % 28))[j % 5])
+    return tuple(row)
+
+
+class Server(object):
+
+    """A mysqld running on a unix socket, with its data directory under
+    a temporary directory that is removed by stop()."""
+
+    def __init__(self, mysqld, install_db=None, timeout=60):
+        self.mysqld = mysqld
+        self.install_db = install_db
+        self.timeout = timeout
+        self.dir = tempfile.mkdtemp(prefix="mysqldb-bench-")
+        self.datadir = os.path.join(self.dir, "data")
+        self.socket = os.path.join(self.dir, "mysql.sock")
+        self.log = os.path.join(self.dir, "error.log")
+        self.process = None
+
+    def user_args(self):
+        if hasattr(os, "geteuid") and os.geteuid() == 0:
+            return ["--user=root"]
+        return []
+
+    def initialize(self):
+        out = open(self.log, "a")
+        try:
+            r = subprocess.call([self.mysqld, "--no-defaults",
+                                 "--initialize-insecure",
+                                 "--datadir=" + self.datadir]
+                                + self.user_args(),
+                                stdout=out, stderr=subprocess.STDOUT)
+            if r == 0:
+                return
+            # MariaDB and MySQL before 5.7 have no --initialize.
+            if os.path.isdir(self.datadir):
+                shutil.rmtree(self.datadir)
+            install_db = self.install_db or find_program(
+                ("mariadb-install-db", "mysql_install_db"),
+                os.path.dirname(self.mysqld))
+            if install_db is None:
+                raise RuntimeError("cannot initialize a data directory;"
+                                   " see %s" % self.log)
+            r = subprocess.call([install_db, "--no-defaults",
+                                 "--datadir=" + self.datadir,
+                                 "--auth-root-authentication-method=normal"]
+                                + self.user_args(),
+                                stdout=out, stderr=subprocess.STDOUT)
+            if r != 0:
+                raise RuntimeError("%s failed; see %s" % (install_db,
+                                                         self.log))
+        finally:
+            out.close()
+
+    def start(self):
+        self.initialize()
+        self.process = subprocess.Popen(
+            [self.mysqld, "--no-defaults",
+             "--datadir=" + self.datadir,
+             "--socket=" + self.socket,
+             "--skip-networking",
+             "--pid-file=" + os.path.join(self.dir, "mysqld.pid"),
+             "--log-error=" + self.log]
+            + self.user_args())
+        deadline = time.time() + self.timeout
+        while True:
+            if self.process.poll() is not None:
+                raise RuntimeError("mysqld exited with status %d; see %s"
+                                   % (self.process.returncode, self.log))
+            try:
+                db = MySQLdb.connect(unix_socket=self.socket, user="root")
+            except MySQLdb.OperationalError:
+                if time.time() > deadline:
+                    raise RuntimeError("mysqld did not start within %ds;"
+                                       " see %s" % (self.timeout, self.log))
+                time.sleep(0.2)
+                continue
+            db.query("CREATE DATABASE IF NOT EXISTS bench")
+            db.close()
+            return
+
+    def stop(self):
+        if self.process is not None and self.process.poll() is None:
+            self.process.terminate()
+            self.process.wait()
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+
+def find_program(names, *dirs):
+    path = list(dirs) + os.environ.get("PATH", "").split(os.pathsep) + \
+        ["/usr/sbin", "/usr/local/sbin", "/usr/local/mysql/bin"]
+    for d in path:
+        for name in names:
+            candidate = os.path.join(d, name)
+            if os.path.isfile(candidate) and os.access(candidate, os.X_OK):
+                return candidate
+    return None
+
+
+class Benchmarks(object):
+
+    """The benchmarks. Each bench_ method runs once and returns
+    (amount, seconds); the rate reported is amount / seconds."""
+
+    def __init__(self, connect_kwargs, rows, queries):
+        self.connect_kwargs = connect_kwargs
+        self.rows = rows
+        self.queries = queries
+        self.db = self.connect()
+
+    def connect(self):
+        return MySQLdb.connect(**self.connect_kwargs)
+
+    def setup(self):
+        c = self.db.cursor()
+        for name, create in (("narrow", NARROW), ("wide", wide_table())):
+            c.execute("DROP TABLE IF EXISTS %s" % name)
+            c.execute(create + " ENGINE=InnoDB")
+        self.insert_narrow(c, "narrow", self.rows)
+        columns = ", ".join(["%s"] * WIDE_COLUMNS)
+        batch = 1000
+        for start in range(0, self.rows // 5, batch):
+            end = min(start + batch, self.rows // 5)
+            c.executemany("INSERT INTO wide VALUES (%s)" % columns,
+                          [ wide_row(i) for i in range(start, end) ])
+        self.db.commit()
+        c.close()
+
+    def insert_narrow(self, c, table, n):
+        batch = 1000
+        for start in range(0, n, batch):
+            c.executemany("INSERT INTO " + table + " VALUES (%s, %s, %s)",
+                          [ (i, i * 3, "row %d" % i)
+                            for i in range(start, min(start + batch, n)) ])
+
+    def bench_connect(self):
+        n = 200
+        t = time.time()
+        for i in range(n):
+            self.connect().close()
+        return n, time.time() - t
+
+    def bench_point_select(self):
+        c = self.db.cursor()
+        n, rows = self.queries, self.rows
+        t = time.time()
+        for i in range(n):
+            c.execute("SELECT id, v, s FROM narrow WHERE id = %s",
+                      ((i * 7919) % rows,))
+            c.fetchall()
+        elapsed = time.time() - t
+        c.close()
+        return n, elapsed
+
+    def fetchall(self, table, use_result=False):
+        c = self.db.cursor()
+        c.use_result = use_result
+        t = time.time()
+        c.execute("SELECT * FROM " + table)
+        if use_result:
+            n = 0
+            for row in c:
+                n += 1
+        else:
+            n = len(c.fetchall())
+        elapsed = time.time() - t
+        c.close()
+        return n, elapsed
+
+    def bench_fetchall_narrow(self):
+        return self.fetchall("narrow")
+
+    def bench_fetchall_wide(self):
+        return self.fetchall("wide")
+
+    def bench_use_result(self):
+        return self.fetchall("narrow", use_result=True)
+
+    def bench_executemany(self):
+        c = self.db.cursor()
+        c.execute("DROP TABLE IF EXISTS insert_target")
+        c.execute(NARROW.replace("narrow", "insert_target") +
+                  " ENGINE=InnoDB")
+        n = self.rows // 2
+        t = time.time()
+        self.insert_narrow(c, "insert_target", n)
+        self.db.commit()
+        elapsed = time.time() - t
+        c.execute("DROP TABLE insert_target")
+        c.close()
+        return n, elapsed
+
+    def bench_escape(self):
+        values = ["plain text", "it's \"quoted\"\n", u"unicode \xe9t\xe9",
+                  12345, 3.25, None, "x" * 200]
+        literal = self.db.literal
+        n = 20000
+        t = time.time()
+        for i in range(n):
+            for v in values:
+                literal(v)
+        return n * len(values), time.time() - t
+
+    def close(self):
+        self.db.close()
+
+
+UNITS = {
+    'connect': 'us',
+    'point_select': 'queries/s',
+    'fetchall_narrow': 'rows/s',
+    'fetchall_wide': 'rows/s',
+    'use_result': 'rows/s',
+    'executemany': 'rows/s',
+    'escape': 'values/s',
+    }
+
+ORDER = ('connect', 'point_select', 'fetchall_narrow', 'fetchall_wide',
+         'use_result', 'executemany', 'escape')
+
+
+def mock_server(rows):
+    """Return a started MockServer answering the benchmark queries."""
+    from mockserver import MockServer
+    narrow = "mock rows=%d cols=3 types=int,int,varchar size=10"
+    wide = "mock rows=%d cols=%d types=int,double,varchar,decimal,datetime" \
+        " size=16" % (rows // 5, WIDE_COLUMNS)
+    return MockServer(rules=[
+        (r"FROM narrow WHERE", narrow % 1),
+        (r"FROM narrow", narrow % rows),
+        (r"FROM wide", wide),
+        (r"^\s*(CREATE|DROP|INSERT)\b", "mock ok"),
+        ]).start()
+
+
+def run(bench, names, repeat):
+    results = {}
+    for name in names:
+        method = getattr(bench, "bench_" + name)
+        runs = []
+        for i in range(repeat):
+            amount, seconds = method()
+            if name == 'connect':
+                runs.append(seconds / amount * 1e6)
+            else:
+                runs.append(amount / seconds)
+        best = name == 'connect' and min(runs) or max(runs)
+        results[name] = {'value': best, 'unit': UNITS[name], 'runs': runs}
+        sys.stderr.write("%-16s %14.1f %s\n" % (name, best, UNITS[name]))
+    return results
+
+
+def compare(results, baseline):
+    """Write each benchmark's change against baseline to standard
+    error, as a percentage where positive means faster."""
+    old = baseline['results']
+    sys.stderr.write("%-16s %14s %14s %8s\n" % ("benchmark", "baseline",
+                                                 "current", "change"))
+    for name in ORDER:
+        if name not in results or name not in old:
+            continue
+        a, b = old[name]['value'], results[name]['value']
+        if name == 'connect':
+            change = (a - b) / a * 100
+        else:
+            change = (b - a) / a * 100
+        sys.stderr.write("%-16s %14.1f %14.1f %+7.1f%%\n"
+                         % (name, a, b, change))
+
+
+def main():
+    parser = OptionParser(usage="%prog [options]")
+    parser.add_option("--mysqld", help="mysqld to boot (default: search PATH)")
+    parser.add_option("--install-db",
+                      help="mysql_install_db, for servers without"
+                      " mysqld --initialize")
+    parser.add_option("--socket", help="use the running server on SOCKET")
+    parser.add_option("--mock", action="store_true",
+                      help="use a mock server instead of mysqld")
+    parser.add_option("--user", default="root")
+    parser.add_option("--passwd", default="")
+    parser.add_option("--db", default="bench")
+    parser.add_option("--rows", type="int", default=100000,
+                      help="rows in the narrow table; the wide one gets"
+                      " a fifth of that")
+    parser.add_option("--queries", type="int", default=10000,
+                      help="point selects per run")
+    parser.add_option("--repeat", type="int", default=5)
+    parser.add_option("--only", action="append", choices=ORDER,
+                      help="run only this benchmark; may be repeated")
+    parser.add_option("-o", "--output", help="write results to this file"
+                      " (default: standard output)")
+    parser.add_option("--compare", metavar="FILE",
+                      help="print the change against an earlier result file")
+    options, args = parser.parse_args()
+
+    server = None
+    if options.socket:
+        socket = options.socket
+    elif options.mock:
+        server = mock_server(options.rows)
+        socket = server.socket
+    else:
+        mysqld = options.mysqld or find_program(("mysqld", "mariadbd"))
+        if mysqld is None:
+            parser.error("no mysqld found; use --mysqld or --socket")
+        server = Server(mysqld, options.install_db)
+        sys.stderr.write("starting %s in %s\n" % (mysqld, server.dir))
+        server.start()
+        socket = server.socket
+    try:
+        bench = Benchmarks(dict(unix_socket=socket, user=options.user,
+                                passwd=options.passwd, db=options.db,
+                                charset="utf8"),
+                           options.rows, options.queries)
+        try:
+            bench.setup()
+            results = run(bench, options.only or ORDER, options.repeat)
+            meta = {
+                'time': time.time(),
+                'python': platform.python_version(),
+                'platform': platform.platform(),
+                'mysqldb': MySQLdb.__version__,
+                'client': _mysql.get_client_info(),
+                'server': bench.db.get_server_info(),
+                'rows': options.rows,
+                'queries': options.queries,
+                'repeat': options.repeat,
+                }
+        finally:
+            bench.close()
+    finally:
+        if server is not None:
+            server.stop()
+
+    output = json.dumps({'meta': meta, 'results': results}, indent=2,
+                        sort_keys=True)
+    if options.output:
+        f = open(options.output, "w")
+        f.write(output + "\n")
+        f.close()
+    else:
+        print output
+    if options.compare:
+        compare(results, json.load(open(options.compare)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,612 @@
+#!/usr/bin/env python
+"""A scriptable fake MySQL server for tests and benchmarks.
+
+It speaks enough of the client/server protocol for libmysqlclient to
+connect (any user and password are accepted) and run text queries, and
+answers them with synthetic result sets, so that the client side can be
+benchmarked and fault-tested without a database:
+
+    server = MockServer(rules=[(r"FROM users", "mock rows=100 cols=4")])
+    server.start()
+    db = MySQLdb.connect(unix_socket=server.socket)
+    ...
+    server.stop()
+
+or from the command line, to run until interrupted:
+
+    python tests/mockserver.py --socket /tmp/mock.sock --latency 0.001
+
+Each statement of a query (they are split on semicolons, and each gets
+its own result as with CLIENT_MULTI_RESULTS) is answered by the first
+rule whose regular expression it matches, or is itself a response if it
+starts with "mock":
+
+    mock rows=N cols=M [types=T,...] [size=S] [nulls=F] [delay=SEC]
+      a result set of N rows of M columns; types are used in turn and
+      are those of FIELD_TYPE (long, double, var_string, datetime, ...)
+      or their SQL names (int, bigint, varchar, blob, ...); size is the
+      length of string values; a fraction nulls of the cells is NULL
+    mock ok [affected=N] [insert_id=N] [warnings=N] [delay=SEC]
+      an OK packet
+    mock error=ERRNO [message=TEXT] [delay=SEC]
+      an error; TEXT runs to the end of the statement
+    mock disconnect
+      closes the connection without answering
+
+A rule may also give a function, called with the statement, returning a
+response string or a list of Response objects. Statements that match
+nothing get an OK if they are SET, USE, BEGIN and the like, an empty
+result for SHOW WARNINGS, and error 1064 otherwise.
+
+delay, and the server-wide latency which applies to every command, are
+slept before the response is sent. Responses built from strings are
+cached by query text (for queries up to 1K), so large results cost
+their generation once.
+
+The server only listens on a unix socket or on 127.0.0.1.
+"""
+
+import os
+import re
+import socket
+import struct
+import sys
+import tempfile
+import threading
+import time
+import SocketServer
+from optparse import OptionParser
+
+# Capabilities offered in the handshake: those of a 5.7 server, from
+# LONG_PASSWORD up to PLUGIN_AUTH_LENENC_CLIENT_DATA, less NO_SCHEMA,
+# COMPRESS and SSL. Without DEPRECATE_EOF, results end with EOF packets.
+CAPABILITIES = 0x003ff7cf
+SERVER_STATUS_AUTOCOMMIT = 0x0002
+SERVER_MORE_RESULTS_EXISTS = 0x0008
+
+COM_QUIT, COM_INIT_DB, COM_QUERY = 0x01, 0x02, 0x03
+COM_STATISTICS, COM_PING, COM_CHANGE_USER = 0x09, 0x0e, 0x11
+COM_SET_OPTION, COM_RESET_CONNECTION = 0x1b, 0x1f
+
+BINARY_CHARSET, UTF8_CHARSET = 63, 33
+BINARY_FLAG, NUM_FLAG = 128, 32768
+
+# name: (FIELD_TYPE code, display length, decimals, value function)
+TYPES = {
+    'tiny': (1, 4, 0, lambda r, c, size: str((r + c) % 128)),
+    'short': (2, 6, 0, lambda r, c, size: str((r * 31 + c) % 32768)),
+    'long': (3, 11, 0, lambda r, c, size: str(r * 1000 + c)),
+    'float': (4, 12, 31, lambda r, c, size: repr(r + c / 8.0)),
+    'double': (5, 22, 31, lambda r, c, size: repr(r / 7.0 + c)),
+    'timestamp': (7, 19, 0, lambda r, c, size:
+                  "2024-01-%02d %02d:%02d:%02d" % (1 + r % 28, r % 24, c % 60,
+                                                   r % 60)),
+    'longlong': (8, 20, 0, lambda r, c, size: str(r * 1000003 + c)),
+    'date': (10, 10, 0, lambda r, c, size: "2024-%02d-%02d" % (1 + r % 12,
+                                                             1 + c % 28)),
+    'time': (11, 10, 0, lambda r, c, size: "%02d:%02d:%02d" % (r % 24, c % 60,
+                                                              r % 60)),
+    'datetime': (12, 19, 0, lambda r, c, size:
+                 "2024-01-%02d %02d:%02d:%02d" % (1 + r % 28, r % 24, c % 60,
+                                                  r % 60)),
+    'year': (13, 4, 0, lambda r, c, size: str(1990 + r % 100)),
+    'bit': (16, 8, 0, lambda r, c, size: chr((r + c) % 256)),
+    'newdecimal': (246, 12, 2, lambda r, c, size: "%d.%02d" % (r, c % 100)),
+    'blob': (252, 65535, 0, lambda r, c, size: _filler(r, c, size)),
+    'var_string': (253, 255, 0, lambda r, c, size: _filler(r, c, size)),
+    'string': (254, 255, 0, lambda r, c, size: _filler(r, c, size)),
+    }
+
+ALIASES = {
+    'tinyint': 'tiny', 'smallint': 'short', 'int': 'long', 'integer': 'long',
+    'bigint': 'longlong', 'decimal': 'newdecimal', 'varchar': 'var_string',
+    'char': 'string', 'text': 'blob',
+    }
+
+DEFAULT_TYPES = ('long', 'var_string')
+OK_STATEMENTS = re.compile(r"\s*(SET|USE|BEGIN|START|COMMIT|ROLLBACK|"
+                           r"SAVEPOINT|RELEASE|DO)\b", re.I)
+WARNINGS = re.compile(r"\s*SHOW\s+WARNINGS\b", re.I)
+SPEC = re.compile(r"\s*mock\b(.*)$", re.I | re.S)
+
+
+def _filler(r, c, size):
+    prefix = "r%dc%d:" % (r, c)
+    if size <= len(prefix):
+        return prefix[:size]
+    return prefix + "x" * (size - len(prefix))
+
+
+def lenenc_int(n):
+    if n < 251:
+        return chr(n)
+    if n < 1 << 16:
+        return '\xfc' + struct.pack('<H', n)
+    if n < 1 << 24:
+        return '\xfd' + struct.pack('<I', n)[:3]
+    return '\xfe' + struct.pack('<Q', n)
+
+
+def lenenc_str(s):
+    return lenenc_int(len(s)) + s
+
+
+class Response(object):
+
+    """One statement's answer. delay is slept before it is sent."""
+
+    delay = 0.0
+
+    def packets(self, more):
+        """Return the payloads of the response, or None to close the
+        connection instead; more is true if another result follows."""
+        raise NotImplementedError
+
+
+class OK(Response):
+
+    def __init__(self, affected=0, insert_id=0, warnings=0, delay=0.0):
+        self.affected = affected
+        self.insert_id = insert_id
+        self.warnings = warnings
+        self.delay = delay
+
+    def packets(self, more):
+        return [ok_packet(self.affected, self.insert_id, self.warnings, more)]
+
+
+class Error(Response):
+
+    def __init__(self, errno, message=None, sqlstate="HY000", delay=0.0):
+        self.errno = errno
+        self.message = message or "mock error %d" % errno
+        self.sqlstate = sqlstate
+        self.delay = delay
+
+    def packets(self, more):
+        return ['\xff' + struct.pack('<H', self.errno) + '#' +
+                self.sqlstate[:5].ljust(5) + self.message]
+
+
+class Disconnect(Response):
+
+    def packets(self, more):
+        return None
+
+
+class Result(Response):
+
+    """A result set. columns is a list of (name, type) with type a key
+    of TYPES; rows is a list of tuples of strings or None."""
+
+    def __init__(self, columns, rows, warnings=0, delay=0.0):
+        self.columns = columns
+        self.rows = rows
+        self.warnings = warnings
+        self.delay = delay
+
+    def definitions(self):
+        """Return the column definition payloads."""
+        out = []
+        for name, kind in self.columns:
+            code, length, decimals, value = TYPES[kind]
+            if code in (252, 253, 254):
+                charset, flags = UTF8_CHARSET, 0
+                if kind == 'blob':
+                    charset, flags = BINARY_CHARSET, BINARY_FLAG
+            else:
+                charset, flags = BINARY_CHARSET, BINARY_FLAG
+                if code not in (7, 10, 11, 12, 16):
+                    flags |= NUM_FLAG
+            out.append(column_definition('def', 'mock', 't', 't', name, name,
+                                         charset, length, code, flags,
+                                         decimals))
+        return out
+
+    def packets(self, more):
+        out = [lenenc_int(len(self.columns))]
+        out.extend(self.definitions())
+        out.append(eof_packet(0, False))
+        for row in self.rows:
+            out.append(''.join([ v is None and '\xfb' or lenenc_str(v)
+                                 for v in row ]))
+        out.append(eof_packet(self.warnings, more))
+        return out
+
+
+class RawResult(Result):
+
+    """A result set described by full field metadata, as recorded by
+    MySQLdb.capture: columns are tuples of (name, org_name, table,
+    org_table, db, catalog, length, max_length, decimals, charsetnr,
+    flags, type)."""
+
+    def definitions(self):
+        return [ column_definition(catalog or 'def', db, table, org_table,
+                                   name, org_name, charsetnr, length, code,
+                                   flags, decimals)
+                 for (name, org_name, table, org_table, db, catalog, length,
+                      max_length, decimals, charsetnr, flags, code)
+                 in self.columns ]
+
+
+def column_definition(catalog, db, table, org_table, name, org_name,
+                      charset, length, code, flags, decimals):
+    return lenenc_str(catalog) + lenenc_str(db) + lenenc_str(table) + \
+        lenenc_str(org_table) + lenenc_str(name) + lenenc_str(org_name) + \
+        '\x0c' + struct.pack('<HIBHB', charset, length, code, flags,
+                             decimals) + '\0\0'
+
+
+def frame(payloads, seq):
+    """Return payloads as packets numbered from seq, and the next
+    sequence number."""
+    out = []
+    for payload in payloads:
+        while True:
+            chunk, payload = payload[:0xffffff], payload[0xffffff:]
+            out.append(struct.pack('<I', len(chunk))[:3] + chr(seq & 0xff) +
+                       chunk)
+            seq += 1
+            if len(chunk) < 0xffffff:
+                break
+    return ''.join(out), seq
+
+
+def status(more):
+    s = SERVER_STATUS_AUTOCOMMIT
+    if more:
+        s |= SERVER_MORE_RESULTS_EXISTS
+    return s
+
+
+def ok_packet(affected=0, insert_id=0, warnings=0, more=False):
+    return '\0' + lenenc_int(affected) + lenenc_int(insert_id) + \
+        struct.pack('<HH', status(more), warnings)
+
+
+def eof_packet(warnings, more):
+    return '\xfe' + struct.pack('<HH', warnings, status(more))
+
+
+def synthetic(rows, cols, types=DEFAULT_TYPES, size=16, nulls=0.0,
+              delay=0.0):
+    """Return a Result of rows x cols deterministic values."""
+    kinds = [ ALIASES.get(t, t) for t in types ]
+    for kind in kinds:
+        if kind not in TYPES:
+            raise ValueError("unknown type %r" % kind)
+    columns = [ ("c%d" % c, kinds[c % len(kinds)]) for c in range(cols) ]
+    values = [ TYPES[kind][3] for name, kind in columns ]
+    null_every = nulls and int(round(1 / nulls)) or 0
+    data = []
+    for r in range(rows):
+        row = []
+        for c in range(cols):
+            if null_every and (r * cols + c) % null_every == null_every - 1:
+                row.append(None)
+            else:
+                row.append(values[c](r, c, size))
+        data.append(tuple(row))
+    return Result(columns, data, delay=delay)
+
+
+def parse(spec):
+    """Return the Response a "mock ..." specification describes."""
+    m = SPEC.match(spec)
+    if not m:
+        raise ValueError("not a mock specification: %r" % spec)
+    words = m.group(1).split()
+    if not words:
+        raise ValueError("empty mock specification")
+    if words[0] == 'disconnect':
+        return Disconnect()
+    args = {}
+    rest = m.group(1)
+    for i, word in enumerate(words):
+        if word == 'ok':
+            continue
+        key, eq, value = word.partition('=')
+        if not eq:
+            raise ValueError("expected name=value, got %r" % word)
+        if key == 'message':
+            args[key] = rest[rest.index('message=') + 8:].strip()
+            break
+        args[key] = value
+    delay = float(args.pop('delay', 0))
+    if 'error' in args:
+        return Error(int(args['error']), args.get('message'), delay=delay)
+    if words[0] == 'ok':
+        return OK(int(args.get('affected', 0)), int(args.get('insert_id', 0)),
+                  int(args.get('warnings', 0)), delay=delay)
+    if 'rows' in args:
+        types = args.get('types')
+        return synthetic(int(args['rows']), int(args.get('cols', 1)),
+                         types and types.split(',') or DEFAULT_TYPES,
+                         int(args.get('size', 16)),
+                         float(args.get('nulls', 0)), delay)
+    raise ValueError("cannot tell what to respond to %r" % spec)
+
+
+def split_statements(query):
+    """Split query on semicolons outside quotes into statements, each
+    stripped of surrounding whitespace as the server does."""
+    statements, start, quote, i = [], 0, None, 0
+    while i < len(query):
+        ch = query[i]
+        if quote:
+            if ch == '\\':
+                i += 1
+            elif ch == quote:
+                quote = None
+        elif ch in '\'"`':
+            quote = ch
+        elif ch == ';':
+            statements.append(query[start:i].strip())
+            start = i + 1
+        i += 1
+    tail = query[start:].strip()
+    if tail or not statements:
+        statements.append(tail)
+    return statements
+
+
+class Connection(SocketServer.BaseRequestHandler):
+
+    """Serves one client connection."""
+
+    def setup(self):
+        self.seq = 0
+        self.buf = ''
+
+    def send(self, payloads):
+        data, self.seq = frame(payloads, self.seq)
+        self.request.sendall(data)
+
+    def recv_exact(self, n):
+        while len(self.buf) < n:
+            data = self.request.recv(max(n - len(self.buf), 65536))
+            if not data:
+                raise EOFError
+            self.buf += data
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def read_packet(self):
+        payload = []
+        while True:
+            header = self.recv_exact(4)
+            length = struct.unpack('<I', header[:3] + '\0')[0]
+            self.seq = ord(header[3]) + 1
+            payload.append(self.recv_exact(length))
+            if length < 0xffffff:
+                return ''.join(payload)
+
+    def handshake(self):
+        server = self.server.mock
+        scramble = os.urandom(20).replace('\0', '\1')
+        self.send(['\x0a' + server.version + '\0' +
+                   struct.pack('<I', server.next_thread_id()) +
+                   scramble[:8] + '\0' +
+                   struct.pack('<HBHHB', CAPABILITIES & 0xffff, UTF8_CHARSET,
+                               SERVER_STATUS_AUTOCOMMIT, CAPABILITIES >> 16,
+                               21) +
+                   '\0' * 10 + scramble[8:] + '\0' +
+                   'mysql_native_password\0'])
+        self.read_packet()
+        self.send([ok_packet()])
+
+    def handle(self):
+        server = self.server.mock
+        try:
+            self.handshake()
+            while True:
+                packet = self.read_packet()
+                command, arg = ord(packet[0]), packet[1:]
+                if server.latency:
+                    time.sleep(server.latency)
+                if command == COM_QUIT:
+                    return
+                elif command == COM_QUERY:
+                    server.queries += 1
+                    self.query(arg)
+                elif command in (COM_INIT_DB, COM_PING, COM_CHANGE_USER,
+                                 COM_RESET_CONNECTION):
+                    self.send([ok_packet()])
+                elif command == COM_SET_OPTION:
+                    self.send([eof_packet(0, False)])
+                elif command == COM_STATISTICS:
+                    self.send(["Uptime: 1  Threads: 1  Questions: %d"
+                               % server.queries])
+                else:
+                    self.send(Error(1047, "Unknown command").packets(False))
+        except (EOFError, socket.error):
+            pass
+
+    def query(self, query):
+        server = self.server.mock
+        parts = server.cache.get(query)
+        if parts is None:
+            responses, cacheable = [], True
+            for statement in split_statements(query):
+                found, fixed = server.respond(statement)
+                responses.extend(found)
+                cacheable = cacheable and fixed
+            # Like mysqld, stop at the first statement that fails.
+            for i, response in enumerate(responses):
+                if isinstance(response, Error):
+                    del responses[i + 1:]
+                    break
+            # Replies to a query always start at sequence number 1, so
+            # the framed bytes can be reused.
+            parts, seq = [], 1
+            for i, response in enumerate(responses):
+                packets = response.packets(i < len(responses) - 1)
+                if packets is None:
+                    parts.append((response.delay, None))
+                    break
+                data, seq = frame(packets, seq)
+                parts.append((response.delay, data))
+            if cacheable and len(query) <= 1024 and \
+                    len(server.cache) < server.cache_size:
+                server.cache[query] = parts
+        for delay, data in parts:
+            if delay:
+                time.sleep(delay)
+            if data is None:
+                raise EOFError
+            self.request.sendall(data)
+
+
+class MockServer(object):
+
+    """A fake server on a unix socket (a temporary one by default) or,
+    if port is given, on 127.0.0.1:port (0 picks a free port).
+
+    rules
+      (regular expression, response) pairs tried in order on each
+      statement, case-insensitively; response is a "mock ..." string or
+      a function of the statement returning one, a Response or a list
+      of Responses
+
+    latency
+      seconds slept before answering every command
+
+    version
+      the server version sent in the handshake
+
+    """
+
+    def __init__(self, socket=None, port=None, rules=(), latency=0.0,
+                 version="5.7.99-mock", cache_size=1024):
+        self.rules = [ (re.compile(pattern, re.I), response)
+                       for pattern, response in rules ]
+        self.latency = latency
+        self.version = version
+        self.cache = {}
+        self.cache_size = cache_size
+        self.queries = 0
+        self.socket = None
+        self.port = None
+        self._dir = None
+        self._thread_id = 0
+        self._lock = threading.Lock()
+        if port is not None:
+            self.server = ThreadingTCPServer(('127.0.0.1', port), Connection)
+            self.port = self.server.server_address[1]
+        else:
+            if socket is None:
+                self._dir = tempfile.mkdtemp(prefix="mysqldb-mock-")
+                socket = os.path.join(self._dir, "mock.sock")
+            elif os.path.exists(socket):
+                os.unlink(socket)
+            self.server = ThreadingUnixServer(socket, Connection)
+            self.socket = socket
+        self.server.mock = self
+        self._thread = None
+
+    def add(self, pattern, response):
+        """Add a rule after the existing ones."""
+        self.rules.append((re.compile(pattern, re.I), response))
+        self.cache.clear()
+
+    def next_thread_id(self):
+        self._lock.acquire()
+        try:
+            self._thread_id += 1
+            return self._thread_id
+        finally:
+            self._lock.release()
+
+    def respond(self, statement):
+        """Return (responses, cacheable) for one statement."""
+        for pattern, response in self.rules:
+            if pattern.search(statement):
+                if callable(response):
+                    response = response(statement)
+                    cacheable = False
+                else:
+                    cacheable = True
+                if isinstance(response, basestring):
+                    response = parse(response)
+                if isinstance(response, Response):
+                    response = [response]
+                return response, cacheable
+        if SPEC.match(statement):
+            return [parse(statement)], True
+        if OK_STATEMENTS.match(statement):
+            return [OK()], True
+        if WARNINGS.match(statement):
+            return [Result([('Level', 'var_string'), ('Code', 'long'),
+                            ('Message', 'var_string')], [])], True
+        return [Error(1064, "mock server has no response for: %s"
+                      % statement.strip()[:200], "42000")], True
+
+    def start(self):
+        """Serve in a background thread."""
+        self._thread = threading.Thread(target=self.server.serve_forever)
+        self._thread.daemon = True
+        self._thread.start()
+        return self
+
+    def stop(self):
+        self.server.shutdown()
+        self.server.server_close()
+        if self.socket and os.path.exists(self.socket):
+            os.unlink(self.socket)
+        if self._dir:
+            os.rmdir(self._dir)
+
+    def connect_args(self):
+        """Keyword arguments for MySQLdb.connect() to reach the server."""
+        if self.port is not None:
+            return dict(host='127.0.0.1', port=self.port)
+        return dict(unix_socket=self.socket)
+
+    def __enter__(self):
+        return self.start()
+
+    def __exit__(self, *exc):
+        self.stop()
+
+
+class ThreadingUnixServer(SocketServer.ThreadingMixIn,
+                          SocketServer.UnixStreamServer):
+    daemon_threads = True
+
+
+class ThreadingTCPServer(SocketServer.ThreadingMixIn,
+                         SocketServer.TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def main():
+    parser = OptionParser(usage="%prog [options]")
+    parser.add_option("--socket", help="unix socket to listen on")
+    parser.add_option("--port", type="int",
+                      help="listen on 127.0.0.1:PORT instead")
+    parser.add_option("--latency", type="float", default=0.0,
+                      help="seconds to wait before every response")
+    parser.add_option("--rule", action="append", nargs=2, default=[],
+                      metavar="REGEX RESPONSE",
+                      help="answer statements matching REGEX with RESPONSE"
+                      " (a mock specification); may be repeated")
+    options, args = parser.parse_args()
+    if not options.socket and options.port is None:
+        parser.error("give --socket or --port")
+    server = MockServer(options.socket, options.port, options.rule,
+                        options.latency)
+    sys.stderr.write("listening on %s\n" % (server.socket or
+                                            "127.0.0.1:%d" % server.port))
+    try:
+        server.server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    server.server.server_close()
+    if server.socket:
+        os.unlink(server.socket)
+
+
+if __name__ == "__main__":
+    main()
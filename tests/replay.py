@@ -0,0 +1,218 @@
+#!/usr/bin/env python
+"""Replays traffic recorded by MySQLdb.capture, for benchmarking the
+client against production-shaped queries and results offline.
+
+Record with a QueryCapture passed to MySQLdb.connect():
+
+    from MySQLdb.capture import QueryCapture
+    capture = QueryCapture("traffic.capture", max_rows=10000)
+    db = MySQLdb.connect(..., capture=capture)
+    ...
+    capture.close()
+
+then replay in one of two modes:
+
+    python tests/replay.py traffic.capture [--json]
+    python tests/replay.py --mock traffic.capture [--json]
+
+The default, decode, feeds each recorded result set through the code
+that turns rows into Python values, without a server: the C code of
+result.fetch_all() (by way of _mysql._synthetic_result), then the
+default decoders and row formatter, as the cursor applies them.
+
+--mock serves the recording from tests/mockserver.py and runs every
+recorded statement again, in order, through a real connection and
+cursor, so that the protocol handling of the client library is timed
+as well. A statement recorded more than once is answered with the
+results of its first execution.
+
+Either way, the times are reported per statement digest (see
+MySQLdb.slowlog.digest), the costliest first; each mode is run --loops
+times and the fastest run is kept.
+"""
+
+import json
+import sys
+import time
+from optparse import OptionParser
+
+import _mysql
+import MySQLdb
+from MySQLdb.capture import Replay, ReplayedError
+from MySQLdb.converters import default_decoders, default_row_formatter, \
+    get_codec
+from MySQLdb.slowlog import digest
+from mockserver import MockServer, OK, Error, RawResult, split_statements
+
+
+class Totals(object):
+
+    """Counts and best times, by digest."""
+
+    def __init__(self):
+        self.digests = {}
+
+    def add(self, query, results, rows, **times):
+        entry = self.digests.get(digest(query))
+        if entry is None:
+            entry = self.digests[digest(query)] = {
+                'count': 0, 'results': 0, 'rows': 0, 'times': {}}
+        entry['count'] += 1
+        entry['results'] += results
+        entry['rows'] += rows
+        for name, t in times.items():
+            entry['times'][name] = entry['times'].get(name, 0.0) + t
+
+    def report(self, top):
+        def total(item):
+            return sum(item[1]['times'].values())
+        items = sorted(self.digests.items(), key=total, reverse=True)
+        return items[:top or None]
+
+
+def decode(replay, loops):
+    """Time fetching and decoding every recorded result set."""
+    totals = Totals()
+    for record in replay:
+        if isinstance(record, ReplayedError) or not record.fields:
+            continue
+        rows = record.rows()
+        synthetic = _mysql._synthetic_result(rows)
+        fetch_ns = min([ synthetic.decode() for i in range(loops) ])
+        result = record.open()
+        decoders = tuple([ get_codec(f, default_decoders)
+                           for f in result.fields ])
+        fetched = synthetic.fetch_all()
+        runs = []
+        for i in range(loops):
+            t = time.time()
+            map(default_row_formatter, [decoders] * len(fetched), fetched)
+            runs.append(time.time() - t)
+        totals.add(record.query, 1, len(rows), fetch=fetch_ns / 1e9,
+                   convert=min(runs))
+    return totals
+
+
+class ReplayServer(MockServer):
+
+    """A mock server answering each recorded statement with what was
+    recorded for it, and anything else as MockServer does."""
+
+    def __init__(self, replay, **kwargs):
+        MockServer.__init__(self, **kwargs)
+        self.responses = {}
+        for query, records in replay.queries():
+            statements = split_statements(query)
+            if statements[0] in self.responses:
+                continue
+            responses = map(response, records)
+            if len(statements) == len(responses):
+                for statement, r in zip(statements, responses):
+                    self.responses.setdefault(statement, [r])
+            else:
+                self.responses[statements[0]] = responses
+                for statement in statements[1:]:
+                    self.responses.setdefault(statement, [])
+
+    def respond(self, statement):
+        found = self.responses.get(statement)
+        if found is not None:
+            return found, True
+        return MockServer.respond(self, statement)
+
+
+def response(record):
+    if isinstance(record, ReplayedError):
+        return Error(record.errno, record.message)
+    lastrowid, affected, warnings = record.status[:3]
+    if not record.fields:
+        return OK(affected, lastrowid, warnings)
+    return RawResult(record.fields, record.rows(), warnings)
+
+
+def mock(replay, loops):
+    """Time running every recorded statement against a ReplayServer."""
+    queries = replay.queries()
+    charset = 'utf8'
+    for record in replay:
+        if not isinstance(record, ReplayedError) and record.charset:
+            charset = record.charset
+            break
+    server = ReplayServer(replay).start()
+    try:
+        db = MySQLdb.connect(charset=charset, **server.connect_args())
+        try:
+            best = None
+            for i in range(loops):
+                totals = Totals()
+                cursor = db.cursor()
+                for query, records in queries:
+                    t = time.time()
+                    rows = results = 0
+                    try:
+                        cursor.execute(query)
+                        while True:
+                            rows += len(cursor.fetchall())
+                            results += 1
+                            if not cursor.nextset():
+                                break
+                    except MySQLdb.Error:
+                        pass
+                    totals.add(query, results, rows, run=time.time() - t)
+                cursor.close()
+                if best is None or total_time(totals) < total_time(best):
+                    best = totals
+            return best
+        finally:
+            db.close()
+    finally:
+        server.stop()
+
+
+def total_time(totals):
+    return sum([ sum(e['times'].values())
+                 for e in totals.digests.values() ])
+
+
+def main():
+    parser = OptionParser(usage="%prog [options] capture-file")
+    parser.add_option("--mock", action="store_true",
+                      help="replay through tests/mockserver.py")
+    parser.add_option("--loops", type="int", default=3,
+                      help="runs; the fastest is reported")
+    parser.add_option("--top", type="int", default=20,
+                      help="digests to print, the costliest first"
+                      " (0: all)")
+    parser.add_option("--json", action="store_true",
+                      help="print the results as JSON")
+    options, args = parser.parse_args()
+    if len(args) != 1:
+        parser.error("give one capture file")
+    replay = Replay(args[0])
+    if options.mock:
+        totals = mock(replay, options.loops)
+    else:
+        totals = decode(replay, options.loops)
+    items = totals.report(options.top)
+    if options.json:
+        print json.dumps({
+            'mode': options.mock and 'mock' or 'decode',
+            'capture': {'started': replay.started,
+                        'client': replay.client_info},
+            'client': _mysql.get_client_info(),
+            'digests': [ dict(entry, digest=text) for text, entry in items ],
+            }, indent=2, sort_keys=True)
+        return
+    names = options.mock and ['run'] or ['fetch', 'convert']
+    print "%8s %8s %10s " % ("count", "results", "rows") + \
+        " ".join([ "%10s" % (name + " ms") for name in names ]) + \
+        "  statement"
+    for text, entry in items:
+        print "%8d %8d %10d " % (entry['count'], entry['results'],
+                                 entry['rows']) + \
+            " ".join([ "%10.2f" % (entry['times'].get(name, 0.0) * 1e3)
+                       for name in names ]) + "  " + text[:80]
+
+
+if __name__ == "__main__":
+    main()
@@ -93,6 +93,256 @@ class test_MySQLdb(capabilities.DatabaseTest):
         self.failUnless(values == "(%s, %s, %s)")
         self.failUnless(end == "")
         
+    def test_lazy_warnings(self):
+        kwargs = dict(self.connect_kwargs, warnings_policy='lazy')
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            c = db.cursor()
+            # would raise under warnings.filterwarnings('error') if eager
+            c.execute("SELECT CAST('1x' AS SIGNED)")
+            self.failUnless(c.warnings())
+            self.failUnless(c.messages)
+        finally:
+            db.close()
+
+    def test_eager_warnings(self):
+        c = self.connection.cursor()
+        self.assertRaises(self.db_module.Warning, c.execute,
+                          "SELECT CAST('1x' AS SIGNED)")
+
+    def test_warnings_off(self):
+        kwargs = dict(self.connect_kwargs, warnings_policy='off')
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            c = db.cursor()
+            c.execute("SELECT CAST('1x' AS SIGNED)")
+            self.assertEquals(c.messages, [])
+            # still there on request
+            self.failUnless(c.warnings())
+        finally:
+            db.close()
+
+    def test_lazy_warnings_unbuffered(self):
+        kwargs = dict(self.connect_kwargs, warnings_policy='lazy')
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            c = db.cursor()
+            c.use_result = True
+            # the DO leaves warnings pending while SELECT 2 is unread
+            c.execute("DO CAST('1x' AS SIGNED); SELECT 2")
+            self.failUnless(c.nextset())
+            self.assertEquals(c.fetchone(), (2,))
+            c.execute("DO CAST('1x' AS SIGNED); SELECT 3")
+            c.execute("SELECT 4")
+            self.assertEquals(c.fetchall(), [(4,)])
+        finally:
+            db.close()
+
+    def test_eager_warnings_multi_statement(self):
+        c = self.connection.cursor()
+        # SHOW WARNINGS for the DO cannot be sent while SELECT 2 is
+        # pending, so they are deferred rather than breaking the query
+        c.execute("DO CAST('1x' AS SIGNED); SELECT 2")
+        self.failUnless(c.nextset())
+        self.assertEquals(c.fetchone(), (2,))
+        self.failIf(c.nextset())
+        c.execute("SELECT 3")
+        self.assertEquals(c.fetchall(), [(3,)])
+
+    def test_result_cache(self):
+        from MySQLdb.cache import ResultCache
+        cache = ResultCache(ttl=60)
+        kwargs = dict(self.connect_kwargs, result_cache=cache)
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            self.create_table(('pos INT', 'tree CHAR(20)'))
+            self.cursor.execute("INSERT INTO %s VALUES (1, 'ash'), (2, NULL)" % self.table)
+            c = db.cursor()
+            query = "SELECT pos, tree FROM %s ORDER BY pos" % self.table
+            c.execute(query)
+            rows = c.fetchall()
+            c.execute(query)
+            self.assertEquals(c.fetchall(), rows)
+            self.assertEquals(cache.hits, 1)
+            cache.invalidate(self.table.strip('`'))
+            self.assertEquals(len(cache), 0)
+        finally:
+            db.close()
+            self.cursor.execute('drop table %s' % (self.table))
+
+    def test_result_cache_scope(self):
+        from MySQLdb.cache import ResultCache
+        cache = ResultCache(ttl=60)
+        kwargs = dict(self.connect_kwargs, result_cache=cache)
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            self.create_table(('pos INT',))
+            self.cursor.execute("INSERT INTO %s VALUES (1)" % self.table)
+            c = db.cursor()
+            # no column of an aggregate has an org_table
+            query = "SELECT COUNT(*) FROM %s" % self.table
+            c.execute(query)
+            self.assertEquals(len(cache), 1)
+            cache.invalidate(self.table.strip('`'))
+            self.assertEquals(len(cache), 0)
+            key = cache.key(db, query)
+            db.select_db('mysql')
+            self.assertNotEquals(cache.key(db, query), key)
+            c.execute("USE test")
+            self.assertEquals(cache.key(db, query), key)
+            for query in ("SELECT pos FROM t FOR UPDATE",
+                          "SELECT pos FROM t LOCK IN SHARE MODE",
+                          "SELECT pos INTO @pos FROM t",
+                          "SELECT NOW()", "SELECT RAND()", "SELECT UUID()",
+                          "SELECT GET_LOCK('a', 0)", "SELECT LAST_INSERT_ID()"):
+                self.failIf(cache.cacheable(query), query)
+        finally:
+            db.close()
+            self.cursor.execute('drop table %s' % (self.table))
+
+    def test_max_result_memory(self):
+        kwargs = dict(self.connect_kwargs, max_result_memory=4096)
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            c = db.cursor()
+            c.execute("SELECT 1")
+            self.assertTrue(0 < db.memory_high_water < 4096)
+            self.assertRaises(db.OperationalError, c.execute,
+                              "SELECT REPEAT('x', 8192)")
+            self.assertTrue(db.memory_high_water > 4096)
+            c.execute("SELECT 2")
+            self.assertEquals(c.fetchall(), [(2,)])
+        finally:
+            db.close()
+
+    def test_slow_query_log(self):
+        import json, os, tempfile
+        from MySQLdb.slowlog import SlowQueryLog, digest
+        self.assertEquals(digest("SELECT a FROM t WHERE b IN (1, 2) AND c = 'x'"),
+                          "SELECT a FROM t WHERE b IN (...) AND c = ?")
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        log = SlowQueryLog(path, threshold=0, explain_sample=1,
+                           explain_connect=dict(self.connect_kwargs))
+        kwargs = dict(self.connect_kwargs, slow_query_log=log)
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            c = db.cursor()
+            c.execute("SELECT 1 UNION ALL SELECT 2")
+            c.fetchall()
+            log.close()
+            entry = json.loads(open(path).readline())
+            self.assertEquals(entry['digest_text'],
+                              "SELECT ? UNION ALL SELECT ?")
+            self.assertEquals(entry['rows'], 2)
+            self.assertTrue(entry['call_site'].startswith(__file__.rstrip('c')))
+            self.assertTrue(entry['explain'])
+        finally:
+            db.close()
+            os.remove(path)
+
+    def test_slow_query_log_explain_selects_only(self):
+        import json, os, tempfile
+        from MySQLdb.slowlog import SlowQueryLog
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        log = SlowQueryLog(path, threshold=0, explain_sample=1,
+                           explain_connect=dict(self.connect_kwargs))
+        kwargs = dict(self.connect_kwargs, slow_query_log=log)
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            self.create_table(('n INT',))
+            self.cursor.execute("INSERT INTO %s VALUES (0)" % self.table)
+            self.connection.commit()
+            c = db.cursor()
+            c.execute("UPDATE %s SET n = n + 1" % self.table)
+            c.execute("SELECT n FROM %s; UPDATE %s SET n = n + 10"
+                      % (self.table, self.table))
+            c.fetchall()
+            while c.nextset():
+                pass
+            c.execute("SELECT n FROM %s WHERE n < 100" % self.table)
+            self.assertEquals(c.fetchall(), ((11,),))
+            db.commit()
+            log.close()
+            entries = [ json.loads(line) for line in open(path) ]
+            explained = [ e['query'] for e in entries if 'explain' in e ]
+            self.assertEquals(explained,
+                              ["SELECT n FROM %s WHERE n < 100" % self.table])
+            self.cursor.execute("SELECT n FROM %s" % self.table)
+            self.assertEquals(self.cursor.fetchall(), ((11,),))
+        finally:
+            db.close()
+            os.remove(path)
+
+    def test_streaming_window(self):
+        c = self.connection.cursor()
+        c.use_result = True
+        c.max_buffer = 10
+        try:
+            self.create_table(('pos INT',))
+            self.cursor.executemany("INSERT INTO %s VALUES (%%s)" % self.table,
+                                    [ (i,) for i in range(100) ])
+            c.execute("SELECT pos FROM %s ORDER BY pos" % self.table)
+            self.assertEquals(c.fetchmany(50)[-1], (49,))
+            c.scroll(-3)
+            self.assertEquals(c.fetchone(), (47,))
+            self.assertEquals(c.fetchmany(5)[-1], (52,))
+            self.assertTrue(len(c._result.rows) <= 20)
+            self.assertRaises(self.connection.NotSupportedError,
+                              c.scroll, 0, 'absolute')
+            self.assertEquals(len(c.fetchall()), 47)
+        finally:
+            c.close()
+            self.cursor.execute('drop table %s' % (self.table))
+
+    def test_spill_dir(self):
+        c = self.connection.cursor()
+        c.spill_dir = ''
+        c.max_buffer = 10
+        try:
+            self.create_table(('pos INT', 'tree CHAR(20)'))
+            self.cursor.executemany("INSERT INTO %s VALUES (%%s, %%s)" % self.table,
+                                    [ (i, i % 3 and 'ash' or None) for i in range(100) ])
+            c.execute("SELECT pos, tree FROM %s ORDER BY pos" % self.table)
+            self.assertEquals(c._result.rowcount, 100)
+            self.assertEquals(len(c.fetchmany(60)), 60)
+            c.scroll(3, 'absolute')
+            self.assertEquals(c.fetchone(), (3, None))
+            c.scroll(90, 'absolute')
+            self.assertEquals(c.fetchone(), (90, None))
+            self.assertEquals(len(c.fetchall()), 9)
+        finally:
+            c.close()
+            self.cursor.execute('drop table %s' % (self.table))
+
+    def test_spill_dir_rows_counted_once(self):
+        import json, os, tempfile
+        from MySQLdb.slowlog import SlowQueryLog
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        log = SlowQueryLog(path, threshold=0)
+        kwargs = dict(self.connect_kwargs, slow_query_log=log)
+        db = self.db_module.connect(*self.connect_args, **kwargs)
+        try:
+            c = db.cursor()
+            c.spill_dir = ''
+            c.max_buffer = 2
+            c.execute("SELECT 1 UNION ALL SELECT 2 UNION ALL SELECT 3"
+                      " UNION ALL SELECT 4")
+            for i in range(3):
+                c.fetchone()
+            # row 0 is no longer buffered, so it is read again from the
+            # spill file, but not counted again
+            c.scroll(0, 'absolute')
+            self.assertEquals(len(c.fetchall()), 4)
+            log.close()
+            entry = json.loads(open(path).readline())
+            self.assertEquals(entry['rows'], 4)
+        finally:
+            db.close()
+            os.remove(path)
+
     def test_ping(self):
         self.connection.ping()
 
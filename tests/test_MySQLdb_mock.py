@@ -0,0 +1,99 @@
+import os
+import tempfile
+import time
+import unittest
+from datetime import datetime
+
+import MySQLdb
+from MySQLdb.capture import QueryCapture, Replay
+from mockserver import MockServer, OK
+from replay import ReplayServer
+
+
+class MockServerTest(unittest.TestCase):
+    """Client behaviour against tests/mockserver.py; needs no database."""
+
+    def setUp(self):
+        self.server = MockServer(rules=[
+            (r"FROM t\b", "mock rows=3 cols=3 types=int,varchar,datetime"
+                          " size=5 nulls=0.25"),
+            (r"^UPDATE", lambda statement: OK(affected=7)),
+            ]).start()
+        self.conn = MySQLdb.connect(**self.server.connect_args())
+        self.cursor = self.conn.cursor()
+
+    def tearDown(self):
+        self.conn.close()
+        self.server.stop()
+
+    def test_result(self):
+        self.cursor.execute("SELECT * FROM t")
+        self.assertEquals([ d[0] for d in self.cursor.description ],
+                          ['c0', 'c1', 'c2'])
+        self.assertEquals(self.cursor.fetchall(),
+                          [(0, 'r0c1:', datetime(2024, 1, 1, 0, 2, 0)),
+                           (None, 'r1c1:', datetime(2024, 1, 2, 1, 2, 1)),
+                           (2000, None, datetime(2024, 1, 3, 2, 2, 2))])
+
+    def test_multi_results(self):
+        self.cursor.execute("mock rows=1 cols=1; UPDATE x; mock rows=2 cols=1")
+        self.assertEquals(self.cursor.fetchall(), [(0,)])
+        self.assertTrue(self.cursor.nextset())
+        self.assertEquals(self.cursor.description, None)
+        self.assertTrue(self.cursor.nextset())
+        self.assertEquals(self.cursor.fetchall(), [(0,), (1000,)])
+        self.assertFalse(self.cursor.nextset())
+
+    def test_error(self):
+        try:
+            self.cursor.execute("mock error=1205 message=Lock wait timeout")
+        except MySQLdb.DatabaseError, e:
+            self.assertEquals(e.args, (1205, 'Lock wait timeout'))
+        else:
+            self.fail("no error raised")
+        self.assertRaises(MySQLdb.ProgrammingError,
+                          self.cursor.execute, "SELECT no_rule")
+
+    def test_disconnect(self):
+        self.assertRaises(MySQLdb.OperationalError,
+                          self.cursor.execute, "mock disconnect")
+
+    def test_delay(self):
+        t = time.time()
+        self.cursor.execute("mock ok delay=0.05")
+        self.assertTrue(time.time() - t >= 0.05)
+
+    def test_capture_replay(self):
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        try:
+            capture = QueryCapture(path)
+            conn = MySQLdb.connect(capture=capture,
+                                   **self.server.connect_args())
+            cursor = conn.cursor()
+            cursor.execute("SELECT * FROM t")
+            rows = cursor.fetchall()
+            self.assertRaises(MySQLdb.DatabaseError, cursor.execute,
+                              "mock error=1205")
+            conn.close()
+            capture.close()
+            records = list(Replay(path))
+            self.assertEquals([ r.query for r in records ],
+                              ["SELECT * FROM t", "mock error=1205"])
+            self.assertEquals(records[0].nrows, 3)
+            self.assertEquals(records[1].errno, 1205)
+            replayed = ReplayServer(Replay(path)).start()
+            try:
+                conn = MySQLdb.connect(**replayed.connect_args())
+                cursor = conn.cursor()
+                cursor.execute("SELECT * FROM t")
+                self.assertEquals(cursor.fetchall(), rows)
+                conn.close()
+            finally:
+                replayed.stop()
+        finally:
+            os.remove(path)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -39,6 +39,33 @@ class CoreModule(unittest.TestCase):
     def test_thread_safe(self):
         self.assertTrue(isinstance(_mysql.thread_safe(), int))
 
+    def test_aggregate_latency(self):
+        previous = _mysql.aggregate_latency(False)
+        try:
+            self.assertEquals(_mysql.aggregate_latency(True), False)
+            _mysql.latency(reset=True)
+            latency = _mysql.latency()
+            self.assertEquals(latency['query'].count, 0)
+            self.assertEquals(latency['result'].snapshot()['buckets'], [])
+        finally:
+            _mysql.aggregate_latency(previous)
+
+    def test_synthetic_result(self):
+        rows = [('1', None, 'a\0b'), ('22', '', "it's")]
+        result = _mysql._synthetic_result(rows)
+        self.assertEquals(result.fetch_all(), rows)
+        self.assertTrue(result.decode(loops=2) >= 0)
+        self.assertTrue(result.escape(quote=True) >= 0)
+        self.assertRaises(ValueError, _mysql._synthetic_result,
+                          [('1',), ('1', '2')])
+
+    def test_free_list_stats(self):
+        stats = _mysql.free_list_stats()
+        for kind in ('result', 'field'):
+            self.assertEqual(sorted(stats[kind].keys()),
+                             ['free', 'hits', 'misses', 'size'])
+            self.assertTrue(stats[kind]['free'] <= stats[kind]['size'])
+
 
 class CoreAPI(unittest.TestCase):
     """Test _mysql interaction internals."""
@@ -62,6 +89,277 @@ class CoreAPI(unittest.TestCase):
                           "Should return 0 before we do anything.")
 
 
+    def test_status(self):
+        self.conn.query("SELECT 1")
+        self.conn.get_result()
+        status = self.conn.status()
+        self.assertEquals(len(status), 5)
+        insert_id, affected_rows, warning_count, info, charset = status
+        self.assertEquals(affected_rows, 1)
+        self.assertEquals(insert_id, self.conn.insert_id())
+        self.assertEquals(warning_count, self.conn.warning_count())
+        self.assertEquals(charset, self.conn.character_set_name())
+
+    def test_query_buffer(self):
+        self.conn.query(bytearray("SELECT 'a'"))
+        self.assertEquals(self.conn.get_result().fetch_row(), ('a',))
+        self.conn.query_parts(["SELECT ", bytearray("'b'"), buffer(", 2")])
+        self.assertEquals(self.conn.get_result().fetch_row(), ('b', '2'))
+        self.assertRaises(TypeError, self.conn.query_parts, ["SELECT", 1])
+        # old-style buffers are copied before the GIL is released
+        from array import array
+        self.conn.query(array('c', "SELECT 'c'"))
+        self.assertEquals(self.conn.get_result().fetch_row(), ('c',))
+        self.conn.query_parts(["SELECT ", array('c', "'d'")])
+        self.assertEquals(self.conn.get_result().fetch_row(), ('d',))
+
+    def test_fetch_all(self):
+        self.conn.query("SELECT 1, NULL UNION ALL SELECT 2, 'x'")
+        result = self.conn.get_result()
+        self.assertEquals(result.fetch_row(), ('1', None))
+        self.assertEquals(result.fetch_all(), [('2', 'x')])
+        self.assertEquals(result.fetch_all(), [])
+
+    def test_memory_usage(self):
+        self.conn.query("SELECT REPEAT('x', 1000)")
+        result = self.conn.get_result()
+        self.assertTrue(result.memory_usage() > 1000)
+
+    def test_spill_dir(self):
+        import tempfile
+        self.conn.query("SELECT 1 UNION ALL SELECT NULL UNION ALL SELECT 3")
+        result = self.conn.get_result(spill_dir=tempfile.gettempdir())
+        self.assertEquals(result.num_rows(), 3)
+        self.assertEquals(result.fetch_all(), [('1',), (None,), ('3',)])
+        result.data_seek(1)
+        self.assertEquals(result.row_tell(), 1)
+        self.assertEquals(result.fetch_row(), (None,))
+
+    def test_copy_to(self):
+        from StringIO import StringIO
+        self.conn.query("SELECT 'a,b' AS x, NULL AS y, '' AS z")
+        result = self.conn.get_result()
+        out = StringIO()
+        self.assertEquals(result.copy_to(out, header=True), 1)
+        self.assertEquals(out.getvalue(), 'x,y,z\r\n"a,b",,""\r\n')
+        self.conn.query("SELECT 'a\tb', NULL")
+        result = self.conn.get_result(use=1)
+        out = StringIO()
+        result.copy_to(out, format='tsv')
+        self.assertEquals(out.getvalue(), 'a\\tb\t\\N\n')
+
+    def test_write_arrow(self):
+        import datetime
+        from decimal import Decimal
+        from arrow_reader import read_stream
+        self.conn.query("SELECT 1 AS i, 2.5e0 AS f,"
+                        " CAST('-1.25' AS DECIMAL(5,2)) AS d,"
+                        " DATE('2024-01-02') AS dt, 'x' AS s, NULL AS n"
+                        " UNION ALL SELECT -7, NULL, NULL, NULL, '', NULL")
+        data = self.conn.get_result().write_arrow(batch_rows=1)
+        names, rows = read_stream(data)
+        self.assertEquals(names, ['i', 'f', 'd', 'dt', 's', 'n'])
+        self.assertEquals(rows,
+                          [(1, 2.5, Decimal('-1.25'), datetime.date(2024, 1, 2),
+                            u'x', None),
+                           (-7, None, None, None, u'', None)])
+
+    def test_fetch_into(self):
+        import struct
+        self.conn.query("SELECT 1 AS i, 2.5e0 AS f, 'x' AS s,"
+                        " TIMESTAMP('1970-01-02 00:00:01.5') AS t"
+                        " UNION ALL SELECT NULL, 0.5e0, 'y', NULL")
+        result = self.conn.get_result()
+        self.assertRaises(ValueError, result.fetch_into, bytearray(64), "if")
+        self.assertRaises(TypeError, result.fetch_into, bytearray(64), "iiiM")
+        buf, nulls = bytearray(48), bytearray(6)
+        self.assertEquals(result.fetch_into(buf, "ifxM", nulls=nulls), 2)
+        self.assertEquals(struct.unpack('=qdqqdq', str(buf)),
+                          (1, 2.5, 86401500000, 0, 0.5, -2**63))
+        self.assertEquals(list(nulls), [0, 0, 0, 1, 0, 1])
+        self.assertEquals(result.fetch_into(buf, "ifxM"), 0)
+
+    def test_blob_streaming(self):
+        from StringIO import StringIO
+        data = ''.join([ chr(i % 256) for i in range(100000) ])
+        self.conn.query("CREATE TEMPORARY TABLE blob_test (b LONGBLOB)")
+        self.assertEquals(self.conn.stmt_execute(
+            "INSERT INTO blob_test VALUES (?)", [StringIO(data)],
+            chunk_size=4096), 1)
+        blob = self.conn.open_blob("SELECT b FROM blob_test")
+        self.assertEquals(blob.size, len(data))
+        self.assertEquals(blob.read(10), data[:10])
+        blob.seek(-10, 2)
+        self.assertEquals(blob.read(), data[-10:])
+        blob.close()
+        self.assertTrue(blob.closed)
+        self.assertEquals(self.conn.open_blob("SELECT NULL"), None)
+
+    def test_blob_after_close(self):
+        other = _mysql.connect(db='test', read_default_file="~/.my.cnf")
+        blob = other.open_blob("SELECT REPEAT('x', 1000)")
+        self.assertEquals(blob.read(10), 'x' * 10)
+        other.close()
+        # the row lived in the connection's buffers, which are gone now
+        self.assertRaises(_mysql.Error, blob.read, 10)
+        self.assertRaises(_mysql.Error, blob.readinto, bytearray(10))
+        blob.close()
+        self.assertTrue(blob.closed)
+
+    def test_stats(self):
+        self.conn.reset_stats()
+        self.conn.query("SELECT 1 UNION ALL SELECT 2")
+        self.conn.get_result().fetch_all()
+        self.assertRaises(MySQLdb.ProgrammingError, self.conn.query, "SELEKT")
+        stats = self.conn.stats()
+        self.assertEquals(stats['queries'], 2)
+        self.assertEquals(stats['rows'], 2)
+        self.assertEquals(stats['errors'], {1064: 1})
+        self.assertTrue(stats['query_ns'] > 0)
+        self.conn.reset_stats()
+        self.assertEquals(self.conn.stats()['queries'], 0)
+
+    def test_latency(self):
+        self.conn.reset_stats()
+        self.conn.query("SELECT 1 UNION ALL SELECT 2")
+        self.conn.get_result(use=1).fetch_all()
+        latency = self.conn.latency()
+        self.assertEquals(latency['query'].count, 1)
+        self.assertEquals(latency['result'].count, 1)
+        h = _mysql.histogram()
+        for us in range(1, 1001):
+            h.record(us)
+        h.merge(latency['query'])
+        snapshot = h.snapshot()
+        self.assertEquals(snapshot['count'], 1001)
+        self.assertEquals(sum([ n for lo, hi, n in snapshot['buckets'] ]),
+                          1001)
+        self.assertTrue(480 <= snapshot['percentiles'][50] <= 520)
+        self.assertTrue(h.percentile(100) >= 1000)
+
+    def test_trace_hook(self):
+        import gc
+        events = []
+        def hook(event, conn, info):
+            events.append((event, info))
+        previous = _mysql.set_trace_hook(hook)
+        try:
+            self.conn.query("SELECT 1 UNION ALL SELECT 2")
+            result = self.conn.get_result(use=1)
+            self.assertEquals(result.fetch_all(), [('1',), ('2',)])
+            self.assertEquals([ e for e, info in events ],
+                              ['query', 'query_done', 'result', 'fetch_done'])
+            self.assertEquals(events[0][1]['sql'],
+                              "SELECT 1 UNION ALL SELECT 2")
+            self.assertEquals(events[1][1]['errno'], 0)
+            self.assertEquals(events[3][1]['rows'], 2)
+            result.clear()
+            self.conn.query("SELECT 3 UNION ALL SELECT 4")
+            result = self.conn.get_result(use=1)
+            self.assertEquals(result.fetch_row(), ('3',))
+            del events[:]
+            # the hook is not run when a result is collected
+            cycle = [result]
+            cycle.append(cycle)
+            del result, cycle
+            gc.collect()
+            self.assertEquals(events, [])
+        finally:
+            _mysql.set_trace_hook(previous)
+
+    def test_trace_hook_errors(self):
+        import sys
+        from StringIO import StringIO
+        events = []
+        def hook(event, conn, info):
+            events.append(event)
+            raise RuntimeError("hook failed")
+        previous = _mysql.set_trace_hook(hook)
+        stderr, sys.stderr = sys.stderr, StringIO()
+        try:
+            self.conn.query("SELECT 1")
+            self.assertEquals(self.conn.get_result().fetch_all(), [('1',)])
+            self.assertRaises(_mysql.ProgrammingError, self.conn.query,
+                              "SELEC 1")
+            self.assertTrue("hook failed" in sys.stderr.getvalue())
+        finally:
+            sys.stderr = stderr
+            _mysql.set_trace_hook(previous)
+        self.assertEquals(events, ['query', 'query_done', 'result',
+                                   'fetch_done', 'query', 'query_done'])
+
+    def test_gil_profile_threads(self):
+        import threading
+        other = _mysql.connect(db='test', read_default_file="~/.my.cnf")
+        def sleep():
+            other.query("SELECT SLEEP(0.1)")
+            other.get_result().fetch_all()
+        def hook(event, conn, info):
+            # another thread runs a profiled call while this one is in
+            # query_parts(); its released time is not charged here
+            if conn is self.conn and event == 'query':
+                thread = threading.Thread(target=sleep)
+                thread.start()
+                thread.join()
+        previous = _mysql.gil_profile(True)
+        _mysql.gil_stats(reset=True)
+        hook_previous = _mysql.set_trace_hook(hook)
+        try:
+            self.conn.query_parts(["SELECT ", "1"])
+            self.conn.get_result().fetch_all()
+        finally:
+            _mysql.set_trace_hook(hook_previous)
+            _mysql.gil_profile(previous)
+            other.close()
+        stats = _mysql.gil_stats()
+        self.assertTrue(stats['connection.query']['released_ns'] >= 9e7)
+        self.assertTrue(stats['connection.query_parts']['released_ns'] < 5e7)
+
+    def test_alloc_stats(self):
+        previous = _mysql.alloc_profile(True)
+        try:
+            _mysql.alloc_stats(reset=True)
+            self.conn.query("SELECT 'abc', NULL UNION ALL SELECT 'de', 'f'")
+            result = self.conn.get_result()
+            result.fetch_all()
+            result.clear()
+        finally:
+            _mysql.alloc_profile(previous)
+        # two tuples, 'abc', 'de' and the list; None and 'f' are shared
+        stats = result.alloc_stats()
+        self.assertEquals((stats['rows'], stats['objects']), (2, 5))
+        self.assertEquals(stats['objects_per_row'], 2.5)
+        self.assertEquals(_mysql.alloc_stats(), stats)
+
+    def test_closed(self):
+        self.assertFalse(self.conn.closed)
+        self.assertRaises(TypeError, setattr, self.conn, 'open', 0)
+
+    def test_compression_options(self):
+        def connect(**kwargs):
+            _mysql.connect(db='test', read_default_file="~/.my.cnf",
+                           **kwargs).close()
+        for value in ("zlib", "zstd", "uncompressed", "zstd,zlib,uncompressed"):
+            try:
+                connect(compression_algorithms=value)
+            except _mysql.NotSupportedError:
+                self.skipTest("client library without compression_algorithms")
+        connect(compression_algorithms="zstd", zstd_compression_level=1)
+        connect(compression_algorithms="zstd", zstd_compression_level=22)
+        self.assertRaises(_mysql.ProgrammingError, connect,
+                          compression_algorithms="lz4")
+        self.assertRaises(_mysql.ProgrammingError, connect,
+                          compression_algorithms="zlib,")
+        self.assertRaises(_mysql.ProgrammingError, connect,
+                          compression_algorithms="zstd",
+                          zstd_compression_level=23)
+
+    def test_reset(self):
+        self.conn.query("SET @reset_test = 1")
+        self.conn.reset()
+        self.conn.query("SELECT @reset_test")
+        self.assertEquals(self.conn.get_result().fetch_row(), (None,))
+
     #def test_debug(self):
         ## FIXME Only actually tests if you lack SUPER
         #self.assertRaises(MySQLdb.OperationalError,